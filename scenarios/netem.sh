@@ -0,0 +1,44 @@
+#!/bin/bash
+# Runs a scenario once per stripe count over loopback with artificial latency and loss (tc netem), like a
+# long-fat WAN link, and prints the download throughput of each run. A single TCP stream is limited by
+# its window over the round trip time and backs off on every loss, parallel data connections are not.
+#
+# Needs root for tc and a server on the address and port, e.g. from the build directory:
+#   WSTED_LOG_LEVEL=warning ./wsted-server 7999 &
+#   sudo ../scenarios/netem.sh ./wsted-loadgen ../scenarios/wan.ini 127.0.0.1 7999
+#
+# DELAY is added to every packet leaving lo, so the round trip time is twice as long. Defaults:
+#   DELAY=25ms LOSS=0.1% STRIPES="1 2 4 8"
+
+set -euo pipefail
+
+if [ $# -ne 4 ]; then
+    echo "Usage: $0 LOADGEN SCENARIO ADDRESS PORT" >&2
+    exit 1
+fi
+
+loadgen=$1
+scenario=$2
+address=$3
+port=$4
+delay=${DELAY:-25ms}
+loss=${LOSS:-0.1%}
+stripes=${STRIPES:-1 2 4 8}
+run=$(mktemp --suffix=.ini)
+
+cleanup() {
+    tc qdisc del dev lo root 2>/dev/null || true
+    rm -f "$run"
+}
+
+trap cleanup EXIT
+
+tc qdisc add dev lo root netem delay "$delay" loss "$loss"
+echo "lo: delay $delay, loss $loss" >&2
+
+for count in $stripes; do
+    # Same scenario, only the stripe count of the [files] section differs
+    sed "s/^stripes *=.*/stripes = $count/" "$scenario" > "$run"
+
+    echo "$count stripes: $("$loadgen" "$run" "$address" "$port" 2>/dev/null | grep '^Files')"
+done
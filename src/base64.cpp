@@ -0,0 +1,459 @@
+#include "base64.hpp"
+
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define BASE64_X86
+#include <immintrin.h>
+#endif
+
+namespace base64 {
+
+// Characters that are not part of the alphabet
+#define INVALID 0xff
+#define PADDING 0xfe
+
+static const char alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+struct DecodeTable {
+    quint8 values[256];
+
+    constexpr DecodeTable() : values() {
+        for (int i = 0; i < 256; i++) {
+            values[i] = INVALID;
+        }
+
+        for (int i = 0; i < 64; i++) {
+            values[static_cast<quint8>(alphabet[i])] = i;
+        }
+
+        values[static_cast<quint8>('=')] = PADDING;
+    }
+};
+
+static constexpr DecodeTable decodeTable;
+
+// Scalar
+
+static void encodeScalar(const quint8* in, qsizetype size, char* out) {
+    qsizetype i;
+
+    for (i = 0; i + 3 <= size; i += 3) {
+        quint32 value = in[i] << 16 | in[i + 1] << 8 | in[i + 2];
+
+        *out++ = alphabet[value >> 18];
+        *out++ = alphabet[(value >> 12) & 0x3f];
+        *out++ = alphabet[(value >> 6) & 0x3f];
+        *out++ = alphabet[value & 0x3f];
+    }
+
+    if (size - i == 1) {
+        *out++ = alphabet[in[i] >> 2];
+        *out++ = alphabet[(in[i] & 0x03) << 4];
+        *out++ = '=';
+        *out++ = '=';
+    } else if (size - i == 2) {
+        *out++ = alphabet[in[i] >> 2];
+        *out++ = alphabet[(in[i] & 0x03) << 4 | in[i + 1] >> 4];
+        *out++ = alphabet[(in[i + 1] & 0x0f) << 2];
+        *out++ = '=';
+    }
+}
+
+// Length is a multiple of 4, padding is only accepted in the last group
+static qsizetype decodeScalar(const quint8* in, qsizetype length, char* out, bool& isPadded) {
+    char* start = out;
+
+    for (qsizetype i = 0; i < length; i += 4) {
+        quint8 a = decodeTable.values[in[i]];
+        quint8 b = decodeTable.values[in[i + 1]];
+        quint8 c = decodeTable.values[in[i + 2]];
+        quint8 d = decodeTable.values[in[i + 3]];
+
+        if ((a | b | c | d) < 64) {
+            *out++ = static_cast<char>(a << 2 | b >> 4);
+            *out++ = static_cast<char>(b << 4 | c >> 2);
+            *out++ = static_cast<char>(c << 6 | d);
+            continue;
+        }
+
+        if (i + 4 != length || a >= 64 || b >= 64 || d != PADDING || (c >= 64 && c != PADDING)) {
+            return -1;
+        }
+
+        *out++ = static_cast<char>(a << 2 | b >> 4);
+
+        if (c != PADDING) {
+            *out++ = static_cast<char>(b << 4 | c >> 2);
+        }
+
+        isPadded = true;
+    }
+
+    return out - start;
+}
+
+static qsizetype encodeBlocksScalar(const quint8*, qsizetype, char*) {
+    return 0;
+}
+
+static qsizetype decodeBlocksScalar(const quint8*, qsizetype, char*) {
+    return 0;
+}
+
+#ifdef BASE64_X86
+
+// Vectorized encoding and decoding after Muła and Lemire, "Faster Base64 Encoding and Decoding using
+// AVX2 Instructions". Blocks return how much input they consumed and leave the rest to the scalar code.
+
+__attribute__((target("sse4.1"))) static inline __m128i encodeReshuffle(__m128i in) {
+    // Spread 3 bytes over the 4 bytes of each 32-bit lane, then move every 6 bits to its own byte
+    in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    __m128i t0 = _mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00));
+    __m128i t1 = _mm_mulhi_epu16(t0, _mm_set1_epi32(0x04000040));
+    __m128i t2 = _mm_and_si128(in, _mm_set1_epi32(0x003f03f0));
+    __m128i t3 = _mm_mullo_epi16(t2, _mm_set1_epi32(0x01000010));
+
+    return _mm_or_si128(t1, t3);
+}
+
+__attribute__((target("sse4.1"))) static inline __m128i encodeLookup(__m128i indices) {
+    // 0..25 -> 13, 26..51 -> 0, 52..61 -> 1..10, 62 -> 11, 63 -> 12, then the offset to the character
+    __m128i result = _mm_subs_epu8(indices, _mm_set1_epi8(51));
+    __m128i less = _mm_cmpgt_epi8(_mm_set1_epi8(26), indices);
+
+    result = _mm_or_si128(result, _mm_and_si128(less, _mm_set1_epi8(13)));
+    result = _mm_shuffle_epi8(_mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                                            '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62,
+                                            '/' - 63, 'A', 0, 0),
+                              result);
+
+    return _mm_add_epi8(result, indices);
+}
+
+__attribute__((target("sse4.1"))) static qsizetype encodeBlocksSse41(const quint8* in, qsizetype size,
+                                                                     char* out) {
+    qsizetype i;
+
+    // 16 bytes are loaded for the 12 that are encoded
+    for (i = 0; size - i >= 16; i += 12) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), encodeLookup(encodeReshuffle(block)));
+        out += 16;
+    }
+
+    return i;
+}
+
+__attribute__((target("sse4.1"))) static qsizetype decodeBlocksSse41(const quint8* in, qsizetype length,
+                                                                     char* out) {
+    const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13,
+                                        0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10,
+                                        0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m128i nibbleMask = _mm_set1_epi8(0x0f);
+    qsizetype i;
+
+    // 16 bytes are stored for the 12 that are decoded, so the output always has room for the rest
+    for (i = 0; length - i >= 24; i += 16) {
+        __m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(block, 4), nibbleMask);
+        __m128i loNibbles = _mm_and_si128(block, nibbleMask);
+        __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+        __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+
+        // Padding and invalid characters are left to the scalar code
+        if (_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_and_si128(lo, hi), _mm_setzero_si128())) != 0) {
+            break;
+        }
+
+        __m128i isSlash = _mm_cmpeq_epi8(block, _mm_set1_epi8('/'));
+        __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(isSlash, hiNibbles));
+
+        block = _mm_add_epi8(block, roll);
+        block = _mm_maddubs_epi16(block, _mm_set1_epi32(0x01400140));
+        block = _mm_madd_epi16(block, _mm_set1_epi32(0x00011000));
+        block =
+            _mm_shuffle_epi8(block, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), block);
+        out += 12;
+    }
+
+    return i;
+}
+
+__attribute__((target("avx2"))) static inline __m256i encodeReshuffle(__m256i in) {
+    in = _mm256_shuffle_epi8(in, _mm256_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1, 10, 11,
+                                                 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+
+    __m256i t0 = _mm256_and_si256(in, _mm256_set1_epi32(0x0fc0fc00));
+    __m256i t1 = _mm256_mulhi_epu16(t0, _mm256_set1_epi32(0x04000040));
+    __m256i t2 = _mm256_and_si256(in, _mm256_set1_epi32(0x003f03f0));
+    __m256i t3 = _mm256_mullo_epi16(t2, _mm256_set1_epi32(0x01000010));
+
+    return _mm256_or_si256(t1, t3);
+}
+
+__attribute__((target("avx2"))) static inline __m256i encodeLookup(__m256i indices) {
+    __m256i result = _mm256_subs_epu8(indices, _mm256_set1_epi8(51));
+    __m256i less = _mm256_cmpgt_epi8(_mm256_set1_epi8(26), indices);
+
+    result = _mm256_or_si256(result, _mm256_and_si256(less, _mm256_set1_epi8(13)));
+    result = _mm256_shuffle_epi8(
+        _mm256_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                         '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0, 'a' - 26, '0' - 52,
+                         '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+                         '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0),
+        result);
+
+    return _mm256_add_epi8(result, indices);
+}
+
+__attribute__((target("avx2"))) static qsizetype encodeBlocksAvx2(const quint8* in, qsizetype size,
+                                                                  char* out) {
+    qsizetype i;
+
+    // Each 128-bit lane gets 12 bytes, the second load ends 28 bytes into the input
+    for (i = 0; size - i >= 28; i += 24) {
+        __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+        __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i + 12));
+        __m256i block = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), encodeLookup(encodeReshuffle(block)));
+        out += 32;
+    }
+
+    return i + encodeBlocksSse41(in + i, size - i, out);
+}
+
+__attribute__((target("avx2"))) static qsizetype decodeBlocksAvx2(const quint8* in, qsizetype length,
+                                                                  char* out) {
+    const __m256i lutLo = _mm256_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13,
+                                           0x1a, 0x1b, 0x1b, 0x1b, 0x1a, 0x15, 0x11, 0x11, 0x11, 0x11, 0x11,
+                                           0x11, 0x11, 0x11, 0x11, 0x13, 0x1a, 0x1b, 0x1b, 0x1b, 0x1a);
+    const __m256i lutHi = _mm256_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10,
+                                           0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x01, 0x02, 0x04, 0x08,
+                                           0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+    const __m256i lutRoll = _mm256_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0, 0, 16,
+                                             19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+    const __m256i nibbleMask = _mm256_set1_epi8(0x0f);
+    qsizetype i;
+
+    // 32 bytes are stored for the 24 that are decoded
+    for (i = 0; length - i >= 44; i += 32) {
+        __m256i block = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+        __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(block, 4), nibbleMask);
+        __m256i loNibbles = _mm256_and_si256(block, nibbleMask);
+        __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+        __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+
+        if (_mm256_movemask_epi8(_mm256_cmpgt_epi8(_mm256_and_si256(lo, hi), _mm256_setzero_si256())) != 0) {
+            break;
+        }
+
+        __m256i isSlash = _mm256_cmpeq_epi8(block, _mm256_set1_epi8('/'));
+        __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(isSlash, hiNibbles));
+
+        block = _mm256_add_epi8(block, roll);
+        block = _mm256_maddubs_epi16(block, _mm256_set1_epi32(0x01400140));
+        block = _mm256_madd_epi16(block, _mm256_set1_epi32(0x00011000));
+        block = _mm256_shuffle_epi8(block, _mm256_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1,
+                                                            -1, -1, 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12,
+                                                            -1, -1, -1, -1));
+        block = _mm256_permutevar8x32_epi32(block, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7));
+
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), block);
+        out += 24;
+    }
+
+    return i + decodeBlocksSse41(in + i, length - i, out);
+}
+
+#endif  // BASE64_X86
+
+// Dispatch
+
+struct Implementation {
+    const char* name;
+    qsizetype (*encodeBlocks)(const quint8* in, qsizetype size, char* out);
+    qsizetype (*decodeBlocks)(const quint8* in, qsizetype length, char* out);
+};
+
+// Only instruction sets of this CPU are found
+static bool findImplementation(const char* name, Implementation& result) {
+#ifdef BASE64_X86
+    __builtin_cpu_init();
+
+    if (qstrcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        result = Implementation{"avx2", encodeBlocksAvx2, decodeBlocksAvx2};
+        return true;
+    }
+
+    if (qstrcmp(name, "sse4.1") == 0 && __builtin_cpu_supports("sse4.1")) {
+        result = Implementation{"sse4.1", encodeBlocksSse41, decodeBlocksSse41};
+        return true;
+    }
+#endif
+
+    if (qstrcmp(name, "scalar") == 0) {
+        result = Implementation{"scalar", encodeBlocksScalar, decodeBlocksScalar};
+        return true;
+    }
+
+    return false;
+}
+
+static Implementation detectImplementation() {
+    Implementation result;
+
+    // Fastest first, scalar is always found
+    for (const char* name : {"avx2", "sse4.1", "scalar"}) {
+        if (findImplementation(name, result)) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+// CPU is checked once, the first time anything is encoded or decoded
+static Implementation& implementationInUse() {
+    static Implementation selected = detectImplementation();
+
+    return selected;
+}
+
+const char* implementation() {
+    return implementationInUse().name;
+}
+
+bool setImplementation(const char* name) {
+    return findImplementation(name, implementationInUse());
+}
+
+void encode(const char* data, qsizetype size, char* out) {
+    auto in = reinterpret_cast<const quint8*>(data);
+    qsizetype consumed = implementationInUse().encodeBlocks(in, size, out);
+
+    encodeScalar(in + consumed, size - consumed, out + consumed / 3 * 4);
+}
+
+QByteArray encode(QByteArrayView data) {
+    QByteArray out(encodedSize(data.size()), Qt::Uninitialized);
+
+    encode(data.data(), data.size(), out.data());
+
+    return out;
+}
+
+static qsizetype decodeGroups(const quint8* in, qsizetype length, char* out, bool& isPadded) {
+    qsizetype consumed = implementationInUse().decodeBlocks(in, length, out);
+    qsizetype written = decodeScalar(in + consumed, length - consumed, out + consumed / 4 * 3, isPadded);
+
+    return written < 0 ? -1 : consumed / 4 * 3 + written;
+}
+
+Decoder::Decoder() : pendingSize(0), isPadded(false) {}
+
+void Decoder::reset() {
+    pendingSize = 0;
+    isPadded = false;
+}
+
+qsizetype Decoder::decode(const char* data, qsizetype size, char* out) {
+    auto in = reinterpret_cast<const quint8*>(data);
+    qsizetype written = 0;
+    qsizetype fullLength;
+    qsizetype n;
+
+    if (size > 0 && isPadded) {
+        return -1;
+    }
+
+    // Group cut by the end of the previous input
+    if (pendingSize > 0) {
+        while (pendingSize < 4 && size > 0) {
+            pending[pendingSize++] = static_cast<char>(*in++);
+            size--;
+        }
+
+        if (pendingSize < 4) {
+            return 0;
+        }
+
+        pendingSize = 0;
+        written = decodeScalar(reinterpret_cast<const quint8*>(pending), 4, out, isPadded);
+
+        if (written < 0 || (isPadded && size > 0)) {
+            return -1;
+        }
+    }
+
+    fullLength = size / 4 * 4;
+    n = decodeGroups(in, fullLength, out + written, isPadded);
+
+    if (n < 0 || (isPadded && size > fullLength)) {
+        return -1;
+    }
+
+    memcpy(pending, in + fullLength, size - fullLength);
+    pendingSize = size - fullLength;
+
+    return written + n;
+}
+
+qsizetype Decoder::finish(char* out) {
+    quint8 values[3] = {};
+    int size = pendingSize;
+
+    pendingSize = 0;
+    isPadded = false;
+
+    if (size == 0) {
+        return 0;
+    } else if (size == 1) {
+        return -1;
+    }
+
+    for (int i = 0; i < size; i++) {
+        values[i] = decodeTable.values[static_cast<quint8>(pending[i])];
+
+        if (values[i] >= 64) {
+            return -1;
+        }
+    }
+
+    out[0] = static_cast<char>(values[0] << 2 | values[1] >> 4);
+
+    if (size == 3) {
+        out[1] = static_cast<char>(values[1] << 4 | values[2] >> 2);
+    }
+
+    return size - 1;
+}
+
+bool decode(QByteArrayView text, QByteArray& out) {
+    Decoder decoder;
+    qsizetype written;
+    qsizetype tail;
+
+    out.resize(decodedSizeBound(text.size()));
+
+    written = decoder.decode(text.data(), text.size(), out.data());
+    tail = written < 0 ? -1 : decoder.finish(out.data() + written);
+
+    if (tail < 0) {
+        out.clear();
+        return false;
+    }
+
+    out.resize(written + tail);
+
+    return true;
+}
+
+}  // namespace base64
@@ -0,0 +1,54 @@
+#ifndef BASE64_HPP
+#define BASE64_HPP
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+// Base64 of the text protocol, vectorized with SSE4.1 or AVX2 when the CPU has them
+namespace base64 {
+
+constexpr qsizetype encodedSize(qsizetype size) {
+    return (size + 2) / 3 * 4;
+}
+
+// Padding is only known once it has been read, so the bound counts every group as 3 bytes
+constexpr qsizetype decodedSizeBound(qsizetype length) {
+    return (length + 3) / 4 * 3;
+}
+
+// Writes encodedSize(size) characters including padding
+void encode(const char* data, qsizetype size, char* out);
+QByteArray encode(QByteArrayView data);
+
+// Decodes input split at any position, a group cut by the end of one call is completed by the next
+class Decoder {
+   public:
+    Decoder();
+
+    // Writes at most decodedSizeBound(size + 3) bytes, returns how many or -1 for invalid input
+    qsizetype decode(const char* data, qsizetype size, char* out);
+
+    // Input has ended, writes the bytes of an unpadded last group; returns how many or -1
+    qsizetype finish(char* out);
+
+    void reset();
+
+   private:
+    char pending[4];
+    int pendingSize;
+    bool isPadded;  // nothing may follow a group with '='
+};
+
+// Whole input at once, false for invalid input
+bool decode(QByteArrayView text, QByteArray& out);
+
+// Instruction set picked at runtime: "avx2", "sse4.1" or "scalar"
+const char* implementation();
+
+// Replaces the instruction set for tests and benchmarks, false if this CPU doesn't have it. Not
+// thread-safe, nothing may be encoded or decoded meanwhile.
+bool setImplementation(const char* name);
+
+}  // namespace base64
+
+#endif  // BASE64_HPP
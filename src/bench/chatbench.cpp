@@ -0,0 +1,102 @@
+#include <QListView>
+#include <QScrollBar>
+#include <QtTest>
+
+#include "../client/chatdelegate.hpp"
+#include "../client/chatmodel.hpp"
+
+// Messages appended per iteration
+#define BENCH_MESSAGE_COUNT 1000000
+
+// Batches between two event loop passes of the view benchmark, roughly what arrives during one frame
+#define BATCHES_PER_FRAME 16
+
+// Chat history of the room window: 1M messages appended to the ring buffer model, alone and with a visible
+// view. Run with QT_QPA_PLATFORM=offscreen where there is no display.
+class ChatBench : public QObject {
+    Q_OBJECT
+
+   private:
+    static QList<ChatMessage> messageBatch(int size);
+
+   private slots:
+    void append_data();
+    void append();
+    void appendToView_data();
+    void appendToView();
+};
+
+QList<ChatMessage> ChatBench::messageBatch(int size) {
+    QList<ChatMessage> batch;
+
+    for (int i = 0; i < size; i++) {
+        batch.append(ChatMessage{"12:30", "user" + QString::number(i % 100),
+                                 "message number " + QString::number(i) + " of a busy room"});
+    }
+
+    return batch;
+}
+
+void ChatBench::append_data() {
+    QTest::addColumn<int>("capacity");
+    QTest::addColumn<int>("batchSize");
+
+    // Batch size is the number of lines parsed in one readyRead()
+    QTest::newRow("10k history, 1 per batch") << 10000 << 1;
+    QTest::newRow("10k history, 100 per batch") << 10000 << 100;
+    QTest::newRow("100k history, 100 per batch") << 100000 << 100;
+}
+
+void ChatBench::append() {
+    QFETCH(int, capacity);
+    QFETCH(int, batchSize);
+    QList<ChatMessage> batch = messageBatch(batchSize);
+
+    QBENCHMARK {
+        ChatModel model(capacity);
+
+        for (int i = 0; i < BENCH_MESSAGE_COUNT; i += batchSize) {
+            model.append(batch);
+        }
+
+        QCOMPARE(model.rowCount(), qMin(capacity, BENCH_MESSAGE_COUNT));
+    }
+}
+
+void ChatBench::appendToView_data() {
+    append_data();
+}
+
+void ChatBench::appendToView() {
+    QFETCH(int, capacity);
+    QFETCH(int, batchSize);
+    QList<ChatMessage> batch = messageBatch(batchSize);
+
+    QBENCHMARK {
+        ChatModel model(capacity);
+        QListView view;
+
+        view.setModel(&model);
+        view.setItemDelegate(new ChatDelegate(&view));
+        view.setUniformItemSizes(true);
+        view.resize(800, 600);
+        view.show();
+
+        // Same as RoomWindow::appendMessages() while the user follows the newest messages
+        for (int i = 0, batches = 0; i < BENCH_MESSAGE_COUNT; i += batchSize, batches++) {
+            model.append(batch);
+            view.scrollToBottom();
+
+            if (batches % BATCHES_PER_FRAME == 0) {
+                QCoreApplication::processEvents();
+            }
+        }
+
+        QCoreApplication::processEvents();
+        QCOMPARE(view.verticalScrollBar()->value(), view.verticalScrollBar()->maximum());
+    }
+}
+
+QTEST_MAIN(ChatBench)
+
+#include "chatbench.moc"
@@ -0,0 +1,760 @@
+#include <QBuffer>
+#include <QLoggingCategory>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QTcpServer>
+#include <QTemporaryDir>
+#include <QtTest>
+
+#include "../base64.hpp"
+#include "../compression.hpp"
+#include "../logger.hpp"
+#include "../protocol.hpp"
+#include "../server/worker.hpp"
+
+#define BENCH_ROOM "benchroom0"
+
+// Lines and frames read per iteration of the stream benchmarks
+#define STREAM_MESSAGE_COUNT 10000
+
+// Joins, leaves and messages timed in each row of the scaling benchmark
+#define SCALING_OPERATION_COUNT 1000
+
+// Input of every base64 row, so each reports a throughput over the same amount of data
+#define BASE64_TOTAL_SIZE ((1 << 20) * 256LL)
+
+// Stored file of the download benchmarks, larger than what the hot-file cache keeps
+#define DOWNLOAD_NAME "bench.bin"
+#define DOWNLOAD_SIZE ((1 << 20) * 64LL)
+#define DOWNLOAD_COUNT 4
+
+// Hot paths of the server in isolation. Sessions have no socket and their writes are dropped after every
+// iteration, so results only depend on the CPU and run the same on any machine. Downloads are the
+// exception, they go through a loopback connection to compare sendfile(2) with buffered writes.
+class ServerBench : public QObject {
+    Q_OBJECT
+
+   private:
+    Session* newSession(int protocolVersion);
+    Room* joinMembers(Worker& worker, int count, int textEvery);
+    void fillRooms(Worker& worker, int roomCount, int sessionCount);
+    void dropWrites(Worker& worker);
+
+    static QByteArray textChunk(qsizetype size);
+    static QByteArray randomChunk(qsizetype size);
+    QByteArray storeFile(qint64 size);
+
+    const char* base64Implementation;  // detected one, restored after every row that replaces it
+    QTemporaryDir blobDir;
+    DiskPool* disks;
+    BlobStore* blobs;
+    QList<Session*> sessions;
+
+   private slots:
+    void initTestCase();
+    void cleanup();
+    void cleanupTestCase();
+
+    // Protocol
+    void parseTextLine_data();
+    void parseTextLine();
+    void parseTextLineRegex_data();
+    void parseTextLineRegex();
+    void readLines();
+    void readFrames();
+    void processTextLine();
+
+    // Rooms
+    void uniqueUserName_data();
+    void uniqueUserName();
+    void joinRoom_data();
+    void joinRoom();
+    void userList_data();
+    void userList();
+    void fileList_data();
+    void fileList();
+    void broadcast_data();
+    void broadcast();
+    void roomScaling_data();
+    void roomScaling();
+
+    // File payloads
+    void base64Encode_data();
+    void base64Encode();
+    void base64Decode_data();
+    void base64Decode();
+    void compressChunk_data();
+    void compressChunk();
+    void isCompressible_data();
+    void isCompressible();
+
+    // Downloads
+    void sendFile_data();
+    void sendFile();
+};
+
+Session* ServerBench::newSession(int protocolVersion) {
+    Session* session = new Session;
+
+    session->socket = nullptr;
+    session->room = nullptr;
+    session->isData = false;
+    session->protocolVersion = protocolVersion;
+    session->codec = compression::Codec::None;
+    session->upload = nullptr;
+    session->sliceTransferId = 0;
+    session->slicePosition = 0;
+    session->sliceEnd = 0;
+    session->isReadPaused = false;
+    session->outgoingBytes = 0;
+    session->isRoomStateStale = false;
+    session->isClosing = false;
+    session->unreadBytes = 0;
+    session->queuedBytes = 0;
+
+    sessions.append(session);
+    return session;
+}
+
+// Every textEvery-th member speaks the text protocol, the others use frames (0: no text members)
+Room* ServerBench::joinMembers(Worker& worker, int count, int textEvery) {
+    for (int i = 0; i < count; i++) {
+        bool isText = textEvery > 0 && i % textEvery == 0;
+        Session* session = newSession(isText ? protocol::TEXT_VERSION : protocol::CURRENT_VERSION);
+        QString userName = "user" + QString::number(i);
+        QString roomId = BENCH_ROOM;
+
+        worker.processJoinRoom(session, userName, roomId);
+    }
+
+    dropWrites(worker);
+    return worker.rooms.find(BENCH_ROOM);
+}
+
+// Sessions are spread over the rooms one by one and stay in the session table, keyed by their own address
+void ServerBench::fillRooms(Worker& worker, int roomCount, int sessionCount) {
+    for (int i = 0; i < sessionCount; i++) {
+        Session* session = newSession(protocol::CURRENT_VERSION);
+        QString userName = "user" + QString::number(i);
+        QString roomId = "room" + QString::number(i % roomCount);
+
+        worker.sessions.insert(reinterpret_cast<QTcpSocket*>(session), session);
+        worker.processJoinRoom(session, userName, roomId);
+
+        if (i % roomCount == roomCount - 1) {
+            dropWrites(worker);
+        }
+    }
+
+    dropWrites(worker);
+}
+
+void ServerBench::dropWrites(Worker& worker) {
+    // Flush posted by the first write finds nothing to write
+    for (auto session : std::as_const(worker.pendingWrites)) {
+        session->outgoing.clear();
+        session->outgoingBytes = 0;
+    }
+
+    worker.pendingWrites.clear();
+}
+
+QByteArray ServerBench::textChunk(qsizetype size) {
+    static const char* words[] = {"room ", "file ", "chunk ", "server ", "client ", "message\n"};
+    QByteArray chunk;
+
+    while (chunk.size() < size) {
+        chunk += words[QRandomGenerator::global()->bounded(int(std::size(words)))];
+    }
+
+    chunk.truncate(size);
+    return chunk;
+}
+
+QByteArray ServerBench::randomChunk(qsizetype size) {
+    QByteArray chunk(size, Qt::Uninitialized);
+
+    QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(chunk.data()), size / sizeof(quint32));
+    return chunk;
+}
+
+QByteArray ServerBench::storeFile(qint64 size) {
+    QByteArray data = randomChunk(size);
+    QByteArray hash = QCryptographicHash::hash(data, QCryptographicHash::Sha256);
+    QString path = blobs->temporaryPath();
+    QFile file(path);
+
+    if (!file.open(QIODevice::WriteOnly) || file.write(data) != size) {
+        return {};
+    }
+
+    file.close();
+    return blobs->commit(path, hash) ? hash : QByteArray();
+}
+
+void ServerBench::initTestCase() {
+    // Logging would dominate every result
+    setLogLevel(LogLevel::Off);
+    QLoggingCategory::setFilterRules("*.debug=false");
+
+    base64Implementation = base64::implementation();
+
+    QVERIFY(blobDir.isValid());
+    disks = new DiskPool(1);
+    blobs = new BlobStore(blobDir.path() + '/', disks);
+}
+
+void ServerBench::cleanup() {
+    qDeleteAll(sessions);
+    sessions.clear();
+
+    base64::setImplementation(base64Implementation);
+}
+
+void ServerBench::cleanupTestCase() {
+    disks->waitForDone();
+    delete blobs;
+    delete disks;
+}
+
+void ServerBench::parseTextLine_data() {
+    QTest::addColumn<QByteArray>("line");
+
+    QTest::newRow("msg") << QByteArray("/msg " BENCH_ROOM ":hello everyone, the file is up");
+    QTest::newRow("join") << QByteArray("/join " BENCH_ROOM ":someone");
+    QTest::newRow("protocol") << QByteArray("/protocol 5:zstd,zlib");
+    QTest::newRow("getfile") << QByteArray("/getfile 'holiday photos.tar' " BENCH_ROOM ":.");
+    QTest::newRow("chat line") << QByteArray("12:30 someone:not a command");
+
+    // Text protocol uploads, the tokenizer stops at the room while the patterns run over all of the data
+    QTest::newRow("sendfile chunk") << "/sendfile 'holiday photos.tar' " BENCH_ROOM ":" +
+                                           base64::encode(randomChunk(protocol::FILE_CHUNK_SIZE));
+    QTest::newRow("sendfile 1 MiB")
+        << "/sendfile 'holiday photos.tar' " BENCH_ROOM ":" + base64::encode(randomChunk(1 << 20));
+}
+
+void ServerBench::parseTextLine() {
+    QFETCH(QByteArray, line);
+    protocol::TextCommand command;
+
+    QBENCHMARK {
+        protocol::parseTextLine(line, command);
+    }
+}
+
+void ServerBench::parseTextLineRegex_data() {
+    parseTextLine_data();
+}
+
+// Patterns that parseTextLine() has replaced, for comparison
+void ServerBench::parseTextLineRegex() {
+    QFETCH(QByteArray, line);
+    static const QRegularExpression messageRegex("^/([a-z]+) ([a-zA-Z0-9]+):(.*)$");  // /command room:data
+    static const QRegularExpression fileRegex("^/([a-z]+) '(.*)' ([a-zA-Z0-9]+):(.*)$");  // filename too
+    QRegularExpressionMatch match;
+    protocol::TextCommand command;
+    bool isFile = false;
+
+    QBENCHMARK {
+        QString text = QString::fromUtf8(line);
+
+        match = messageRegex.match(text);
+        isFile = !match.hasMatch();
+
+        if (isFile) {
+            match = fileRegex.match(text);
+        }
+    }
+
+    // Both parsers agree on the lines they accept
+    QCOMPARE(protocol::parseTextLine(line, command), match.hasMatch());
+
+    if (match.hasMatch()) {
+        QCOMPARE(QString::fromUtf8(command.room), match.captured(isFile ? 3 : 2));
+        QCOMPARE(QString::fromUtf8(command.data), match.captured(isFile ? 4 : 3));
+    }
+}
+
+void ServerBench::readLines() {
+    QByteArray stream;
+    QByteArray lineBuffer;
+    protocol::TextCommand command;
+    QBuffer buffer(&stream);
+
+    for (int i = 0; i < STREAM_MESSAGE_COUNT; i++) {
+        stream += "/msg " BENCH_ROOM ":message number " + QByteArray::number(i) + '\n';
+    }
+
+    buffer.open(QIODevice::ReadOnly);
+
+    // Like Worker::processIncoming() on a socket with many lines buffered
+    QBENCHMARK {
+        buffer.seek(0);
+
+        while (buffer.canReadLine()) {
+            protocol::parseTextLine(protocol::readLine(&buffer, lineBuffer), command);
+        }
+    }
+}
+
+void ServerBench::readFrames() {
+    QByteArray stream;
+    protocol::Frame frame;
+    QBuffer buffer(&stream);
+
+    for (int i = 0; i < STREAM_MESSAGE_COUNT; i++) {
+        stream += protocol::encodeFrame(protocol::FrameType::Message, BENCH_ROOM,
+                                        "message number " + QByteArray::number(i));
+    }
+
+    buffer.open(QIODevice::ReadOnly);
+
+    QBENCHMARK {
+        buffer.seek(0);
+
+        while (protocol::readFrame(&buffer, frame) == protocol::ReadResult::Ok) {
+        }
+    }
+}
+
+void ServerBench::processTextLine() {
+    Worker worker(0, blobs, disks);
+    QByteArray line = "/msg " BENCH_ROOM ":hello everyone, the file is up";
+
+    worker.setWorkers({&worker});
+    joinMembers(worker, 10, 0);
+
+    // Parsing, dispatch and the fan-out to 10 members
+    QBENCHMARK {
+        worker.processTextLine(sessions.first(), line);
+        dropWrites(worker);
+    }
+}
+
+void ServerBench::uniqueUserName_data() {
+    QTest::addColumn<int>("takenCount");
+
+    QTest::newRow("free") << 0;
+    QTest::newRow("1 taken") << 1;
+    QTest::newRow("10 taken") << 10;
+    QTest::newRow("100 taken") << 100;
+}
+
+void ServerBench::uniqueUserName() {
+    QFETCH(int, takenCount);
+    Room room;
+    QString name = "someone";
+    QString result;
+
+    // "someone", "someone-1", "someone-1-1", ...
+    for (int i = 0; i < takenCount; i++) {
+        room.members.insert(name, nullptr);
+        name += "-1";
+    }
+
+    QBENCHMARK {
+        result = ::uniqueUserName(&room, "someone");
+    }
+
+    QCOMPARE(result, name);
+}
+
+void ServerBench::joinRoom_data() {
+    QTest::addColumn<int>("memberCount");
+    QTest::addColumn<bool>("isSameName");
+    QTest::addColumn<int>("protocolVersion");
+
+    QTest::newRow("10 members") << 10 << false << protocol::CURRENT_VERSION;
+    QTest::newRow("100 members") << 100 << false << protocol::CURRENT_VERSION;
+    QTest::newRow("1000 members") << 1000 << false << protocol::CURRENT_VERSION;
+    QTest::newRow("10 members, same name") << 10 << true << protocol::CURRENT_VERSION;
+    QTest::newRow("100 members, same name") << 100 << true << protocol::CURRENT_VERSION;
+
+    // Members before room events get the whole user list on every join
+    QTest::newRow("100 members, full lists") << 100 << false << protocol::FRAMED_VERSION;
+    QTest::newRow("1000 members, full lists") << 1000 << false << protocol::FRAMED_VERSION;
+}
+
+void ServerBench::joinRoom() {
+    QFETCH(int, memberCount);
+    QFETCH(bool, isSameName);
+    QFETCH(int, protocolVersion);
+
+    // Every join sends a notice and a UserJoined event or the user list to all members that are already there
+    QBENCHMARK {
+        Worker worker(0, blobs, disks);
+
+        worker.setWorkers({&worker});
+
+        for (int i = 0; i < memberCount; i++) {
+            Session* session = newSession(protocolVersion);
+            QString userName = isSameName ? "someone" : "user" + QString::number(i);
+            QString roomId = BENCH_ROOM;
+
+            worker.processJoinRoom(session, userName, roomId);
+        }
+
+        dropWrites(worker);
+        cleanup();
+    }
+}
+
+void ServerBench::userList_data() {
+    QTest::addColumn<int>("memberCount");
+
+    QTest::newRow("10 members") << 10;
+    QTest::newRow("100 members") << 100;
+    QTest::newRow("1000 members") << 1000;
+}
+
+void ServerBench::userList() {
+    QFETCH(int, memberCount);
+    Room room;
+    QString list;
+
+    for (int i = 0; i < memberCount; i++) {
+        room.members.insert("user" + QString::number(i), nullptr);
+    }
+
+    QBENCHMARK {
+        list = ::userList(&room);
+    }
+
+    QCOMPARE(list.count(','), memberCount - 1);
+}
+
+void ServerBench::fileList_data() {
+    QTest::addColumn<int>("fileCount");
+
+    QTest::newRow("10 files") << 10;
+    QTest::newRow("100 files") << 100;
+    QTest::newRow("1000 files") << 1000;
+}
+
+void ServerBench::fileList() {
+    QFETCH(int, fileCount);
+    Room room;
+    QString list;
+
+    for (int i = 0; i < fileCount; i++) {
+        room.files.insert("file " + QString::number(i) + ".tar.gz", QByteArray(32, char(i)));
+    }
+
+    QBENCHMARK {
+        list = ::fileList(&room);
+    }
+
+    QCOMPARE(list.count('/'), fileCount - 1);
+}
+
+void ServerBench::broadcast_data() {
+    QTest::addColumn<int>("memberCount");
+    QTest::addColumn<int>("textEvery");
+
+    QTest::newRow("10 members") << 10 << 0;
+    QTest::newRow("100 members") << 100 << 0;
+    QTest::newRow("1000 members") << 1000 << 0;
+    QTest::newRow("1000 members, 1/4 text protocol") << 1000 << 4;
+}
+
+void ServerBench::broadcast() {
+    QFETCH(int, memberCount);
+    QFETCH(int, textEvery);
+    Worker worker(0, blobs, disks);
+    Room* room;
+
+    worker.setWorkers({&worker});
+    room = joinMembers(worker, memberCount, textEvery);
+
+    QVERIFY(room);
+
+    // Message is encoded once per protocol version and queued for every member
+    QBENCHMARK {
+        worker.broadcast(room, protocol::FrameType::Message, "12:30 someone:hello everyone, the file is up");
+        dropWrites(worker);
+    }
+}
+
+void ServerBench::roomScaling_data() {
+    QTest::addColumn<int>("roomCount");
+    QTest::addColumn<int>("sessionCount");
+    QTest::addColumn<QString>("operation");
+
+    for (int roomCount : {1000, 10000}) {
+        for (int sessionCount : {10000, 100000}) {
+            for (const char* operation : {"join", "leave", "message"}) {
+                QTest::addRow("%dk rooms, %dk sessions, %s", roomCount / 1000, sessionCount / 1000, operation)
+                    << roomCount << sessionCount << QString(operation);
+            }
+        }
+    }
+}
+
+void ServerBench::roomScaling() {
+    QFETCH(int, roomCount);
+    QFETCH(int, sessionCount);
+    QFETCH(QString, operation);
+    Worker worker(0, blobs, disks);
+    QElapsedTimer timer;
+    qint64 elapsed = 0;
+
+    worker.setWorkers({&worker});
+    fillRooms(worker, roomCount, sessionCount);
+
+    QCOMPARE(worker.rooms.size(), roomCount);
+    QCOMPARE(worker.sessions.size(), sessionCount);
+
+    // Only the operation itself is timed, the rooms and the session table are back to their size after it
+    for (int i = 0; i < SCALING_OPERATION_COUNT; i++) {
+        QString userName = "someone";
+        QString roomId = "room" + QString::number(i % roomCount);
+
+        if (operation == "message") {
+            // Sessions of the first pass of fillRooms() are in rooms 0, 1, 2, ...
+            protocol::Frame frame{protocol::FrameType::Message, roomId.toUtf8(), "hello everyone"};
+
+            timer.start();
+            worker.processFrame(sessions[i % roomCount], frame);
+            elapsed += timer.nsecsElapsed();
+
+            dropWrites(worker);
+            continue;
+        }
+
+        // Leaving client is removed like a disconnected one, so it needs a socket to delete
+        Session* session = newSession(protocol::CURRENT_VERSION);
+        session->socket = new QTcpSocket;
+        worker.sessions.insert(session->socket, session);
+
+        timer.start();
+        worker.processJoinRoom(session, userName, roomId);
+        elapsed += operation == "join" ? timer.nsecsElapsed() : 0;
+        dropWrites(worker);
+
+        sessions.removeLast();
+
+        timer.start();
+        worker.removeClient(session);
+        elapsed += operation == "leave" ? timer.nsecsElapsed() : 0;
+        dropWrites(worker);
+    }
+
+    QCoreApplication::sendPostedEvents(nullptr, QEvent::DeferredDelete);
+    QTest::setBenchmarkResult(qreal(elapsed) / SCALING_OPERATION_COUNT, QTest::WalltimeNanoseconds);
+
+    QCOMPARE(worker.rooms.size(), roomCount);
+    QCOMPARE(worker.sessions.size(), sessionCount);
+
+    // Sessions of fillRooms() belong to the benchmark, the worker would delete them on its way out
+    worker.sessions.clear();
+}
+
+void ServerBench::base64Encode_data() {
+    QTest::addColumn<qsizetype>("size");
+    QTest::addColumn<QByteArray>("implementation");
+
+    // Qt's codec is the baseline, instruction sets this CPU doesn't have are skipped
+    for (const char* implementation : {"qt", "scalar", "sse4.1", "avx2"}) {
+        QTest::addRow("chunk, %s", implementation)
+            << qsizetype(protocol::FILE_CHUNK_SIZE) << QByteArray(implementation);
+        QTest::addRow("1 MiB, %s", implementation) << qsizetype(1 << 20) << QByteArray(implementation);
+    }
+}
+
+void ServerBench::base64Encode() {
+    QFETCH(qsizetype, size);
+    QFETCH(QByteArray, implementation);
+    QByteArray data = randomChunk(size);
+    QByteArray encoded;
+    QElapsedTimer timer;
+    bool isQt = implementation == "qt";
+
+    if (!isQt && !base64::setImplementation(implementation.constData())) {
+        QSKIP("This CPU doesn't have the instruction set");
+    }
+
+    // Reported in bytes of input per second
+    timer.start();
+
+    for (qint64 total = 0; total < BASE64_TOTAL_SIZE; total += size) {
+        encoded = isQt ? data.toBase64() : base64::encode(data);
+    }
+
+    QTest::setBenchmarkResult(BASE64_TOTAL_SIZE * 1e9 / qMax<qint64>(timer.nsecsElapsed(), 1),
+                              QTest::BytesPerSecond);
+
+    QCOMPARE(encoded, data.toBase64());
+}
+
+void ServerBench::base64Decode_data() {
+    base64Encode_data();
+}
+
+void ServerBench::base64Decode() {
+    QFETCH(qsizetype, size);
+    QFETCH(QByteArray, implementation);
+    QByteArray data = randomChunk(size);
+    QByteArray encoded = data.toBase64();
+    QByteArray decoded;
+    QElapsedTimer timer;
+    bool isQt = implementation == "qt";
+    bool isValid = false;
+
+    if (!isQt && !base64::setImplementation(implementation.constData())) {
+        QSKIP("This CPU doesn't have the instruction set");
+    }
+
+    // Reported in bytes of decoded output per second, both codecs reject invalid input
+    timer.start();
+
+    for (qint64 total = 0; total < BASE64_TOTAL_SIZE; total += size) {
+        if (isQt) {
+            auto result = QByteArray::fromBase64Encoding(encoded, QByteArray::AbortOnBase64DecodingErrors);
+
+            isValid = bool(result);
+            decoded = result.decoded;
+        } else {
+            isValid = base64::decode(encoded, decoded);
+        }
+    }
+
+    QTest::setBenchmarkResult(BASE64_TOTAL_SIZE * 1e9 / qMax<qint64>(timer.nsecsElapsed(), 1),
+                              QTest::BytesPerSecond);
+
+    QVERIFY(isValid);
+    QCOMPARE(decoded, data);
+}
+
+void ServerBench::compressChunk_data() {
+    QTest::addColumn<int>("codec");
+    QTest::addColumn<bool>("isText");
+
+    QTest::newRow("zlib, text") << int(compression::Codec::Zlib) << true;
+    QTest::newRow("zlib, random") << int(compression::Codec::Zlib) << false;
+
+#ifdef WSTED_HAVE_ZSTD
+    QTest::newRow("zstd, text") << int(compression::Codec::Zstd) << true;
+    QTest::newRow("zstd, random") << int(compression::Codec::Zstd) << false;
+#endif
+}
+
+void ServerBench::compressChunk() {
+    QFETCH(int, codec);
+    QFETCH(bool, isText);
+    QByteArray chunk = isText ? textChunk(protocol::FILE_CHUNK_SIZE) : randomChunk(protocol::FILE_CHUNK_SIZE);
+    QByteArray payload;
+    QByteArray unpacked;
+
+    QBENCHMARK {
+        compression::compressChunk(compression::Codec(codec), chunk, payload);
+    }
+
+    QVERIFY(compression::decompressChunk(payload, unpacked));
+    QCOMPARE(unpacked, chunk);
+}
+
+void ServerBench::isCompressible_data() {
+    QTest::addColumn<bool>("isText");
+
+    QTest::newRow("text") << true;
+    QTest::newRow("random") << false;
+}
+
+void ServerBench::isCompressible() {
+    QFETCH(bool, isText);
+    QByteArray sample = isText ? textChunk(compression::SAMPLE_SIZE) : randomChunk(compression::SAMPLE_SIZE);
+    bool result = !isText;
+
+    // Sampled once for every download and upload of a client with a codec
+    QBENCHMARK {
+        result = compression::isCompressible(sample);
+    }
+
+    QCOMPARE(result, isText);
+}
+
+void ServerBench::sendFile_data() {
+    QTest::addColumn<bool>("isZeroCopy");
+
+    QTest::newRow("sendfile") << true;
+    QTest::newRow("buffered") << false;
+}
+
+void ServerBench::sendFile() {
+    QFETCH(bool, isZeroCopy);
+    QTcpServer server;
+    QTcpSocket reader;
+    QEventLoop loop;
+    Worker worker(0, blobs, disks);
+    QTcpSocket* client;
+    Session* session;
+    QByteArray hash;
+    QString userName = "someone";
+    QString roomId = BENCH_ROOM;
+    QElapsedTimer timer;
+    qint64 received = 0;
+    int finished = 0;
+
+#ifndef Q_OS_LINUX
+    if (isZeroCopy) {
+        QSKIP("sendfile(2) is only used on Linux");
+    }
+#endif
+
+    hash = storeFile(DOWNLOAD_SIZE);
+    QVERIFY(!hash.isEmpty());
+
+    QVERIFY(server.listen(QHostAddress::LocalHost));
+    reader.connectToHost(server.serverAddress(), server.serverPort());
+    QVERIFY(server.waitForNewConnection(5000));
+    QVERIFY(reader.waitForConnected(5000));
+
+    client = server.nextPendingConnection();
+    session = newSession(protocol::FRAMED_VERSION);
+    session->socket = client;
+
+    worker.setWorkers({&worker});
+    worker.connectClient(client);
+    worker.sessions.insert(client, session);
+    worker.processJoinRoom(session, userName, roomId);
+
+    QVERIFY(session->room);
+    session->room->files.insert(DOWNLOAD_NAME, hash);
+
+    // Reading end only parses frames and counts the file data, it costs the same for both paths
+    connect(&reader, &QTcpSocket::readyRead, &loop, [&] {
+        protocol::Frame frame;
+
+        while (protocol::readFrame(&reader, frame) == protocol::ReadResult::Ok) {
+            if (frame.type == protocol::FrameType::FileChunk) {
+                received += frame.payload.size();
+            } else if (frame.type == protocol::FrameType::FileEnd && ++finished == DOWNLOAD_COUNT) {
+                loop.quit();
+            }
+        }
+    });
+
+    timer.start();
+
+    for (int i = 0; i < DOWNLOAD_COUNT; i++) {
+        worker.sendFile(session, DOWNLOAD_NAME);
+
+        // Path under test, openDownload() leaves it alone for clients without a codec
+        session->downloads.last()->isZeroCopy = isZeroCopy;
+    }
+
+    QTimer::singleShot(60000, &loop, &QEventLoop::quit);
+    loop.exec();
+
+    QTest::setBenchmarkResult(received * 1e9 / qMax<qint64>(timer.nsecsElapsed(), 1), QTest::BytesPerSecond);
+
+    worker.sessions.remove(client);
+    client->disconnect(&worker);
+    blobs->release(hash);
+
+    QCOMPARE(received, DOWNLOAD_SIZE * DOWNLOAD_COUNT);
+}
+
+QTEST_GUILESS_MAIN(ServerBench)
+
+#include "serverbench.moc"
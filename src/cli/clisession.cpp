@@ -0,0 +1,141 @@
+#include "clisession.hpp"
+
+#include <QCoreApplication>
+#include <iostream>
+
+CliSession::CliSession(RoomClient* client, Command command, const QStringList& arguments, QObject* parent)
+    : QObject(parent),
+      m_client(client),
+      m_command(command),
+      m_arguments(arguments),
+      m_isStarted(false),
+      m_isFinishing(false),
+      m_hasFailed(false) {
+    connect(m_client, SIGNAL(connectionFailed(QString)), this, SLOT(connectionFailed(QString)));
+    connect(m_client, SIGNAL(filesChanged(QStringList)), this, SLOT(filesChanged(QStringList)));
+    connect(m_client, SIGNAL(messagesReceived(QList<ChatMessage>)), this,
+            SLOT(messagesReceived(QList<ChatMessage>)));
+    connect(m_client, SIGNAL(uploadRejected(QString)), this, SLOT(uploadRejected(QString)));
+    connect(m_client, SIGNAL(uploadFinished(QString, bool)), this, SLOT(uploadFinished(QString, bool)));
+    connect(m_client, SIGNAL(downloadFinished(QString, QString, bool)), this,
+            SLOT(downloadFinished(QString, QString, bool)));
+    connect(m_client, SIGNAL(disconnected()), this, SLOT(disconnected()));
+}
+
+void CliSession::connectionFailed(const QString& error) {
+    std::cerr << "Failed to connect to " << m_client->getServerAddress().toStdString() << ": "
+              << error.toStdString() << std::endl;
+
+    QCoreApplication::exit(EXIT_FAILURE);
+}
+
+void CliSession::filesChanged(const QStringList& files) {
+    Q_UNUSED(files);
+
+    // Server sends the file list right after joining, so the room is known from here on
+    if (!m_isStarted) {
+        m_isStarted = true;
+        runCommand();
+    }
+}
+
+void CliSession::runCommand() {
+    std::cerr << "Joined room " << m_client->getRoomId().toStdString() << " as "
+              << m_client->getUserName().toStdString() << std::endl;
+
+    switch (m_command) {
+        case Command::Tail:
+            // Messages are printed until the connection is closed
+            break;
+        case Command::Say:
+            m_client->sendMessage(m_arguments.join(' '));
+            finish();
+            break;
+        case Command::Upload:
+        case Command::Download:
+            transferNext();
+            break;
+    }
+}
+
+void CliSession::transferNext() {
+    // RoomClient moves one file at a time in each direction
+    while (!m_arguments.isEmpty()) {
+        QString fileName = m_arguments.takeFirst();
+
+        if (m_command == Command::Upload) {
+            // uploadFinished() or uploadRejected() continues with the next file
+            m_client->uploadFile(fileName);
+            return;
+        }
+
+        if (m_client->getFileList().contains(fileName)) {
+            m_client->downloadFile(fileName);
+            return;
+        }
+
+        std::cerr << "No file '" << fileName.toStdString() << "' in room "
+                  << m_client->getRoomId().toStdString() << std::endl;
+        m_hasFailed = true;
+    }
+
+    finish();
+}
+
+void CliSession::messagesReceived(const QList<ChatMessage>& messages) {
+    if (m_command != Command::Tail) {
+        return;
+    }
+
+    for (const auto& message : messages) {
+        std::cout << message.time.toStdString() << ' ' << message.userName.toStdString() << ':'
+                  << message.text.toStdString() << '\n';
+    }
+
+    std::cout.flush();
+}
+
+void CliSession::uploadRejected(const QString& error) {
+    std::cerr << error.toStdString() << std::endl;
+    m_hasFailed = true;
+
+    transferNext();
+}
+
+void CliSession::uploadFinished(const QString& fileName, bool success) {
+    if (success) {
+        std::cout << "Uploaded '" << fileName.toStdString() << "'" << std::endl;
+    } else {
+        std::cerr << "Upload of '" << fileName.toStdString() << "' failed" << std::endl;
+        m_hasFailed = true;
+    }
+
+    transferNext();
+}
+
+void CliSession::downloadFinished(const QString& fileName, const QString& path, bool success) {
+    if (success) {
+        std::cout << "Downloaded '" << fileName.toStdString() << "' to " << path.toStdString() << std::endl;
+    } else {
+        std::cerr << "Download of '" << fileName.toStdString() << "' failed" << std::endl;
+        m_hasFailed = true;
+    }
+
+    transferNext();
+}
+
+void CliSession::finish() {
+    m_isFinishing = true;
+
+    // Data still buffered in the socket is written before the connection is closed
+    m_client->disconnectFromServer();
+}
+
+void CliSession::disconnected() {
+    if (!m_isFinishing) {
+        std::cerr << "Connection to " << m_client->getServerAddress().toStdString() << " lost" << std::endl;
+        m_hasFailed = true;
+    }
+
+    QCoreApplication::exit(m_hasFailed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,41 @@
+#ifndef CLISESSION_HPP
+#define CLISESSION_HPP
+
+#include <QObject>
+#include <QStringList>
+
+#include "../client/roomclient.hpp"
+
+// CliSession runs one command of wsted-cli in a room once the client has joined it and received the file
+// list, then disconnects. Results go to stdout, errors to stderr.
+class CliSession : public QObject {
+    Q_OBJECT
+   public:
+    enum class Command { Tail, Say, Upload, Download };
+
+    CliSession(RoomClient* client, Command command, const QStringList& arguments,
+               QObject* parent = nullptr);
+
+   private:
+    void runCommand();
+    void transferNext();
+    void finish();
+
+    RoomClient* m_client;
+    Command m_command;
+    QStringList m_arguments;  // files still to be transferred, or the words of the message
+    bool m_isStarted;
+    bool m_isFinishing;
+    bool m_hasFailed;
+
+   private slots:
+    void connectionFailed(const QString& error);
+    void filesChanged(const QStringList& files);
+    void messagesReceived(const QList<ChatMessage>& messages);
+    void uploadRejected(const QString& error);
+    void uploadFinished(const QString& fileName, bool success);
+    void downloadFinished(const QString& fileName, const QString& path, bool success);
+    void disconnected();
+};
+
+#endif  // CLISESSION_HPP
@@ -0,0 +1,95 @@
+#include <QDir>
+#include <QtCore/QCoreApplication>
+#include <iomanip>
+#include <iostream>
+
+#include "clisession.hpp"
+
+void usage(std::string exe) {
+    std::cout << std::left;
+
+    std::cout << "Usage: " << std::endl;
+    std::cout << exe << " [--stripes N] [--output DIR] ADDRESS[:PORT] ROOM USER COMMAND" << std::endl
+              << std::endl;
+    std::cout << "Commands:" << std::endl;
+    std::cout << std::setw(32) << "  tail" << "print messages of the room until the connection is closed"
+              << std::endl;
+    std::cout << std::setw(32) << "  say TEXT..." << "send a message to the room" << std::endl;
+    std::cout << std::setw(32) << "  upload FILE..." << "upload files to the room" << std::endl;
+    std::cout << std::setw(32) << "  download FILE..." << "download files of the room to the output directory"
+              << std::endl
+              << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << std::setw(32) << "  --stripes N" << "connections used for large files (1-"
+              << MAX_STRIPE_COUNT << ", default 1)" << std::endl;
+    std::cout << std::setw(32) << "  --output DIR" << "directory for downloads (default current directory)"
+              << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    QStringList arguments;
+    QString outputDir;
+    int stripeCount;
+    CliSession::Command command;
+
+    outputDir = ".";
+    stripeCount = 1;
+
+    for (int i = 1; i < argc; i++) {
+        arguments.append(QString::fromLocal8Bit(argv[i]));
+    }
+
+    while (arguments.size() >= 2 && arguments.first().startsWith("--")) {
+        QString option = arguments.takeFirst();
+        QString value = arguments.takeFirst();
+
+        if (option == "--stripes") {
+            stripeCount = value.toInt();
+        } else if (option == "--output") {
+            outputDir = value;
+        } else {
+            std::cout << "Unknown option " << option.toStdString() << std::endl << std::endl;
+
+            usage(argv[0]);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    if (arguments.size() < 4) {
+        std::cout << "Missing arguments" << std::endl << std::endl;
+
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (arguments[3] == "tail" && arguments.size() == 4) {
+        command = CliSession::Command::Tail;
+    } else if (arguments[3] == "say" && arguments.size() > 4) {
+        command = CliSession::Command::Say;
+    } else if (arguments[3] == "upload" && arguments.size() > 4) {
+        command = CliSession::Command::Upload;
+    } else if (arguments[3] == "download" && arguments.size() > 4) {
+        command = CliSession::Command::Download;
+    } else {
+        std::cout << "Invalid command" << std::endl << std::endl;
+
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    QCoreApplication a(argc, argv);
+
+    RoomClient client;
+    client.setServerAddress(arguments[0]);
+    client.setRoomId(arguments[1]);
+    client.setUserName(arguments[2]);
+    client.setStripeCount(stripeCount);
+    client.setDownloadDirectory(QDir(outputDir).absolutePath());
+
+    CliSession session(&client, command, arguments.mid(4));
+
+    // Connecting starts with the event loop, so a failure can end it
+    QMetaObject::invokeMethod(&client, "connectToServer", Qt::QueuedConnection);
+
+    return a.exec();
+}
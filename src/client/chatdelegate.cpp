@@ -0,0 +1,64 @@
+#include "chatdelegate.hpp"
+
+#include <QPainter>
+
+#include "chatmodel.hpp"
+
+#define ROW_PADDING 2
+#define TEXT_MARGIN 4
+
+ChatDelegate::ChatDelegate(QObject* parent) : QStyledItemDelegate(parent) {}
+
+void ChatDelegate::paint(QPainter* painter, const QStyleOptionViewItem& option,
+                         const QModelIndex& index) const {
+    QString time = index.data(ChatModel::TimeRole).toString();
+    QString userName = index.data(ChatModel::UserNameRole).toString();
+    QString text = index.data(ChatModel::TextRole).toString();
+    QRect rect = option.rect.adjusted(TEXT_MARGIN, 0, -TEXT_MARGIN, 0);
+    QFont font = option.font;
+
+    painter->save();
+
+    if (option.state & QStyle::State_Selected) {
+        painter->fillRect(option.rect, option.palette.highlight());
+        painter->setPen(option.palette.color(QPalette::HighlightedText));
+    } else {
+        painter->setPen(option.palette.color(QPalette::Text));
+    }
+
+    // Notices of the client have no sender and are shown in italics
+    if (userName.isEmpty()) {
+        font.setItalic(true);
+        painter->setFont(font);
+        painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter,
+                          QFontMetrics(font).elidedText(text, Qt::ElideRight, rect.width()));
+        painter->restore();
+        return;
+    }
+
+    time += ' ';
+    font.setItalic(true);
+    painter->setFont(font);
+    painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter, time);
+    rect.setLeft(rect.left() + QFontMetrics(font).horizontalAdvance(time));
+
+    userName += ": ";
+    font.setItalic(false);
+    font.setBold(true);
+    painter->setFont(font);
+    painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter, userName);
+    rect.setLeft(rect.left() + QFontMetrics(font).horizontalAdvance(userName));
+
+    font.setBold(false);
+    painter->setFont(font);
+    painter->drawText(rect, Qt::AlignLeft | Qt::AlignVCenter,
+                      QFontMetrics(font).elidedText(text, Qt::ElideRight, rect.width()));
+
+    painter->restore();
+}
+
+QSize ChatDelegate::sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const {
+    Q_UNUSED(index);
+
+    return QSize(option.rect.width(), option.fontMetrics.height() + 2 * ROW_PADDING);
+}
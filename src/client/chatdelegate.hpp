@@ -0,0 +1,18 @@
+#ifndef CHATDELEGATE_HPP
+#define CHATDELEGATE_HPP
+
+#include <QStyledItemDelegate>
+
+// ChatDelegate draws a message of ChatModel as one line: time in italics, user name in bold, then the text.
+// Every row has the same height, so the view with uniform item sizes lays out only the rows it shows.
+class ChatDelegate : public QStyledItemDelegate {
+    Q_OBJECT
+   public:
+    explicit ChatDelegate(QObject* parent = nullptr);
+
+    void paint(QPainter* painter, const QStyleOptionViewItem& option,
+               const QModelIndex& index) const override;
+    QSize sizeHint(const QStyleOptionViewItem& option, const QModelIndex& index) const override;
+};
+
+#endif  // CHATDELEGATE_HPP
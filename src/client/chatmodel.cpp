@@ -0,0 +1,88 @@
+#include "chatmodel.hpp"
+
+ChatModel::ChatModel(int capacity, QObject* parent)
+    : QAbstractListModel(parent), m_capacity(qMax(1, capacity)), m_first(0), m_count(0) {}
+
+int ChatModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : m_count;
+}
+
+const ChatMessage& ChatModel::at(int row) const {
+    return m_messages[(m_first + row) % m_capacity];
+}
+
+QVariant ChatModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= m_count) {
+        return QVariant();
+    }
+
+    const ChatMessage& message = at(index.row());
+
+    switch (role) {
+        case Qt::DisplayRole:
+            if (message.userName.isEmpty()) {
+                return message.text;
+            }
+
+            return message.time + ' ' + message.userName + ": " + message.text;
+        case Qt::ToolTipRole:
+            // Rows show one line, long messages are elided
+            return message.text;
+        case TimeRole:
+            return message.time;
+        case UserNameRole:
+            return message.userName;
+        case TextRole:
+            return message.text;
+        default:
+            return QVariant();
+    }
+}
+
+void ChatModel::append(const QList<ChatMessage>& messages) {
+    int incoming;
+    int overflow;
+
+    // Only the newest messages fit when more arrive at once than the buffer holds
+    incoming = int(qMin<qsizetype>(messages.size(), m_capacity));
+    overflow = m_count + incoming - m_capacity;
+
+    if (incoming == 0) {
+        return;
+    }
+
+    if (overflow > 0) {
+        beginRemoveRows(QModelIndex(), 0, overflow - 1);
+        m_first = (m_first + overflow) % m_capacity;
+        m_count -= overflow;
+        endRemoveRows();
+    }
+
+    beginInsertRows(QModelIndex(), m_count, m_count + incoming - 1);
+
+    for (qsizetype i = messages.size() - incoming; i < messages.size(); i++) {
+        int slot = (m_first + m_count) % m_capacity;
+
+        if (slot < m_messages.size()) {
+            m_messages[slot] = messages[i];
+        } else {
+            m_messages.append(messages[i]);
+        }
+
+        m_count++;
+    }
+
+    endInsertRows();
+}
+
+void ChatModel::clear() {
+    // Slots are kept for the next room
+    beginResetModel();
+    m_first = 0;
+    m_count = 0;
+    endResetModel();
+}
+
+int ChatModel::capacity() const {
+    return m_capacity;
+}
@@ -0,0 +1,38 @@
+#ifndef CHATMODEL_HPP
+#define CHATMODEL_HPP
+
+#include <QAbstractListModel>
+#include <QList>
+
+#include "roomclient.hpp"
+
+// Chat history kept by RoomWindow when WSTED_CHAT_HISTORY is not set
+#define DEFAULT_CHAT_HISTORY 10000
+
+// ChatModel keeps the last messages of a room in a ring buffer. Older messages are dropped once it is
+// full, so memory and insertion cost stay the same however long the room is open.
+class ChatModel : public QAbstractListModel {
+    Q_OBJECT
+   public:
+    enum Role { TimeRole = Qt::UserRole, UserNameRole, TextRole };
+
+    explicit ChatModel(int capacity, QObject* parent = nullptr);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+    void append(const QList<ChatMessage>& messages);
+    void clear();
+
+    int capacity() const;
+
+   private:
+    const ChatMessage& at(int row) const;
+
+    QList<ChatMessage> m_messages;  // grows to the capacity, then slots are reused
+    int m_capacity;
+    int m_first;  // slot of the oldest message
+    int m_count;
+};
+
+#endif  // CHATMODEL_HPP
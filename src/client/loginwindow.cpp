@@ -31,6 +31,7 @@ LoginWindow::LoginWindow(QWidget* parent) : QWidget(parent) {
     // Connect
     m_lineUserName = new QLineEdit(this);
     m_lineRoomId = new QLineEdit(this);
+    m_spinBoxStripes = new QSpinBox(this);
     m_pushButtonConnect = new QPushButton(this);
 
     // Next windows
@@ -77,6 +78,9 @@ void LoginWindow::ui_setupGeometry() {
     m_lineRoomId->setGeometry(currentObjectSize);
     increaseCurrentObjectAY(currentObjectSize);
 
+    m_spinBoxStripes->setGeometry(currentObjectSize);
+    increaseCurrentObjectAY(currentObjectSize);
+
     m_pushButtonConnect->setGeometry(currentObjectSize.x(),
                                      size().height() - currentObjectSize.height() - 20,
                                      currentObjectSize.width(), currentObjectSize.height());
@@ -128,6 +132,13 @@ void LoginWindow::ui_loadContents() {
     m_lineRoomId->setClearButtonEnabled(true);
     connect(m_lineRoomId, SIGNAL(returnPressed()), this, SLOT(pushButtonConnect_clicked()));
 
+    m_spinBoxStripes->setStyleSheet(m_lineUserName->styleSheet());
+    m_spinBoxStripes->setAlignment(Qt::AlignHCenter);
+    m_spinBoxStripes->setRange(1, MAX_STRIPE_COUNT);
+    m_spinBoxStripes->setValue(4);
+    m_spinBoxStripes->setPrefix("Parallel connections: ");
+    m_spinBoxStripes->setToolTip("Connections used for files larger than a few megabytes");
+
     m_pushButtonConnect->setStyleSheet(m_lineUserName->styleSheet());
     m_pushButtonConnect->setText("Connect");
     m_pushButtonConnect->setDefault(true);
@@ -136,6 +147,8 @@ void LoginWindow::ui_loadContents() {
     // Next windows
     connect(m_widgetRoom, SIGNAL(opened()), this, SLOT(hide()));
     connect(m_widgetRoom, SIGNAL(closed()), this, SLOT(show()));
+    connect(m_widgetRoom, SIGNAL(connectionOpened()), this, SLOT(roomConnectionOpened()));
+    connect(m_widgetRoom, SIGNAL(connectionFailed(QString)), this, SLOT(roomConnectionFailed(QString)));
 }
 
 void LoginWindow::actionAbout_triggered() {
@@ -159,20 +172,36 @@ void LoginWindow::pushButtonConnect_clicked() {
     m_widgetRoom->setUserName(m_lineUserName->text());
     m_widgetRoom->setRoomId(m_lineRoomId->text());
     m_widgetRoom->setServerAddress(m_comboBoxServers->currentText());
+    m_widgetRoom->setStripeCount(m_spinBoxStripes->value());
 
-    if (m_widgetRoom->connectToServer() == false) {
-        messageBoxText =
-            QString("Can't join " + m_widgetRoom->getRoomId() + '@' + m_widgetRoom->getServerAddress() +
-                    " as " + m_widgetRoom->getUserName());
-        qDebug() << messageBoxText;
+    // Window stays usable while connecting, the room opens once the connection is established
+    m_pushButtonConnect->setEnabled(false);
+    m_pushButtonConnect->setText("Connecting...");
 
-        QMessageBox::warning(this, "Connect", messageBoxText, QMessageBox::Close, QMessageBox::Close);
-        return;
-    }
+    m_widgetRoom->connectToServer();
+}
+
+void LoginWindow::roomConnectionOpened() {
+    m_pushButtonConnect->setEnabled(true);
+    m_pushButtonConnect->setText("Connect");
 
     m_widgetRoom->show();
 }
 
+void LoginWindow::roomConnectionFailed(const QString& error) {
+    QString messageBoxText;
+
+    m_pushButtonConnect->setEnabled(true);
+    m_pushButtonConnect->setText("Connect");
+
+    messageBoxText =
+        QString("Can't join " + m_widgetRoom->getRoomId() + '@' + m_widgetRoom->getServerAddress() + " as " +
+                m_widgetRoom->getUserName() + ": " + error);
+    qDebug() << messageBoxText;
+
+    QMessageBox::warning(this, "Connect", messageBoxText, QMessageBox::Close, QMessageBox::Close);
+}
+
 LoginWindow::~LoginWindow() {
     // Menubar
     m_actionAbout->deleteLater();
@@ -189,6 +218,8 @@ LoginWindow::~LoginWindow() {
     delete m_lineRoomId->validator();
     m_lineRoomId->deleteLater();
 
+    m_spinBoxStripes->deleteLater();
+
     m_pushButtonConnect->deleteLater();
 
     // Next windows
@@ -7,6 +7,7 @@
 #include <QMenu>
 #include <QMenuBar>
 #include <QPushButton>
+#include <QSpinBox>
 #include <QStatusBar>
 #include <QWidget>
 
@@ -34,6 +35,7 @@ class LoginWindow : public QWidget {
     // Connect
     QLineEdit* m_lineUserName;
     QLineEdit* m_lineRoomId;
+    QSpinBox* m_spinBoxStripes;
     QPushButton* m_pushButtonConnect;
 
     // Next windows
@@ -42,5 +44,7 @@ class LoginWindow : public QWidget {
    public slots:
     void pushButtonConnect_clicked();
     void actionAbout_triggered();
+    void roomConnectionOpened();
+    void roomConnectionFailed(const QString& error);
 };
 #endif  // LOGINWINDOW_HPP
@@ -0,0 +1,1079 @@
+#include "roomclient.hpp"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFileInfo>
+#include <QRandomGenerator>
+
+#include "../base64.hpp"
+#include "../logger.hpp"
+
+#define DEFAULT_PORT 8044
+#define PARTIAL_FILE_SUFFIX ".part"
+#define CONNECT_TIMEOUT_MS 10000
+#define PROGRESS_INTERVAL_MS 100
+
+static void splitServerAddress(const QString& serverAddress, QString& address, quint16& port) {
+    auto idx = serverAddress.lastIndexOf(':');
+
+    if (idx != -1) {
+        address = serverAddress.mid(0, idx);
+        port = serverAddress.mid(idx + 1).toUInt();
+    } else {
+        address = serverAddress;
+        port = DEFAULT_PORT;
+    }
+}
+
+// SHA-256 of the whole file, empty if it can't be read
+static QByteArray contentHash(QFile* file) {
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+
+    if (!hash.addData(file)) {
+        qDebug() << file->fileName() << file->errorString();
+        return QByteArray();
+    }
+
+    return hash.result();
+}
+
+RoomClient::RoomClient(QObject* parent)
+    : QObject(parent),
+      m_stripeCount(1),
+      m_clientSocketDisconnected(true),
+      m_protocolVersion(protocol::TEXT_VERSION),
+      m_codec(compression::Codec::None),
+      m_roomSequence(0),
+      m_hasRoomState(false),
+      m_uploadFile(nullptr),
+      m_uploadIsText(false),
+      m_uploadCodec(compression::Codec::None),
+      m_uploadStarted(false),
+      m_uploadTransferId(0),
+      m_uploadStripes(nullptr),
+      m_downloadFile(nullptr),
+      m_downloadSize(-1),
+      m_downloadIsProbe(false),
+      m_downloadTransferId(0) {
+    // Messages cross threads in queued connections
+    qRegisterMetaType<QList<ChatMessage>>("QList<ChatMessage>");
+
+    // Children move with the client when it is moved to another thread
+    m_clientSocket = new QTcpSocket(this);
+    connect(m_clientSocket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+    connect(m_clientSocket, SIGNAL(connected()), this, SLOT(connected()));
+    connect(m_clientSocket, SIGNAL(disconnected()), this, SLOT(socketDisconnected()));
+    connect(m_clientSocket, SIGNAL(errorOccurred(QAbstractSocket::SocketError)), this, SLOT(socketError()));
+    connect(m_clientSocket, SIGNAL(bytesWritten(qint64)), this, SLOT(sendFileChunks()));
+
+    m_connectTimer = new QTimer(this);
+    m_connectTimer->setSingleShot(true);
+    m_connectTimer->setInterval(CONNECT_TIMEOUT_MS);
+    connect(m_connectTimer, SIGNAL(timeout()), this, SLOT(connectTimedOut()));
+}
+
+void RoomClient::receiveTextMessage(const QString& msg) {
+    ChatMessage message;
+
+    auto firstSpaceIdx = msg.indexOf(' ');
+    message.time = msg.mid(0, firstSpaceIdx);
+
+    auto delimiterColonIdx = firstSpaceIdx + msg.mid(firstSpaceIdx).indexOf(':');
+    message.userName = msg.mid(firstSpaceIdx + 1, delimiterColonIdx - firstSpaceIdx - 1);
+    message.text = msg.mid(delimiterColonIdx + 1);
+
+    m_pendingMessages.append(message);
+}
+
+void RoomClient::flushMessages() {
+    // Busy rooms deliver many lines per read, the view inserts them in one go
+    if (m_pendingMessages.isEmpty()) {
+        return;
+    }
+
+    emit messagesReceived(m_pendingMessages);
+    m_pendingMessages.clear();
+}
+
+void RoomClient::setUserList(const QString& separatedString) {
+    m_userList = separatedString.split(',', Qt::SkipEmptyParts);
+
+    emit usersChanged(m_userList);
+}
+
+void RoomClient::setFileList(const QString& separatedString) {
+    m_fileList = separatedString.split('/', Qt::SkipEmptyParts);
+
+    emit filesChanged(m_fileList);
+}
+
+void RoomClient::setRoomState(const QByteArray& payload) {
+    QString users;
+    QString files;
+    quint64 sequence;
+
+    if (!protocol::decodeRoomState(payload, sequence, users, files)) {
+        messageLogger("Received BAD", m_clientSocket, "Invalid room state");
+        return;
+    }
+
+    m_roomSequence = sequence;
+    m_hasRoomState = true;
+
+    setUserList(users);
+    setFileList(files);
+}
+
+void RoomClient::applyRoomEvent(const QByteArray& payload) {
+    protocol::RoomEventKind kind;
+    QString name;
+    quint64 sequence;
+
+    if (!protocol::decodeRoomEvent(payload, sequence, kind, name)) {
+        messageLogger("Received BAD", m_clientSocket, "Invalid room event");
+        return;
+    }
+
+    // Events sent before the state was taken are already part of it
+    if (!m_hasRoomState || sequence <= m_roomSequence) {
+        return;
+    }
+
+    if (sequence != m_roomSequence + 1) {
+        // Lists are stale from here on, events are ignored until the new state arrives
+        qDebug() << "Missed room events" << m_roomSequence + 1 << "to" << sequence - 1;
+
+        m_hasRoomState = false;
+        sendToServer(protocol::FrameType::GetRoomState, QByteArray());
+        return;
+    }
+
+    m_roomSequence = sequence;
+
+    switch (kind) {
+        case protocol::RoomEventKind::UserJoined:
+            m_userList.append(name);
+            emit userJoined(name);
+            break;
+        case protocol::RoomEventKind::UserLeft:
+            m_userList.removeOne(name);
+            emit userLeft(name);
+            break;
+        case protocol::RoomEventKind::FileAdded:
+            m_fileList.append(name);
+            emit fileAdded(name);
+            break;
+        case protocol::RoomEventKind::FileRemoved:
+            m_fileList.removeOne(name);
+            emit fileRemoved(name);
+            break;
+    }
+}
+
+bool RoomClient::beginReceiveFile(QString& fileName, const QString& roomId, qint64 size) {
+    QString outputDir;
+    QString filePath;
+
+    abortReceiveFile();
+
+    outputDir = m_downloadDirectory.isEmpty() ? QString(getenv("HOME")) + "/Downloads/" + roomId
+                                              : m_downloadDirectory;
+
+    QDir dir;
+    if (!dir.mkpath(outputDir)) {
+        qDebug() << "Failed to create path" << outputDir;
+        emit downloadFinished(fileName, QString(), false);
+        return false;
+    }
+
+    m_downloadKey = roomId + '/' + fileName;
+    m_downloadIsProbe = m_stripeProbes.remove(m_downloadKey);
+    auto partial = m_partialDownloads.constFind(m_downloadKey);
+
+    if (partial != m_partialDownloads.constEnd() && m_protocolVersion >= protocol::RESUMABLE_VERSION &&
+        QFile::exists(partial->path + PARTIAL_FILE_SUFFIX)) {
+        // Interrupted download, FileOffset tells how much of the partial file is kept
+        m_downloadFile = new QFile(partial->path + PARTIAL_FILE_SUFFIX);
+        m_downloadPath = partial->path;
+        m_downloadSize = size;
+
+        if (!m_downloadFile->open(QIODevice::ReadWrite)) {
+            qDebug() << m_downloadFile->fileName() << m_downloadFile->errorString();
+            failReceiveFile();
+            return false;
+        }
+
+        return true;
+    }
+
+    filePath = outputDir + '/' + fileName;
+
+    while (QFile::exists(filePath) || QFile::exists(filePath + PARTIAL_FILE_SUFFIX)) {
+        qDebug() << "Duplicate filename" << fileName;
+
+        auto idx = fileName.lastIndexOf('.');
+        if (idx != -1) {
+            fileName = fileName.mid(0, idx) + "-1" + fileName.mid(idx);
+        } else {
+            fileName = fileName + "-1";
+        }
+
+        filePath = outputDir + '/' + fileName;
+
+        qDebug() << "Changing to" << fileName;
+    }
+
+    // Data goes to a temporary file that gets its real name only when the download is complete
+    QFile* file = new QFile(filePath + PARTIAL_FILE_SUFFIX);
+
+    if (!file->open(QIODevice::WriteOnly, QFileDevice::ReadOwner | QFileDevice::WriteOwner)) {
+        qDebug() << file->fileName() << file->errorString();
+        delete file;
+        emit downloadFinished(fileName, filePath, false);
+        return false;
+    }
+
+    m_downloadFile = file;
+    m_downloadPath = filePath;
+    m_downloadSize = size;
+
+    return true;
+}
+
+void RoomClient::seekReceiveFile(quint64 transferId, qint64 offset) {
+    if (!m_downloadFile) {
+        return;
+    }
+
+    // Server starts over if the partial file has different content
+    if (!m_downloadFile->resize(offset) || !m_downloadFile->seek(offset)) {
+        qDebug() << m_downloadFile->fileName() << m_downloadFile->errorString();
+        failReceiveFile();
+        return;
+    }
+
+    // Striped downloads can't be continued, their ranges are not contiguous
+    if (m_downloadIsProbe) {
+        m_downloadTransferId = transferId;
+        return;
+    }
+
+    m_partialDownloads.insert(m_downloadKey, PartialDownload{m_downloadPath, transferId});
+}
+
+void RoomClient::receiveFileChunk(const QByteArray& data) {
+    if (!m_downloadFile) {
+        return;
+    }
+
+    if (m_downloadFile->write(data) != data.size()) {
+        qDebug() << m_downloadFile->fileName() << m_downloadFile->errorString();
+        failReceiveFile();
+        return;
+    }
+
+    if (m_downloadSize > 0 && isProgressDue()) {
+        emit downloadProgress(QFileInfo(m_downloadPath).fileName(), m_downloadFile->size(), m_downloadSize);
+    }
+}
+
+void RoomClient::finishReceiveFile() {
+    if (!m_downloadFile) {
+        return;
+    }
+
+    QFileInfo fileInfo(m_downloadPath);
+
+    if (m_downloadIsProbe) {
+        beginStripedDownload();
+        return;
+    }
+
+    if (m_downloadSize != -1 && m_downloadFile->size() != m_downloadSize) {
+        qDebug() << "Incomplete download" << m_downloadPath << m_downloadFile->size() << "of"
+                 << m_downloadSize << "bytes";
+        failReceiveFile();
+        return;
+    }
+
+    m_downloadFile->close();
+
+    if (!m_downloadFile->rename(m_downloadPath)) {
+        qDebug() << m_downloadFile->fileName() << m_downloadFile->errorString();
+        failReceiveFile();
+        return;
+    }
+
+    messageLogger("Received FILE", m_clientSocket, fileInfo.fileName());
+
+    m_partialDownloads.remove(m_downloadKey);
+
+    delete m_downloadFile;
+    m_downloadFile = nullptr;
+
+    emit downloadFinished(fileInfo.fileName(), m_downloadPath, true);
+}
+
+void RoomClient::failReceiveFile() {
+    QString path = m_downloadPath;
+
+    if (!m_downloadFile) {
+        return;
+    }
+
+    abortReceiveFile();
+
+    emit downloadFinished(QFileInfo(path).fileName(), path, false);
+}
+
+void RoomClient::abortReceiveFile() {
+    if (!m_downloadFile) {
+        return;
+    }
+
+    m_downloadFile->remove();
+    m_partialDownloads.remove(m_downloadKey);
+
+    delete m_downloadFile;
+    m_downloadFile = nullptr;
+}
+
+void RoomClient::suspendReceiveFile() {
+    if (!m_downloadFile) {
+        return;
+    }
+
+    // Only downloads with a transfer ID can be continued, others are started over
+    if (!m_partialDownloads.contains(m_downloadKey)) {
+        abortReceiveFile();
+        return;
+    }
+
+    qDebug() << "Suspended download" << m_downloadPath << "at" << m_downloadFile->size() << "bytes";
+
+    delete m_downloadFile;
+    m_downloadFile = nullptr;
+}
+
+void RoomClient::requestFile(const QString& fileName) {
+    PartialDownload partial;
+    qint64 offset;
+
+    partial = m_partialDownloads.value(m_roomId + '/' + fileName, PartialDownload{QString(), 0});
+    offset = partial.transferId != 0 ? QFileInfo(partial.path + PARTIAL_FILE_SUFFIX).size() : 0;
+
+    sendToServer(protocol::FrameType::GetFileRange,
+                 protocol::encodeTransfer(partial.transferId, offset, fileName));
+}
+
+void RoomClient::beginStripedDownload() {
+    QString fileName;
+    QString roomId;
+    QString path;
+    QString address;
+    quint16 port;
+
+    roomId = m_downloadKey.left(m_downloadKey.indexOf('/'));
+    fileName = m_downloadKey.mid(roomId.size() + 1);
+    path = m_downloadPath;
+
+    // Small files are requested again as a whole
+    if (m_downloadSize < STRIPE_MIN_SIZE || m_downloadTransferId == 0) {
+        abortReceiveFile();
+        requestFile(fileName);
+        return;
+    }
+
+    if (!m_downloadFile->resize(m_downloadSize)) {
+        qDebug() << m_downloadFile->fileName() << m_downloadFile->errorString();
+        failReceiveFile();
+        return;
+    }
+
+    // Partial file stays on disk, the data connections open it again
+    delete m_downloadFile;
+    m_downloadFile = nullptr;
+
+    auto transfer = new StripedTransfer(StripedTransfer::Direction::Download, path + PARTIAL_FILE_SUFFIX,
+                                        m_downloadTransferId, m_downloadSize, this);
+
+    connect(transfer, &StripedTransfer::progress, this, [this, path](qint64 transferred, qint64 size) {
+        if (isProgressDue()) {
+            emit downloadProgress(QFileInfo(path).fileName(), transferred, size);
+        }
+    });
+
+    connect(transfer, &StripedTransfer::finished, this, [this, transfer, path](bool success) {
+        QFileInfo fileInfo(path);
+
+        if (success && QFile::rename(path + PARTIAL_FILE_SUFFIX, path)) {
+            messageLogger("Received FILE", m_clientSocket, fileInfo.fileName());
+        } else {
+            QFile::remove(path + PARTIAL_FILE_SUFFIX);
+            success = false;
+        }
+
+        transfer->deleteLater();
+
+        emit downloadFinished(fileInfo.fileName(), path, success);
+    });
+
+    splitServerAddress(m_serverAddress, address, port);
+    transfer->start(address, port, roomId, m_userName, fileName, m_stripeCount);
+}
+
+void RoomClient::beginStripedUpload() {
+    QString address;
+    quint16 port;
+
+    auto transfer = new StripedTransfer(StripedTransfer::Direction::Upload, m_uploadFile->fileName(),
+                                        m_uploadTransferId, m_uploadFile->size(), this);
+    m_uploadStripes = transfer;
+
+    connect(transfer, &StripedTransfer::progress, this, [this](qint64 transferred, qint64 size) {
+        if (isProgressDue()) {
+            emit uploadProgress(m_uploadFileName, transferred, size);
+        }
+    });
+
+    // Server finishes the upload on the main connection once every range is acknowledged
+    connect(transfer, &StripedTransfer::finished, this, [this, transfer](bool success) {
+        if (m_uploadStripes != transfer) {
+            return;
+        }
+
+        sendToServer(protocol::FrameType::FileEnd, QByteArray());
+
+        if (success) {
+            qDebug() << "Uploaded file" << m_uploadFile->fileName();
+        }
+
+        finishUpload(success);
+    });
+
+    splitServerAddress(m_serverAddress, address, port);
+    transfer->start(address, port, m_uploadRoomId, m_userName, m_uploadFileName, m_stripeCount);
+}
+
+void RoomClient::resumeTransfers() {
+    if (m_protocolVersion < protocol::RESUMABLE_VERSION) {
+        return;
+    }
+
+    if (m_uploadFile && !m_uploadStarted) {
+        if (m_uploadRoomId == m_roomId) {
+            sendToServer(protocol::FrameType::FileResume,
+                         protocol::encodeResume(m_uploadTransferId, m_uploadFile->size(), m_uploadFileName,
+                                                m_uploadHash));
+        } else {
+            finishUpload(false);
+        }
+    }
+
+    for (const auto& key : m_partialDownloads.keys()) {
+        if (key.startsWith(m_roomId + '/')) {
+            requestFile(key.mid(m_roomId.size() + 1));
+        }
+    }
+}
+
+void RoomClient::finishUpload(bool success) {
+    QString fileName = m_uploadFileName;
+
+    cancelUpload();
+
+    emit uploadFinished(fileName, success);
+}
+
+bool RoomClient::isProgressDue() {
+    // Transfers report progress a few times per second, not for every chunk
+    if (m_progressClock.isValid() && m_progressClock.elapsed() < PROGRESS_INTERVAL_MS) {
+        return false;
+    }
+
+    m_progressClock.start();
+    return true;
+}
+
+void RoomClient::cancelUpload() {
+    if (m_uploadStripes) {
+        m_uploadStripes->deleteLater();
+        m_uploadStripes = nullptr;
+    }
+
+    delete m_uploadFile;
+    m_uploadFile = nullptr;
+    m_uploadStarted = false;
+    m_uploadTransferId = 0;
+    m_uploadHash.clear();
+    m_deferredWrites.clear();
+}
+
+void RoomClient::downloadFile(const QString& fileName) {
+    QString message;
+
+    if (fileName.isEmpty()) {
+        return;
+    }
+
+    if (m_protocolVersion >= protocol::STRIPED_VERSION && m_stripeCount > 1 &&
+        !m_partialDownloads.contains(m_roomId + '/' + fileName)) {
+        // Empty range tells the size and ID of the file, the ranges follow over data connections
+        m_stripeProbes.insert(m_roomId + '/' + fileName);
+        sendToServer(protocol::FrameType::GetFileSlice, protocol::encodeSlice(0, 0, 0, fileName));
+    } else if (m_protocolVersion >= protocol::RESUMABLE_VERSION) {
+        requestFile(fileName);
+    } else if (m_protocolVersion >= protocol::FRAMED_VERSION) {
+        sendToServer(protocol::FrameType::GetFile, fileName.toUtf8());
+    } else {
+        message = "/getfile '" + fileName + "' " + m_roomId + ":." + '\n';
+
+        writeToServer(message.toUtf8());
+        messageLogger("Sent", m_clientSocket, message);
+    }
+}
+
+void RoomClient::sendMessage(const QString& message) {
+    QString line;
+
+    if (message.isEmpty()) {
+        return;
+    }
+
+    if (m_protocolVersion >= protocol::FRAMED_VERSION) {
+        sendToServer(protocol::FrameType::Message, message.toUtf8());
+    } else {
+        line = "/msg " + m_roomId + ":" + message + '\n';
+
+        writeToServer(line.toUtf8());
+        messageLogger("Sent", m_clientSocket, line);
+    }
+}
+
+void RoomClient::uploadFile(const QString& filePath) {
+    QString fileName;
+    QString messageToWrite;
+
+    if (m_uploadFile) {
+        messageToWrite = "Another file is being uploaded, wait until it is finished.";
+        qDebug() << messageToWrite;
+
+        emit uploadRejected(messageToWrite);
+        return;
+    }
+
+    QFile* file = new QFile(filePath);
+    if (!file->open(QIODevice::ReadOnly)) {
+        messageToWrite = file->fileName() + ": " + file->errorString();
+        qDebug() << messageToWrite;
+        delete file;
+
+        emit uploadRejected(messageToWrite);
+        return;
+    }
+
+    m_uploadIsText = m_protocolVersion < protocol::FRAMED_VERSION;
+
+    if (m_uploadIsText && file->size() > protocol::MAX_TEXT_FILE_SIZE) {
+        messageToWrite =
+            "The size of the selected file is larger than allowed (512 MiB), the process is aborted.";
+        qDebug() << messageToWrite;
+
+        delete file;
+
+        emit uploadRejected(messageToWrite);
+        return;
+    }
+
+    fileName = filePath.mid(filePath.lastIndexOf('/') + 1).replace('\'', '_');
+    m_uploadFile = file;
+    m_uploadFileName = fileName;
+    m_uploadRoomId = m_roomId;
+
+    // Archives and media are sent as they are
+    m_uploadCodec = m_uploadIsText || !compression::isCompressible(file->peek(compression::SAMPLE_SIZE))
+                        ? compression::Codec::None
+                        : m_codec;
+
+    if (m_uploadIsText) {
+        messageToWrite = "/sendfile '" + fileName + "' " + m_roomId + ':';
+
+        m_clientSocket->write(messageToWrite.toUtf8());
+        messageLogger("Sent FILE", m_clientSocket, messageToWrite + "_BASE64_DATA_");
+    } else if (m_protocolVersion >= protocol::RESUMABLE_VERSION) {
+        // Chunks follow once the server answers with FileOffset
+        m_uploadTransferId = QRandomGenerator::global()->generate64() | 1;
+        m_uploadStarted = false;
+
+        // Server answers with the file size if it already stores the content, the file is then only listed
+        if (m_protocolVersion >= protocol::CONTENT_HASH_VERSION) {
+            m_uploadHash = contentHash(file);
+        }
+
+        sendToServer(protocol::FrameType::FileResume,
+                     protocol::encodeResume(m_uploadTransferId, file->size(), fileName, m_uploadHash));
+        return;
+    } else {
+        sendToServer(protocol::FrameType::FileBegin, protocol::encodeFileBegin(fileName, file->size()));
+    }
+
+    m_uploadStarted = true;
+    sendFileChunks();
+}
+
+void RoomClient::sendFileChunks() {
+    QByteArray chunk;
+    QByteArray packed;
+
+    if (!m_uploadFile || !m_uploadStarted || m_uploadStripes) {
+        return;
+    }
+
+    // File is read only as fast as the socket drains, so memory use does not depend on file size
+    while (m_clientSocket->bytesToWrite() < protocol::FILE_HIGH_WATER_MARK) {
+        chunk = m_uploadFile->read(protocol::FILE_CHUNK_SIZE);
+
+        if (chunk.isEmpty()) {
+            if (m_uploadIsText) {
+                m_clientSocket->write("\n" + m_deferredWrites);
+                m_deferredWrites.clear();
+            } else {
+                sendToServer(protocol::FrameType::FileEnd, QByteArray());
+            }
+
+            qDebug() << "Uploaded file" << m_uploadFile->fileName();
+
+            finishUpload(true);
+            return;
+        }
+
+        if (m_uploadIsText) {
+            m_clientSocket->write(base64::encode(chunk));
+        } else if (m_uploadCodec != compression::Codec::None &&
+                   compression::compressChunk(m_uploadCodec, chunk, packed) &&
+                   packed.size() < chunk.size() - (chunk.size() >> compression::MIN_SAVING_SHIFT)) {
+            m_clientSocket->write(protocol::encodeFrame(protocol::FrameType::PackedChunk, m_roomId.toUtf8(),
+                                                        packed));
+        } else {
+            // Chunk did not shrink enough, the rest of the file is sent raw
+            m_uploadCodec = compression::Codec::None;
+            m_clientSocket->write(protocol::encodeFrame(protocol::FrameType::FileChunk, m_roomId.toUtf8(),
+                                                        chunk));
+        }
+    }
+
+    if (isProgressDue()) {
+        emit uploadProgress(m_uploadFileName, m_uploadFile->pos(), m_uploadFile->size());
+    }
+}
+
+void RoomClient::disconnectFromServer() {
+    m_connectTimer->stop();
+
+    if (m_clientSocketDisconnected) {
+        // Still connecting
+        if (m_clientSocket->state() != QAbstractSocket::UnconnectedState) {
+            m_clientSocket->abort();
+            emit connectionFailed("Connection cancelled");
+        }
+
+        return;
+    }
+
+    m_clientSocketDisconnected = true;
+
+    cancelUpload();
+    abortReceiveFile();
+
+    closeConnection();
+}
+
+void RoomClient::connectionLost() {
+    if (m_clientSocketDisconnected) return;
+
+    m_clientSocketDisconnected = true;
+
+    if (m_protocolVersion >= protocol::RESUMABLE_VERSION) {
+        // Transfers continue after joining the room again
+        if (m_uploadTransferId == 0 || m_uploadStripes) {
+            cancelUpload();
+        }
+
+        m_uploadStarted = false;
+        suspendReceiveFile();
+    } else {
+        cancelUpload();
+        abortReceiveFile();
+    }
+
+    closeConnection();
+}
+
+void RoomClient::closeConnection() {
+    bool isOpen = m_clientSocket->state() == QAbstractSocket::ConnectedState ||
+                  m_clientSocket->state() == QAbstractSocket::ClosingState;
+
+    // Buffered data is written first, socketDisconnected() follows once the socket is closed
+    m_clientSocket->disconnectFromHost();
+
+    if (!isOpen) {
+        socketDisconnected();
+    }
+}
+
+void RoomClient::socketDisconnected() {
+    if (!m_clientSocketDisconnected) {
+        // Server closed the connection, connectionLost() comes back here through closeConnection()
+        connectionLost();
+        return;
+    }
+
+    qDebug() << "Disconnected!";
+
+    m_userList.clear();
+    m_fileList.clear();
+
+    emit disconnected();
+}
+
+void RoomClient::socketError() {
+    // Errors of an established connection end in socketDisconnected()
+    if (!m_clientSocketDisconnected || !m_connectTimer->isActive()) {
+        return;
+    }
+
+    m_connectTimer->stop();
+    qDebug() << m_clientSocket->errorString();
+
+    emit connectionFailed(m_clientSocket->errorString());
+}
+
+void RoomClient::connectTimedOut() {
+    qDebug() << "Connection to" << m_serverAddress << "timed out";
+
+    m_clientSocket->abort();
+
+    emit connectionFailed("Connection timed out");
+}
+
+void RoomClient::readyRead() {
+    char firstByte;
+
+    while (m_clientSocket->peek(&firstByte, 1) == 1) {
+        if (protocol::isFrameStart(firstByte)) {
+            // Binary frame from server
+            protocol::Frame frame;
+            auto result = protocol::readFrame(m_clientSocket, frame);
+
+            if (result == protocol::ReadResult::Incomplete) {
+                break;
+            } else if (result == protocol::ReadResult::Error) {
+                messageLogger("Received BAD", m_clientSocket, "Malformed frame, disconnecting");
+                flushMessages();
+                connectionLost();
+                return;
+            }
+
+            processFrame(frame);
+        } else if (m_clientSocket->canReadLine()) {
+            // Text line from server
+            processTextLine(protocol::readLine(m_clientSocket, m_lineBuffer));
+        } else {
+            break;
+        }
+    }
+
+    flushMessages();
+}
+
+void RoomClient::processTextLine(QByteArrayView line) {
+    protocol::TextCommand command;
+    QString filename;
+    QString roomId;
+    QString data;
+
+    if (!protocol::parseTextLine(line, command)) {
+        data = QString::fromUtf8(line);
+
+        if (data.contains(':')) {
+            // Text message from server
+            receiveTextMessage(data);
+
+            messageLogger("Received TEXT", m_clientSocket, data);
+        } else {
+            messageLogger("Received BAD", m_clientSocket, data);
+        }
+
+        return;
+    }
+
+    roomId = QString::fromUtf8(command.room);
+    data = QString::fromUtf8(command.data);
+
+    if (!command.hasFileName) {
+        // Message from server
+
+        if (command.command == protocol::Command::Protocol) {
+            // Server accepted the protocol version, it will send frames from now on
+            m_protocolVersion =
+                qBound(protocol::TEXT_VERSION, command.room.toInt(), protocol::CURRENT_VERSION);
+            m_codec = m_protocolVersion >= protocol::COMPRESSED_VERSION
+                          ? compression::chooseCodec(command.data)
+                          : compression::Codec::None;
+
+            messageLogger("Received PROTOCOL", m_clientSocket, QString::fromUtf8(line));
+        } else if (command.command == protocol::Command::RoomId) {
+            // Room ID for client from server
+            setRoomId(roomId);
+            emit identityChanged(m_userName, m_roomId);
+
+            messageLogger("Received ROOM_ID", m_clientSocket, QString::fromUtf8(line));
+        } else if (command.command == protocol::Command::UserId) {
+            // Username for client from server
+            setUserName(data);
+            emit identityChanged(m_userName, m_roomId);
+
+            messageLogger("Received USER_ID", m_clientSocket, QString::fromUtf8(line));
+
+            emit joined();
+        } else if (command.command == protocol::Command::Users && roomId == m_roomId) {
+            // User list from server
+            setUserList(data);
+
+            messageLogger("Received USER_LIST", m_clientSocket, QString::fromUtf8(line));
+        } else if (command.command == protocol::Command::Files && roomId == m_roomId) {
+            // File list from server
+            setFileList(data);
+
+            messageLogger("Received FILE_LIST", m_clientSocket, QString::fromUtf8(line));
+        }
+    } else {
+        // File from server
+
+        filename = QString::fromUtf8(command.fileName);
+
+        if (command.command == protocol::Command::SendFile && !filename.isEmpty() &&
+            !command.data.isEmpty()) {
+            // File contents from server
+
+            QByteArray contents;
+
+            if (!base64::decode(command.data, contents)) {
+                messageLogger("Received BAD", m_clientSocket, "Invalid base64 data of '" + filename + "'");
+                emit downloadFinished(filename, QString(), false);
+            } else if (beginReceiveFile(filename, roomId, -1)) {
+                receiveFileChunk(contents);
+                finishReceiveFile();
+            }
+        }
+    }
+}
+
+void RoomClient::processFrame(const protocol::Frame& frame) {
+    QString roomId;
+    QString data;
+    QString filename;
+    QByteArray chunk;
+    quint64 transferId;
+    qint64 size;
+
+    roomId = QString::fromUtf8(frame.room);
+
+    switch (frame.type) {
+        case protocol::FrameType::RoomId:
+            // Room ID for client from server
+            setRoomId(roomId);
+            emit identityChanged(m_userName, m_roomId);
+
+            messageLogger("Received ROOM_ID", m_clientSocket, protocol::describeFrame(frame));
+            break;
+        case protocol::FrameType::UserId:
+            // Username for client from server
+            setUserName(QString::fromUtf8(frame.payload));
+            emit identityChanged(m_userName, m_roomId);
+
+            messageLogger("Received USER_ID", m_clientSocket, protocol::describeFrame(frame));
+
+            // Client has joined the room, interrupted transfers can continue
+            resumeTransfers();
+
+            emit joined();
+            break;
+        case protocol::FrameType::Users:
+            // User list from server
+            if (roomId == m_roomId) {
+                setUserList(QString::fromUtf8(frame.payload));
+
+                messageLogger("Received USER_LIST", m_clientSocket, protocol::describeFrame(frame));
+            }
+            break;
+        case protocol::FrameType::Files:
+            // File list from server
+            if (roomId == m_roomId) {
+                setFileList(QString::fromUtf8(frame.payload));
+
+                messageLogger("Received FILE_LIST", m_clientSocket, protocol::describeFrame(frame));
+            }
+            break;
+        case protocol::FrameType::RoomState:
+            // Users and files of the room, room events continue from its sequence number
+            if (roomId == m_roomId) {
+                setRoomState(frame.payload);
+
+                messageLogger("Received ROOM_STATE", m_clientSocket, protocol::describeFrame(frame));
+            }
+            break;
+        case protocol::FrameType::RoomEvent:
+            // User or file added to or removed from the room
+            if (roomId == m_roomId) {
+                applyRoomEvent(frame.payload);
+
+                messageLogger("Received ROOM_EVENT", m_clientSocket, protocol::describeFrame(frame));
+            }
+            break;
+        case protocol::FrameType::Message:
+            // Text message from server
+            data = QString::fromUtf8(frame.payload);
+            receiveTextMessage(data);
+
+            messageLogger("Received TEXT", m_clientSocket, data);
+            break;
+        case protocol::FrameType::FileBegin:
+            // File contents from server follow in chunks
+            if (protocol::decodeFileBegin(frame.payload, filename, size) && !filename.isEmpty()) {
+                beginReceiveFile(filename, roomId, size);
+            }
+            break;
+        case protocol::FrameType::FileOffset:
+            // Where an upload or the download that has just begun continues from
+            if (!protocol::decodeTransfer(frame.payload, transferId, size, filename)) {
+                messageLogger("Received BAD", m_clientSocket, protocol::describeFrame(frame));
+            } else if (m_uploadFile && !m_uploadStarted && transferId == m_uploadTransferId) {
+                if (!m_uploadFile->seek(size)) {
+                    qDebug() << m_uploadFile->fileName() << m_uploadFile->errorString();
+                    finishUpload(false);
+                    break;
+                }
+
+                m_uploadStarted = true;
+
+                if (m_protocolVersion >= protocol::STRIPED_VERSION && m_stripeCount > 1 && size == 0 &&
+                    m_uploadFile->size() >= STRIPE_MIN_SIZE) {
+                    beginStripedUpload();
+                } else {
+                    sendFileChunks();
+                }
+            } else {
+                seekReceiveFile(transferId, size);
+            }
+            break;
+        case protocol::FrameType::FileChunk:
+            receiveFileChunk(frame.payload);
+            break;
+        case protocol::FrameType::PackedChunk:
+            if (compression::decompressChunk(frame.payload, chunk)) {
+                receiveFileChunk(chunk);
+            } else {
+                messageLogger("Received BAD", m_clientSocket, protocol::describeFrame(frame));
+                failReceiveFile();
+            }
+            break;
+        case protocol::FrameType::FileEnd:
+            finishReceiveFile();
+            break;
+        default:
+            messageLogger("Received BAD", m_clientSocket, protocol::describeFrame(frame));
+            break;
+    }
+}
+
+void RoomClient::writeToServer(const QByteArray& data) {
+    // Text uploads occupy the stream until their line ends
+    if (m_uploadFile && m_uploadIsText) {
+        m_deferredWrites += data;
+    } else {
+        m_clientSocket->write(data);
+    }
+}
+
+void RoomClient::sendToServer(protocol::FrameType type, const QByteArray& payload) {
+    protocol::Frame frame{type, m_roomId.toUtf8(), payload};
+
+    m_clientSocket->write(protocol::encodeFrame(frame.type, frame.room, frame.payload));
+    messageLogger("Sent", m_clientSocket, protocol::describeFrame(frame));
+}
+
+void RoomClient::connected() {
+    QString message = "/protocol " + QString::number(protocol::CURRENT_VERSION) + ':' +
+                      QString::fromLatin1(compression::supportedCodecs()) + '\n';
+
+    m_connectTimer->stop();
+    m_clientSocketDisconnected = false;
+    m_hasRoomState = false;
+
+    qDebug() << "Connected!";
+    emit connectionOpened();
+
+    // Old servers ignore unknown commands, so the client stays on text protocol until confirmed
+    m_protocolVersion = protocol::TEXT_VERSION;
+    m_codec = compression::Codec::None;
+    m_clientSocket->write(message.toUtf8());
+    messageLogger("Sent", m_clientSocket, message);
+
+    message = "/join " + m_roomId + ':' + m_userName + '\n';
+
+    m_clientSocket->write(message.toUtf8());
+    messageLogger("Sent", m_clientSocket, message);
+}
+
+void RoomClient::connectToServer() {
+    QString address;
+    quint16 port;
+
+    splitServerAddress(m_serverAddress, address, port);
+
+    // connected() or connectionFailed() follows
+    qDebug() << "Connect to" << m_serverAddress;
+    m_connectTimer->start();
+    m_clientSocket->connectToHost(address, port);
+}
+
+QString RoomClient::getUserName() { return m_userName; }
+
+QString RoomClient::getRoomId() { return m_roomId; }
+
+QString RoomClient::getServerAddress() { return m_serverAddress; }
+
+QStringList RoomClient::getUserList() { return m_userList; }
+
+QStringList RoomClient::getFileList() { return m_fileList; }
+
+void RoomClient::setServerAddress(const QString& str) {
+    m_serverAddress = str;
+}
+
+void RoomClient::setStripeCount(int count) {
+    m_stripeCount = qBound(1, count, MAX_STRIPE_COUNT);
+}
+
+void RoomClient::setDownloadDirectory(const QString& path) {
+    m_downloadDirectory = path;
+}
+
+void RoomClient::setUserName(const QString& str) {
+    m_userName = str;
+}
+
+void RoomClient::setRoomId(const QString& str) {
+    if (str.isEmpty()) {
+        m_roomId = "new";
+    } else {
+        m_roomId = str;
+    }
+}
+
+RoomClient::~RoomClient() {
+    cancelUpload();
+
+    delete m_downloadFile;
+}
@@ -0,0 +1,174 @@
+#ifndef ROOMCLIENT_HPP
+#define ROOMCLIENT_HPP
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QObject>
+#include <QSet>
+#include <QStringList>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "../compression.hpp"
+#include "../protocol.hpp"
+#include "stripedtransfer.hpp"
+
+// Download interrupted by a dropped connection, continued from the size of its ".part" file
+struct PartialDownload {
+    QString path;
+    quint64 transferId;
+};
+
+// Chat line as sent by the server, "time userName:text". Notices of the client itself have no time and user.
+struct ChatMessage {
+    QString time;
+    QString userName;
+    QString text;
+};
+
+Q_DECLARE_METATYPE(ChatMessage)
+
+// RoomClient speaks the protocol of one room: it negotiates the version, joins, sends and receives messages
+// and moves files. It has no user interface, RoomWindow and wsted-cli show what its signals report. Nothing
+// blocks, so the client can run on a thread of its own and keep socket and disk work off the GUI thread.
+class RoomClient : public QObject {
+    Q_OBJECT
+   public:
+    explicit RoomClient(QObject* parent = nullptr);
+    ~RoomClient();
+
+    QString getUserName();
+    QString getRoomId();
+    QString getServerAddress();
+    QStringList getUserList();
+    QStringList getFileList();
+
+   public slots:
+    // Slots can be invoked from another thread, RoomWindow runs the client on its own thread
+    void connectToServer();
+    void disconnectFromServer();
+
+    void setUserName(const QString& str);
+    void setRoomId(const QString& str);
+    void setServerAddress(const QString& str);
+    void setStripeCount(int count);
+
+    // Downloads go to ~/Downloads/<room> unless a directory is set
+    void setDownloadDirectory(const QString& path);
+
+    void sendMessage(const QString& message);
+    void uploadFile(const QString& filePath);
+    void downloadFile(const QString& fileName);
+
+   private:
+    // Protocol
+    void processTextLine(QByteArrayView line);
+    void processFrame(const protocol::Frame& frame);
+    void sendToServer(protocol::FrameType type, const QByteArray& payload);
+    void writeToServer(const QByteArray& data);
+
+    // Messages
+    void receiveTextMessage(const QString& msg);
+    void flushMessages();
+
+    // Users
+    void setUserList(const QString& separatedString);
+
+    // Files
+    void setFileList(const QString& separatedString);
+
+    // Room state
+    void setRoomState(const QByteArray& payload);
+    void applyRoomEvent(const QByteArray& payload);
+
+    bool beginReceiveFile(QString& fileName, const QString& roomId, qint64 size);
+    void seekReceiveFile(quint64 transferId, qint64 offset);
+    void receiveFileChunk(const QByteArray& data);
+    void finishReceiveFile();
+    void failReceiveFile();
+    void abortReceiveFile();
+    void suspendReceiveFile();
+    void requestFile(const QString& fileName);
+    void beginStripedDownload();
+    void beginStripedUpload();
+
+    // Transfers
+    void resumeTransfers();
+    void finishUpload(bool success);
+    void cancelUpload();
+    bool isProgressDue();
+
+    // Connection
+    void connectionLost();
+    void closeConnection();
+
+    QString m_userName;
+    QString m_roomId;
+    QString m_serverAddress;
+    QString m_downloadDirectory;
+    int m_stripeCount;  // connections used for large transfers, 1 keeps them on the main connection
+
+    QTcpSocket* m_clientSocket;
+    QTimer* m_connectTimer;
+    bool m_clientSocketDisconnected;  // also set before the connection is established
+    int m_protocolVersion;
+    compression::Codec m_codec;  // picked by the server from the codecs offered in "/protocol"
+    QByteArray m_lineBuffer;
+    QList<ChatMessage> m_pendingMessages;  // parsed during one readyRead(), emitted together
+
+    QStringList m_userList;
+    QStringList m_fileList;
+    quint64 m_roomSequence;  // number of the last room event applied to the lists
+    bool m_hasRoomState;     // events are ignored until RoomState has arrived
+
+    // Transfers
+    QFile* m_uploadFile;
+    bool m_uploadIsText;
+    compression::Codec m_uploadCodec;
+    bool m_uploadStarted;        // chunks are sent only after the server reports where to continue
+    quint64 m_uploadTransferId;  // 0 unless the upload can be resumed
+    QByteArray m_uploadHash;     // SHA-256 sent to version 7 servers, which skip content they already store
+    QString m_uploadFileName;
+    QString m_uploadRoomId;
+    StripedTransfer* m_uploadStripes;
+    QByteArray m_deferredWrites;
+    QFile* m_downloadFile;
+    QString m_downloadKey;  // "room/filename" as known by the server
+    QString m_downloadPath;
+    qint64 m_downloadSize;
+    bool m_downloadIsProbe;  // only the size and ID are sent, ranges follow over data connections
+    quint64 m_downloadTransferId;
+    QSet<QString> m_stripeProbes;
+    QHash<QString, PartialDownload> m_partialDownloads;
+    QElapsedTimer m_progressClock;
+
+   private slots:
+    void readyRead();
+    void connected();
+    void connectTimedOut();
+    void socketError();
+    void socketDisconnected();
+    void sendFileChunks();
+
+   signals:
+    void connectionOpened();
+    void connectionFailed(const QString& error);
+    void joined();
+    void identityChanged(const QString& userName, const QString& roomId);  // assigned by the server
+    void messagesReceived(const QList<ChatMessage>& messages);
+    void usersChanged(const QStringList& users);  // whole list, on join and after a gap in room events
+    void filesChanged(const QStringList& files);
+    void userJoined(const QString& userName);
+    void userLeft(const QString& userName);
+    void fileAdded(const QString& fileName);
+    void fileRemoved(const QString& fileName);
+    void uploadRejected(const QString& error);
+    void uploadProgress(const QString& fileName, qint64 sent, qint64 size);
+    void uploadFinished(const QString& fileName, bool success);
+    void downloadProgress(const QString& fileName, qint64 received, qint64 size);
+    void downloadFinished(const QString& fileName, const QString& path, bool success);
+    void disconnected();
+};
+
+#endif  // ROOMCLIENT_HPP
@@ -2,14 +2,20 @@
 
 #include <QApplication>
 #include <QFileDialog>
+#include <QFileInfo>
 #include <QMessageBox>
-#include <QRegExp>
 #include <QScreen>
-#include <QThread>
+#include <QScrollBar>
 
-#include "../logger.hpp"
+#include "chatdelegate.hpp"
 
-#define DEFAULT_PORT 8044
+// Messages kept in the chat view, WSTED_CHAT_HISTORY overrides the default
+static int chatHistorySize() {
+    bool isValid;
+    int size = qEnvironmentVariableIntValue("WSTED_CHAT_HISTORY", &isValid);
+
+    return isValid && size > 0 ? size : DEFAULT_CHAT_HISTORY;
+}
 
 static QSize getDefaultWindowSize() {
     const QSize screenSize = QApplication::primaryScreen()->size();
@@ -22,9 +28,10 @@ static QSize getDefaultWindowSize() {
     return s;
 }
 
-RoomWindow::RoomWindow(QWidget* parent) : QWidget(parent), m_clientSocketDisconnected(false) {
+RoomWindow::RoomWindow(QWidget* parent) : QWidget(parent) {
     // Messages
-    m_textMessages = new QTextEdit(this);
+    m_chatModel = new ChatModel(chatHistorySize(), this);
+    m_listMessages = new QListView(this);
     m_lineMessage = new QLineEdit(this);
     m_pushButtonSendMessage = new QPushButton(this);
 
@@ -45,10 +52,34 @@ RoomWindow::RoomWindow(QWidget* parent) : QWidget(parent), m_clientSocketDisconn
     ui_setupGeometry();
     ui_loadContents();
 
-    m_clientSocket = new QTcpSocket();
-    connect(m_clientSocket, SIGNAL(readyRead()), this, SLOT(readyRead()));
-    connect(m_clientSocket, SIGNAL(connected()), this, SLOT(connected()));
-    connect(m_clientSocket, SIGNAL(disconnected()), this, SLOT(pushButtonDisconnect_clicked()));
+    // Socket reads, parsing, base64 and file writes stay off the GUI thread
+    m_clientThread = new QThread(this);
+    m_client = new RoomClient();
+    m_client->moveToThread(m_clientThread);
+    connect(m_clientThread, SIGNAL(finished()), m_client, SLOT(deleteLater()));
+
+    connect(m_client, SIGNAL(connectionOpened()), this, SIGNAL(connectionOpened()));
+    connect(m_client, SIGNAL(connectionFailed(QString)), this, SIGNAL(connectionFailed(QString)));
+    connect(m_client, SIGNAL(identityChanged(QString, QString)), this, SLOT(setIdentity(QString, QString)));
+    connect(m_client, SIGNAL(messagesReceived(QList<ChatMessage>)), this,
+            SLOT(appendMessages(QList<ChatMessage>)));
+    connect(m_client, SIGNAL(usersChanged(QStringList)), this, SLOT(showUsers(QStringList)));
+    connect(m_client, SIGNAL(filesChanged(QStringList)), this, SLOT(showFiles(QStringList)));
+    connect(m_client, SIGNAL(userJoined(QString)), this, SLOT(addUser(QString)));
+    connect(m_client, SIGNAL(userLeft(QString)), this, SLOT(removeUser(QString)));
+    connect(m_client, SIGNAL(fileAdded(QString)), this, SLOT(addFile(QString)));
+    connect(m_client, SIGNAL(fileRemoved(QString)), this, SLOT(removeFile(QString)));
+    connect(m_client, SIGNAL(uploadRejected(QString)), this, SLOT(uploadRejected(QString)));
+    connect(m_client, SIGNAL(uploadProgress(QString, qint64, qint64)), this,
+            SLOT(uploadProgress(QString, qint64, qint64)));
+    connect(m_client, SIGNAL(uploadFinished(QString, bool)), this, SLOT(uploadFinished(QString, bool)));
+    connect(m_client, SIGNAL(downloadProgress(QString, qint64, qint64)), this,
+            SLOT(downloadProgress(QString, qint64, qint64)));
+    connect(m_client, SIGNAL(downloadFinished(QString, QString, bool)), this,
+            SLOT(downloadFinished(QString, QString, bool)));
+    connect(m_client, SIGNAL(disconnected()), this, SLOT(clientDisconnected()));
+
+    m_clientThread->start();
 }
 
 void RoomWindow::ui_setupGeometry() {
@@ -57,25 +88,25 @@ void RoomWindow::ui_setupGeometry() {
     qDebug() << "Window" << size();
 
     // Messages
-    m_textMessages->setGeometry(QRect(0, 0, size().width() * 0.75, size().height() * 0.93));
+    m_listMessages->setGeometry(QRect(0, 0, size().width() * 0.75, size().height() * 0.93));
     m_lineMessage->setGeometry(
-        QRect(0, m_textMessages->height(), size().width() * 2 / 3, size().height() * 0.07));
-    m_pushButtonSendMessage->setGeometry(QRect(m_lineMessage->width(), m_textMessages->height(),
+        QRect(0, m_listMessages->height(), size().width() * 2 / 3, size().height() * 0.07));
+    m_pushButtonSendMessage->setGeometry(QRect(m_lineMessage->width(), m_listMessages->height(),
                                                size().width() * 0.25 / 3, size().height() * 0.07));
 
     // Users
     m_listUsers->setGeometry(
-        QRect(m_textMessages->width(), 0, size().width() * 0.25, m_textMessages->height() * 0.50));
+        QRect(m_listMessages->width(), 0, size().width() * 0.25, m_listMessages->height() * 0.50));
 
     // Disconnect
-    m_pushButtonDisconnect->setGeometry(QRect(m_textMessages->width(), m_pushButtonSendMessage->y(),
+    m_pushButtonDisconnect->setGeometry(QRect(m_listMessages->width(), m_pushButtonSendMessage->y(),
                                               size().width() * 0.25, size().height() * 0.07));
 
     // Files
     m_pushButtonSendFile->setGeometry(QRect(
         m_pushButtonDisconnect->x(), m_pushButtonDisconnect->y() - m_pushButtonDisconnect->height() - 1,
         m_pushButtonDisconnect->width(), m_pushButtonDisconnect->height()));
-    m_listFiles->setGeometry(QRect(m_textMessages->width(), m_listUsers->height(), m_listUsers->width(),
+    m_listFiles->setGeometry(QRect(m_listMessages->width(), m_listUsers->height(), m_listUsers->width(),
                                    m_listUsers->height() - m_pushButtonSendFile->height() - 2));
 }
 
@@ -85,10 +116,13 @@ void RoomWindow::ui_loadContents() {
     setWindowIcon(QIcon(":/icons/app"));
 
     // Messages
-    m_textMessages->setStyleSheet(
+    m_listMessages->setStyleSheet(
         "color:white;border:0px;border-left:1px solid white;border-radius:1px");
-    m_textMessages->setReadOnly(true);
-    m_textMessages->setText("");
+    m_listMessages->setModel(m_chatModel);
+    m_listMessages->setItemDelegate(new ChatDelegate(m_listMessages));
+    m_listMessages->setUniformItemSizes(true);
+    m_listMessages->setSelectionMode(QAbstractItemView::NoSelection);
+    m_listMessages->setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
 
     m_lineMessage->setStyleSheet(
         "color:white;border:1px solid white;border-radius:1px;border-right:0px");
@@ -128,104 +162,126 @@ void RoomWindow::ui_loadContents() {
     connect(m_pushButtonDisconnect, SIGNAL(clicked()), SLOT(pushButtonDisconnect_clicked()));
 }
 
-void RoomWindow::receiveTextMessage(const QString& msg) {
-    QString userName;
-    QString message;
-    QString timeString;
-
-    auto firstSpaceIdx = msg.indexOf(' ');
-    timeString = msg.mid(0, firstSpaceIdx);
+void RoomWindow::appendMessages(const QList<ChatMessage>& messages) {
+    QScrollBar* scrollBar = m_listMessages->verticalScrollBar();
+    bool isAtBottom = scrollBar->value() == scrollBar->maximum();
 
-    auto delimiterColonIdx = firstSpaceIdx + msg.mid(firstSpaceIdx).indexOf(':');
-    userName = msg.mid(firstSpaceIdx + 1, delimiterColonIdx - firstSpaceIdx - 1);
-    message = msg.mid(delimiterColonIdx + 1);
+    m_chatModel->append(messages);
 
-    m_textMessages->append("<i>" + timeString + "</i> <b>" + userName + "</b>: " + message);
+    // Reading older messages is not interrupted by new ones
+    if (isAtBottom) {
+        m_listMessages->scrollToBottom();
+    }
 }
 
-void RoomWindow::setUserList(const QString& separatedString) {
-    QStringList userList = separatedString.split(',');
+void RoomWindow::appendNotice(const QString& text) {
+    appendMessages({ChatMessage{QString(), QString(), text}});
+}
 
+void RoomWindow::showUsers(const QStringList& users) {
     m_listUsers->clear();
-    for (const auto& user : userList) {
+    for (const auto& user : users) {
         m_listUsers->addItem(user);
     }
 }
 
-void RoomWindow::setFileList(const QString& separatedString) {
-    QStringList fileList = separatedString.split('/');
-
+void RoomWindow::showFiles(const QStringList& files) {
     m_listFiles->clear();
-    for (const auto& fileName : fileList) {
+    for (const auto& fileName : files) {
         m_listFiles->addItem(fileName);
     }
 }
 
-void RoomWindow::receiveFile(QString& fileName, const QString& base64_data, const QString& outputDir) {
-    QDir dir;
-    if (!dir.mkpath(outputDir)) {
-        qDebug() << "Failed to create path" << outputDir;
-        return;
+// Room events change one row, the rest of the list and its selection stay as they are
+void RoomWindow::removeItem(QListWidget* list, const QString& text) {
+    QList<QListWidgetItem*> items = list->findItems(text, Qt::MatchExactly);
+
+    if (!items.isEmpty()) {
+        delete list->takeItem(list->row(items.first()));
     }
+}
 
-    QFile file(outputDir + '/' + fileName);
+void RoomWindow::addUser(const QString& userName) {
+    m_listUsers->addItem(userName);
+}
 
-    while (file.exists()) {
-        qDebug() << "Duplicate filename" << fileName;
+void RoomWindow::removeUser(const QString& userName) {
+    removeItem(m_listUsers, userName);
+}
 
-        auto idx = fileName.lastIndexOf('.');
-        if (idx != -1) {
-            fileName = fileName.mid(0, idx) + "-1" + fileName.mid(idx);
-        } else {
-            fileName = fileName + "-1";
-        }
+void RoomWindow::addFile(const QString& fileName) {
+    m_listFiles->addItem(fileName);
+}
 
-        file.setFileName(outputDir + '/' + fileName);
+void RoomWindow::removeFile(const QString& fileName) {
+    removeItem(m_listFiles, fileName);
+}
 
-        qDebug() << "Changing to" << fileName;
-    }
+void RoomWindow::setIdentity(const QString& userName, const QString& roomId) {
+    m_userName = userName;
+    m_roomId = roomId;
+    updateWindowTitle();
+}
 
-    if (!file.open(QIODevice::Append, QFileDevice::ReadOwner | QFileDevice::WriteOwner)) {
-        qDebug() << file.fileName() << file.errorString();
-        return;
-    }
+void RoomWindow::showProgress(const QString& verb, const QString& fileName, qint64 done, qint64 size) {
+    qint64 percent = size > 0 ? done * 100 / size : 0;
 
-    file.write(QByteArray::fromBase64(base64_data.toUtf8()));
-    file.close();
+    m_transferStatus = verb + " '" + fileName + "' " + QString::number(percent) + '%';
+    updateWindowTitle();
 }
 
-void RoomWindow::actionDownload_triggered() {
-    QString fileName;
-    QString message;
+void RoomWindow::uploadRejected(const QString& error) {
+    QMessageBox::warning(this, "Upload file", error, QMessageBox::Close, QMessageBox::Close);
+}
+
+void RoomWindow::uploadProgress(const QString& fileName, qint64 sent, qint64 size) {
+    showProgress("Uploading", fileName, sent, size);
+}
 
-    fileName = m_listFiles->currentItem()->text();
+void RoomWindow::downloadProgress(const QString& fileName, qint64 received, qint64 size) {
+    showProgress("Downloading", fileName, received, size);
+}
 
-    if (!fileName.isEmpty()) {
-        message = "/getfile '" + fileName + "' " + m_roomId + ":." + '\n';
+void RoomWindow::uploadFinished(const QString& fileName, bool success) {
+    m_transferStatus.clear();
+    updateWindowTitle();
 
-        m_clientSocket->write(message.toUtf8());
-        messageLogger("Sent", m_clientSocket, message);
+    // Uploaded files show up in the file list
+    if (!success) {
+        appendNotice("Upload of file '" + fileName + "' failed");
     }
 }
 
-void RoomWindow::pushButtonSendMessage_clicked() {
-    QString message = m_lineMessage->text().trimmed();
+void RoomWindow::downloadFinished(const QString& fileName, const QString& path, bool success) {
+    m_transferStatus.clear();
+    updateWindowTitle();
 
-    if (!message.isEmpty()) {
-        message = "/msg " + m_roomId + ":" + message + '\n';
+    if (success) {
+        appendNotice("Downloaded file '" + fileName + "' to " + QFileInfo(path).path());
+    } else {
+        appendNotice("Download of file '" + fileName + "' failed");
+    }
+}
 
-        m_clientSocket->write(message.toUtf8());
-        messageLogger("Sent", m_clientSocket, message);
+void RoomWindow::actionDownload_triggered() {
+    if (!m_listFiles->currentItem()) {
+        return;
     }
 
+    QMetaObject::invokeMethod(m_client, "downloadFile", Qt::QueuedConnection,
+                              Q_ARG(QString, m_listFiles->currentItem()->text()));
+}
+
+void RoomWindow::pushButtonSendMessage_clicked() {
+    QMetaObject::invokeMethod(m_client, "sendMessage", Qt::QueuedConnection,
+                              Q_ARG(QString, m_lineMessage->text().trimmed()));
+
     m_lineMessage->clear();
     m_lineMessage->setFocus();
 }
 
 void RoomWindow::pushButtonSendFile_clicked() {
     QString filePath;
-    QString fileName;
-    QString messageToWrite;
 
     filePath = QFileDialog::getOpenFileName(this);
     if (filePath.isEmpty()) {
@@ -233,44 +289,17 @@ void RoomWindow::pushButtonSendFile_clicked() {
         return;
     }
 
-    QFile file(filePath);
-    if (!file.open(QIODevice::ReadOnly)) {
-        qDebug() << file.fileName() << file.errorString();
-        return;
-    }
-
-    if (file.size() > (1 << 20) * 512) {
-        messageToWrite =
-            "The size of the selected file is larger than allowed (512 MiB), the process is aborted.";
-        qDebug() << messageToWrite;
-
-        QMessageBox::warning(this, "Upload file", messageToWrite, QMessageBox::Close,
-                             QMessageBox::Close);
-
-        file.close();
-        return;
-    }
-
-    fileName = "'" + filePath.mid(filePath.lastIndexOf('/') + 1).replace('\'', '_') + "'";
-    messageToWrite = "/sendfile " + fileName + ' ' + m_roomId + ':' + file.readAll().toBase64() + '\n';
-
-    m_clientSocket->write(messageToWrite.toUtf8());
-    messageLogger("Sent FILE", m_clientSocket,
-                  messageToWrite.mid(0, messageToWrite.indexOf(':') + 1) + "_BASE64_DATA_");
+    // uploadRejected() follows if another upload is running or the file can't be sent
+    QMetaObject::invokeMethod(m_client, "uploadFile", Qt::QueuedConnection, Q_ARG(QString, filePath));
 }
 
 void RoomWindow::pushButtonDisconnect_clicked() {
-    if (m_clientSocketDisconnected) return;
-
-    m_clientSocketDisconnected = true;
-    m_clientSocket->disconnectFromHost();
-
-    if (m_clientSocket->state() == QAbstractSocket::UnconnectedState ||
-        m_clientSocket->waitForDisconnected(10000)) {
-        qDebug() << "Disconnected!";
-    }
+    QMetaObject::invokeMethod(m_client, "disconnectFromServer", Qt::QueuedConnection);
+}
 
-    m_textMessages->clear();
+void RoomWindow::clientDisconnected() {
+    m_transferStatus.clear();
+    m_chatModel->clear();
     m_lineMessage->clear();
     m_listUsers->clear();
     m_listFiles->clear();
@@ -279,88 +308,6 @@ void RoomWindow::pushButtonDisconnect_clicked() {
     close();
 }
 
-void RoomWindow::readyRead() {
-    QString line;
-
-    QRegExp messageRegex("^/([a-z]+) ([a-zA-Z0-9]+):(.*)$");  // /command room:data
-    QString command;
-
-    QRegExp fileRegex("^/([a-z]+) '(.*)' ([a-zA-Z0-9]+):(.*)$");  // /command filename room:data
-    QString filename;
-
-    QString roomId;
-    QString data;
-
-    while (m_clientSocket->canReadLine()) {
-        line = QString::fromUtf8(m_clientSocket->readLine().trimmed());
-
-        if (messageRegex.indexIn(line) != -1) {
-            // Message from server
-
-            command = messageRegex.cap(1);
-            roomId = messageRegex.cap(2);
-            data = messageRegex.cap(3);
-
-            if (command == "roomid") {
-                // Room ID for client from server
-                setRoomId(roomId);
-
-                messageLogger("Received ROOM_ID", m_clientSocket, line);
-            } else if (command == "userid") {
-                // Username for client from server
-                setUserName(data);
-
-                messageLogger("Received USER_ID", m_clientSocket, line);
-            } else if (command == "users" && roomId == m_roomId) {
-                // User list from server
-                setUserList(data);
-
-                messageLogger("Received USER_LIST", m_clientSocket, line);
-            } else if (command == "files" && roomId == m_roomId) {
-                // File list from server
-                setFileList(data);
-
-                messageLogger("Received FILE_LIST", m_clientSocket, line);
-            }
-        } else if (fileRegex.indexIn(line) != -1) {
-            // File from server
-
-            command = fileRegex.cap(1);
-            filename = fileRegex.cap(2);
-            roomId = fileRegex.cap(3);
-            data = fileRegex.cap(4);
-
-            if (command == "sendfile" && !filename.isEmpty() && !data.isEmpty()) {
-                // File contents from server
-
-                QString downloadRoomPath = QString(getenv("HOME")) + "/Downloads/" + roomId;
-                receiveFile(filename, data, downloadRoomPath);
-
-                m_textMessages->append("Downloaded file <b>'" + filename + "'</b> to <b>" +
-                                       downloadRoomPath + "</b>");
-
-                messageLogger("Received FILE", m_clientSocket, filename);
-            }
-        } else if (line.contains(':')) {
-            // Text message from server
-            receiveTextMessage(line);
-
-            messageLogger("Received TEXT", m_clientSocket, line);
-        } else {
-            messageLogger("Received BAD", m_clientSocket, line);
-        }
-    }
-}
-
-void RoomWindow::connected() {
-    QString message = "/join " + m_roomId + ':' + m_userName + '\n';
-
-    QThread::msleep(10);
-
-    m_clientSocket->write(message.toUtf8());
-    messageLogger("Sent", m_clientSocket, message);
-}
-
 void RoomWindow::resizeEvent(QResizeEvent* ev) {
     QWidget::resizeEvent(ev);
     ui_setupGeometry();
@@ -371,36 +318,9 @@ void RoomWindow::show() {
     emit opened();
 }
 
-bool RoomWindow::connectToServer() {
-    QString address;
-    quint16 port;
-    bool success;
-
-    auto idx = m_serverAddress.lastIndexOf(':');
-
-    if (idx != -1) {
-        address = m_serverAddress.mid(0, idx);
-        port = m_serverAddress.mid(idx + 1).toUInt();
-    } else {
-        address = m_serverAddress;
-        port = DEFAULT_PORT;
-    }
-
-    qDebug() << "Connect to" << m_serverAddress;
-    m_clientSocket->connectToHost(address, port);
-
-    if (m_clientSocket->state() == QAbstractSocket::ConnectedState ||
-        m_clientSocket->waitForConnected(10000)) {
-        success = true;
-        m_clientSocketDisconnected = false;
-
-        qDebug() << "Connected!";
-    } else {
-        success = false;
-        qDebug() << m_clientSocket->errorString();
-    }
-
-    return success;
+void RoomWindow::connectToServer() {
+    // connectionOpened() or connectionFailed() follows
+    QMetaObject::invokeMethod(m_client, "connectToServer", Qt::QueuedConnection);
 }
 
 QString RoomWindow::getUserName() { return m_userName; }
@@ -410,32 +330,40 @@ QString RoomWindow::getRoomId() { return m_roomId; }
 QString RoomWindow::getServerAddress() { return m_serverAddress; }
 
 void RoomWindow::setServerAddress(const QString& str) {
-    m_serverAddress = std::move(str);
+    m_serverAddress = str;
+    QMetaObject::invokeMethod(m_client, "setServerAddress", Qt::QueuedConnection, Q_ARG(QString, str));
     updateWindowTitle();
 }
 
+void RoomWindow::setStripeCount(int count) {
+    QMetaObject::invokeMethod(m_client, "setStripeCount", Qt::QueuedConnection, Q_ARG(int, count));
+}
+
 void RoomWindow::setUserName(const QString& str) {
-    m_userName = std::move(str);
+    m_userName = str;
+    QMetaObject::invokeMethod(m_client, "setUserName", Qt::QueuedConnection, Q_ARG(QString, str));
     updateWindowTitle();
 }
 
 void RoomWindow::setRoomId(const QString& str) {
-    if (str.isEmpty()) {
-        m_roomId = "new";
-    } else {
-        m_roomId = std::move(str);
-    }
-
+    m_roomId = str.isEmpty() ? "new" : str;
+    QMetaObject::invokeMethod(m_client, "setRoomId", Qt::QueuedConnection, Q_ARG(QString, str));
     updateWindowTitle();
 }
 
 void RoomWindow::updateWindowTitle() {
-    setWindowTitle(m_userName + '@' + m_roomId + " | " + m_serverAddress);
+    QString title = m_userName + '@' + m_roomId + " | " + m_serverAddress;
+
+    if (!m_transferStatus.isEmpty()) {
+        title += " | " + m_transferStatus;
+    }
+
+    setWindowTitle(title);
 }
 
 RoomWindow::~RoomWindow() {
     // Messages
-    m_textMessages->deleteLater();
+    m_listMessages->deleteLater();
     m_lineMessage->deleteLater();
     m_pushButtonSendMessage->deleteLater();
 
@@ -450,5 +378,7 @@ RoomWindow::~RoomWindow() {
     // Disconnect
     m_pushButtonDisconnect->deleteLater();
 
-    m_clientSocket->deleteLater();
+    // Client is deleted by its thread once the event loop has stopped
+    m_clientThread->quit();
+    m_clientThread->wait();
 }
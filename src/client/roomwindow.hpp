@@ -2,13 +2,16 @@
 #define ROOMWINDOW_HPP
 
 #include <QLineEdit>
+#include <QListView>
 #include <QListWidget>
 #include <QMenuBar>
 #include <QPushButton>
-#include <QTcpSocket>
-#include <QTextEdit>
+#include <QThread>
 #include <QWidget>
 
+#include "chatmodel.hpp"
+#include "roomclient.hpp"
+
 class RoomWindow : public QWidget {
     Q_OBJECT
    public:
@@ -18,7 +21,7 @@ class RoomWindow : public QWidget {
     void resizeEvent(QResizeEvent* ev) override;
     void show();
 
-    bool connectToServer();
+    void connectToServer();
 
     QString getUserName();
     QString getRoomId();
@@ -27,31 +30,29 @@ class RoomWindow : public QWidget {
     void setUserName(const QString& str);
     void setRoomId(const QString& str);
     void setServerAddress(const QString& str);
-    void updateWindowTitle();
+    void setStripeCount(int count);
 
    private:
     void ui_setupGeometry();
     void ui_loadContents();
 
-    // Messages
-    void receiveTextMessage(const QString& msg);
-
-    // Users
-    void setUserList(const QString& separatedString);
+    void appendNotice(const QString& text);
+    static void removeItem(QListWidget* list, const QString& text);
+    void showProgress(const QString& verb, const QString& fileName, qint64 done, qint64 size);
 
-    // Files
-    void setFileList(const QString& separatedString);
-    void receiveFile(QString& fileName, const QString& base64_data, const QString& outputDir);
+    // Client runs on its own thread and is only reached through queued calls and signals
+    RoomClient* m_client;
+    QThread* m_clientThread;
 
+    // Copies of the client state shown by the window
     QString m_userName;
     QString m_roomId;
     QString m_serverAddress;
-
-    QTcpSocket* m_clientSocket;
-    bool m_clientSocketDisconnected;
+    QString m_transferStatus;
 
     // Messages
-    QTextEdit* m_textMessages;
+    ChatModel* m_chatModel;
+    QListView* m_listMessages;
     QLineEdit* m_lineMessage;
     QPushButton* m_pushButtonSendMessage;
 
@@ -71,11 +72,26 @@ class RoomWindow : public QWidget {
     void pushButtonSendMessage_clicked();
     void pushButtonSendFile_clicked();
     void pushButtonDisconnect_clicked();
+    void updateWindowTitle();
 
-    void readyRead();
-    void connected();
+    void setIdentity(const QString& userName, const QString& roomId);
+    void appendMessages(const QList<ChatMessage>& messages);
+    void showUsers(const QStringList& users);
+    void showFiles(const QStringList& files);
+    void addUser(const QString& userName);
+    void removeUser(const QString& userName);
+    void addFile(const QString& fileName);
+    void removeFile(const QString& fileName);
+    void uploadRejected(const QString& error);
+    void uploadProgress(const QString& fileName, qint64 sent, qint64 size);
+    void uploadFinished(const QString& fileName, bool success);
+    void downloadProgress(const QString& fileName, qint64 received, qint64 size);
+    void downloadFinished(const QString& fileName, const QString& path, bool success);
+    void clientDisconnected();
 
    signals:
+    void connectionOpened();
+    void connectionFailed(const QString& error);
     void opened();
     void closed();
 };
@@ -0,0 +1,256 @@
+#include "stripedtransfer.hpp"
+
+#include "../logger.hpp"
+
+StripedTransfer::StripedTransfer(Direction direction, const QString& filePath, quint64 transferId,
+                                 qint64 size, QObject* parent)
+    : QObject(parent),
+      m_direction(direction),
+      m_filePath(filePath),
+      m_transferId(transferId),
+      m_size(size),
+      m_transferred(0),
+      m_isFinished(false) {}
+
+void StripedTransfer::start(const QString& address, quint16 port, const QString& roomId,
+                            const QString& userName, const QString& fileName, int stripeCount) {
+    qint64 stripeSize;
+    QIODevice::OpenMode mode;
+
+    m_fileName = fileName;
+    m_roomId = roomId.toUtf8();
+    m_attachLines = "/protocol " + QByteArray::number(protocol::STRIPED_VERSION) + ":\n/attach " +
+                    m_roomId + ':' + userName.toUtf8() + '\n';
+
+    // Ranges are whole chunks, so every data connection sends full frames except the last one
+    stripeCount = qBound(1, stripeCount, MAX_STRIPE_COUNT);
+    stripeSize = (m_size + stripeCount - 1) / stripeCount;
+    stripeSize = (stripeSize + protocol::FILE_CHUNK_SIZE - 1) / protocol::FILE_CHUNK_SIZE *
+                 protocol::FILE_CHUNK_SIZE;
+
+    // Downloads write into a file already allocated to its full size
+    mode = m_direction == Direction::Upload ? QIODevice::ReadOnly : QIODevice::ReadWrite;
+
+    for (qint64 offset = 0; offset < m_size; offset += stripeSize) {
+        Stripe* stripe = new Stripe;
+
+        stripe->socket = new QTcpSocket(this);
+        stripe->file.setFileName(m_filePath);
+        stripe->position = offset;
+        stripe->end = qMin(offset + stripeSize, m_size);
+        stripe->done = false;
+        m_stripes.append(stripe);
+
+        if (!stripe->file.open(mode) || !stripe->file.seek(offset)) {
+            fail(stripe->file.fileName() + ": " + stripe->file.errorString());
+            return;
+        }
+
+        connect(stripe->socket, SIGNAL(connected()), this, SLOT(connected()));
+        connect(stripe->socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+        connect(stripe->socket, SIGNAL(bytesWritten(qint64)), this, SLOT(bytesWritten(qint64)));
+        connect(stripe->socket, SIGNAL(disconnected()), this, SLOT(connectionLost()));
+        connect(stripe->socket, SIGNAL(errorOccurred(QAbstractSocket::SocketError)), this,
+                SLOT(connectionLost()));
+
+        stripe->socket->connectToHost(address, port);
+    }
+
+    qDebug() << "Striped transfer of" << m_fileName << "over" << m_stripes.size() << "connections";
+}
+
+Stripe* StripedTransfer::stripeOf(QObject* socket) const {
+    for (auto stripe : m_stripes) {
+        if (stripe->socket == socket) {
+            return stripe;
+        }
+    }
+
+    return nullptr;
+}
+
+void StripedTransfer::connected() {
+    Stripe* stripe = stripeOf(sender());
+    protocol::FrameType type;
+    QByteArray payload;
+
+    if (!stripe || m_isFinished) {
+        return;
+    }
+
+    // Server reads the frame only after it has attached the connection to the room
+    type = m_direction == Direction::Upload ? protocol::FrameType::PutFileSlice
+                                            : protocol::FrameType::GetFileSlice;
+    payload = protocol::encodeSlice(m_transferId, stripe->position, stripe->end - stripe->position,
+                                    m_direction == Direction::Upload ? QString() : m_fileName);
+
+    stripe->socket->write(m_attachLines);
+    stripe->socket->write(protocol::encodeFrame(type, m_roomId, payload));
+    messageLogger("Sent", stripe->socket, protocol::describeFrame(protocol::Frame{type, m_roomId, payload}));
+
+    if (m_direction == Direction::Upload) {
+        sendChunks(stripe);
+    }
+}
+
+void StripedTransfer::readyRead() {
+    Stripe* stripe = stripeOf(sender());
+    QTcpSocket* socket;
+    char firstByte;
+
+    if (!stripe) {
+        return;
+    }
+
+    socket = stripe->socket;
+
+    while (!m_isFinished && socket->peek(&firstByte, 1) == 1) {
+        if (protocol::isFrameStart(firstByte)) {
+            protocol::Frame frame;
+            auto result = protocol::readFrame(socket, frame);
+
+            if (result == protocol::ReadResult::Incomplete) {
+                break;
+            } else if (result == protocol::ReadResult::Error) {
+                fail("Malformed frame");
+                return;
+            }
+
+            processFrame(stripe, frame);
+        } else if (socket->canReadLine()) {
+            // Only the answer to "/protocol" comes as a text line
+            protocol::TextCommand command;
+            QByteArrayView line = protocol::readLine(socket, m_lineBuffer);
+
+            if (protocol::parseTextLine(line, command) && command.command == protocol::Command::Protocol &&
+                command.room.toInt() < protocol::STRIPED_VERSION) {
+                fail("Server does not support data connections");
+                return;
+            }
+        } else {
+            break;
+        }
+    }
+}
+
+void StripedTransfer::processFrame(Stripe* stripe, const protocol::Frame& frame) {
+    QString fileName;
+    quint64 transferId;
+    qint64 position;
+
+    switch (frame.type) {
+        case protocol::FrameType::FileBegin:
+            break;
+        case protocol::FrameType::FileOffset:
+            if (!protocol::decodeTransfer(frame.payload, transferId, position, fileName) ||
+                transferId != m_transferId) {
+                fail("File has changed on the server");
+            } else if (m_direction == Direction::Download && position != stripe->position) {
+                fail("Unexpected offset " + QString::number(position));
+            } else if (m_direction == Direction::Upload && position == stripe->end) {
+                // Server has written the whole range
+                finishStripe(stripe);
+            }
+            break;
+        case protocol::FrameType::FileChunk:
+            if (m_direction != Direction::Download ||
+                stripe->position + frame.payload.size() > stripe->end ||
+                stripe->file.write(frame.payload) != frame.payload.size()) {
+                fail("Can't write chunk at " + QString::number(stripe->position));
+                return;
+            }
+
+            stripe->position += frame.payload.size();
+            m_transferred += frame.payload.size();
+
+            emit progress(m_transferred, m_size);
+            break;
+        case protocol::FrameType::FileEnd:
+            if (stripe->position != stripe->end) {
+                fail("Incomplete range");
+                return;
+            }
+
+            finishStripe(stripe);
+            break;
+        default:
+            messageLogger("Received BAD", stripe->socket, protocol::describeFrame(frame));
+            break;
+    }
+}
+
+void StripedTransfer::bytesWritten(qint64 bytes) {
+    Q_UNUSED(bytes);
+    Stripe* stripe = stripeOf(sender());
+
+    if (stripe && m_direction == Direction::Upload) {
+        sendChunks(stripe);
+    }
+}
+
+void StripedTransfer::sendChunks(Stripe* stripe) {
+    QByteArray chunk;
+
+    // File is read only as fast as the socket drains, like uploads on the main connection
+    while (!m_isFinished && stripe->position < stripe->end &&
+           stripe->socket->bytesToWrite() < protocol::FILE_HIGH_WATER_MARK) {
+        chunk = stripe->file.read(qMin(protocol::FILE_CHUNK_SIZE, stripe->end - stripe->position));
+
+        if (chunk.isEmpty()) {
+            fail(stripe->file.fileName() + ": " + stripe->file.errorString());
+            return;
+        }
+
+        stripe->socket->write(protocol::encodeFrame(protocol::FrameType::FileChunk, m_roomId, chunk));
+        stripe->position += chunk.size();
+        m_transferred += chunk.size();
+
+        emit progress(m_transferred, m_size);
+    }
+}
+
+void StripedTransfer::finishStripe(Stripe* stripe) {
+    stripe->done = true;
+    stripe->file.close();
+    stripe->socket->disconnectFromHost();
+
+    for (auto other : m_stripes) {
+        if (!other->done) {
+            return;
+        }
+    }
+
+    m_isFinished = true;
+    qDebug() << "Striped transfer of" << m_fileName << "finished";
+
+    emit finished(true);
+}
+
+void StripedTransfer::connectionLost() {
+    Stripe* stripe = stripeOf(sender());
+
+    if (stripe && !stripe->done) {
+        fail("Data connection lost: " + stripe->socket->errorString());
+    }
+}
+
+void StripedTransfer::fail(const QString& reason) {
+    if (m_isFinished) {
+        return;
+    }
+
+    m_isFinished = true;
+    qDebug() << "Striped transfer of" << m_fileName << "failed:" << reason;
+
+    for (auto stripe : m_stripes) {
+        stripe->socket->abort();
+        stripe->file.close();
+    }
+
+    emit finished(false);
+}
+
+StripedTransfer::~StripedTransfer() {
+    // Sockets are children and deleted with the transfer
+    qDeleteAll(m_stripes);
+}
@@ -0,0 +1,70 @@
+#ifndef STRIPEDTRANSFER_HPP
+#define STRIPEDTRANSFER_HPP
+
+#include <QFile>
+#include <QList>
+#include <QObject>
+#include <QTcpSocket>
+
+#include "../protocol.hpp"
+
+// Files smaller than this are not worth the additional connections
+constexpr qint64 STRIPE_MIN_SIZE = protocol::FILE_CHUNK_SIZE * 64;
+constexpr int MAX_STRIPE_COUNT = 16;
+
+// Byte range of the file moved over one data connection
+struct Stripe {
+    QTcpSocket* socket;
+    QFile file;
+    qint64 position;
+    qint64 end;
+    bool done;
+};
+
+// StripedTransfer moves one file over several data connections ("/attach room:user"), each carries a
+// byte range and reads or writes the file at its own offset
+class StripedTransfer : public QObject {
+    Q_OBJECT
+   public:
+    enum class Direction { Upload, Download };
+
+    StripedTransfer(Direction direction, const QString& filePath, quint64 transferId, qint64 size,
+                    QObject* parent = nullptr);
+    ~StripedTransfer();
+
+    void start(const QString& address, quint16 port, const QString& roomId, const QString& userName,
+               const QString& fileName, int stripeCount);
+
+   private:
+    void processFrame(Stripe* stripe, const protocol::Frame& frame);
+    void sendChunks(Stripe* stripe);
+    void finishStripe(Stripe* stripe);
+    void fail(const QString& reason);
+
+    Stripe* stripeOf(QObject* socket) const;
+
+    Direction m_direction;
+    QString m_filePath;
+    QString m_fileName;
+    QByteArray m_roomId;
+    QByteArray m_attachLines;
+    QByteArray m_lineBuffer;
+    quint64 m_transferId;
+    qint64 m_size;
+    qint64 m_transferred;  // bytes written or received over all data connections
+    bool m_isFinished;
+
+    QList<Stripe*> m_stripes;
+
+   private slots:
+    void connected();
+    void readyRead();
+    void bytesWritten(qint64 bytes);
+    void connectionLost();
+
+   signals:
+    void progress(qint64 transferred, qint64 size);
+    void finished(bool success);
+};
+
+#endif  // STRIPEDTRANSFER_HPP
@@ -0,0 +1,199 @@
+#include "compression.hpp"
+
+#include <QList>
+#include <QtEndian>
+#include <cmath>
+
+#ifdef WSTED_HAVE_ZSTD
+#include <zstd.h>
+#endif
+
+#include "protocol.hpp"
+
+namespace compression {
+
+// Fast levels, chunks are compressed while the socket drains
+#define ZLIB_LEVEL 1
+#define ZSTD_LEVEL 3
+
+// Bits per byte above which a sample is treated as already compressed
+#define MAX_COMPRESSIBLE_ENTROPY 7.2
+
+QByteArray supportedCodecs() {
+#ifdef WSTED_HAVE_ZSTD
+    return "zstd,zlib";
+#else
+    return "zlib";
+#endif
+}
+
+Codec codecFromName(QByteArrayView name) {
+    if (name == "zlib") {
+        return Codec::Zlib;
+    }
+
+#ifdef WSTED_HAVE_ZSTD
+    if (name == "zstd") {
+        return Codec::Zstd;
+    }
+#endif
+
+    return Codec::None;
+}
+
+QByteArray codecName(Codec codec) {
+    switch (codec) {
+        case Codec::Zlib:
+            return "zlib";
+        case Codec::Zstd:
+            return "zstd";
+        case Codec::None:
+            break;
+    }
+
+    return "none";
+}
+
+Codec chooseCodec(QByteArrayView offered) {
+    qsizetype start = 0;
+
+    // Client lists the codecs it prefers first
+    while (start < offered.size()) {
+        qsizetype end = offered.indexOf(',', start);
+
+        if (end == -1) {
+            end = offered.size();
+        }
+
+        Codec codec = codecFromName(offered.sliced(start, end - start).trimmed());
+        if (codec != Codec::None) {
+            return codec;
+        }
+
+        start = end + 1;
+    }
+
+    return Codec::None;
+}
+
+static bool hasKnownMagic(QByteArrayView sample) {
+    static const QList<QByteArrayView> magics = {
+        QByteArrayView("PK\x03\x04", 4),          // zip, jar, docx, apk
+        QByteArrayView("\x1f\x8b", 2),            // gzip
+        QByteArrayView("BZh", 3),                 // bzip2
+        QByteArrayView("\xfd" "7zXZ\x00", 6),     // xz
+        QByteArrayView("7z\xbc\xaf\x27\x1c", 6),  // 7z
+        QByteArrayView("Rar!", 4),                // rar
+        QByteArrayView("\x28\xb5\x2f\xfd", 4),    // zstd
+        QByteArrayView("\x89PNG", 4),             // png
+        QByteArrayView("\xff\xd8\xff", 3),        // jpeg
+        QByteArrayView("GIF8", 4),                // gif
+        QByteArrayView("OggS", 4),                // ogg, opus
+        QByteArrayView("fLaC", 4),                // flac
+        QByteArrayView("ID3", 3),                 // mp3
+        QByteArrayView("\x1a\x45\xdf\xa3", 4),    // mkv, webm
+    };
+
+    for (const auto& magic : magics) {
+        if (sample.startsWith(magic)) {
+            return true;
+        }
+    }
+
+    // mp4, mov, heic: box size followed by "ftyp"; webp: "RIFF" size "WEBP"
+    return (sample.size() >= 8 && sample.sliced(4, 4) == "ftyp") ||
+           (sample.size() >= 12 && sample.startsWith("RIFF") && sample.sliced(8, 4) == "WEBP");
+}
+
+bool isCompressible(QByteArrayView sample) {
+    qsizetype counts[256] = {};
+    double entropy = 0;
+
+    if (sample.isEmpty() || hasKnownMagic(sample)) {
+        return false;
+    }
+
+    sample = sample.first(qMin(sample.size(), SAMPLE_SIZE));
+
+    for (char c : sample) {
+        counts[static_cast<quint8>(c)]++;
+    }
+
+    for (qsizetype count : counts) {
+        if (count > 0) {
+            double p = double(count) / sample.size();
+            entropy -= p * std::log2(p);
+        }
+    }
+
+    return entropy <= MAX_COMPRESSIBLE_ENTROPY;
+}
+
+bool compressChunk(Codec codec, const QByteArray& chunk, QByteArray& payload) {
+    payload.clear();
+
+    if (codec == Codec::Zlib) {
+        // qCompress already starts with the raw size as 4 big-endian bytes
+        payload.append(static_cast<char>(codec));
+        payload.append(qCompress(chunk, ZLIB_LEVEL));
+        return payload.size() > 5;
+    }
+
+#ifdef WSTED_HAVE_ZSTD
+    if (codec == Codec::Zstd) {
+        payload.resize(5 + ZSTD_compressBound(chunk.size()));
+        payload[0] = static_cast<char>(codec);
+        qToBigEndian<quint32>(chunk.size(), payload.data() + 1);
+
+        size_t size = ZSTD_compress(payload.data() + 5, payload.size() - 5, chunk.constData(), chunk.size(),
+                                    ZSTD_LEVEL);
+
+        if (ZSTD_isError(size)) {
+            payload.clear();
+            return false;
+        }
+
+        payload.resize(5 + size);
+        return true;
+    }
+#endif
+
+    return false;
+}
+
+bool decompressChunk(const QByteArray& payload, QByteArray& chunk) {
+    Codec codec;
+    quint32 rawSize;
+
+    if (payload.size() < 5) {
+        return false;
+    }
+
+    codec = static_cast<Codec>(payload[0]);
+    rawSize = qFromBigEndian<quint32>(payload.constData() + 1);
+
+    // Chunk can't grow past what a plain FileChunk frame could carry
+    if (rawSize > protocol::MAX_FRAME_PAYLOAD) {
+        return false;
+    }
+
+    if (codec == Codec::Zlib) {
+        chunk = qUncompress(reinterpret_cast<const uchar*>(payload.constData() + 1), payload.size() - 1);
+        return chunk.size() == qsizetype(rawSize);
+    }
+
+#ifdef WSTED_HAVE_ZSTD
+    if (codec == Codec::Zstd) {
+        chunk.resize(rawSize);
+
+        size_t size =
+            ZSTD_decompress(chunk.data(), chunk.size(), payload.constData() + 5, payload.size() - 5);
+
+        return !ZSTD_isError(size) && size == rawSize;
+    }
+#endif
+
+    return false;
+}
+
+}  // namespace compression
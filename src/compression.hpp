@@ -0,0 +1,34 @@
+#ifndef COMPRESSION_HPP
+#define COMPRESSION_HPP
+
+#include <QByteArray>
+#include <QByteArrayView>
+
+namespace compression {
+
+// Codecs are offered by the client in "/protocol 5:zstd,zlib" and the server answers with the one it picked
+enum class Codec : quint8 { None = 0, Zlib = 1, Zstd = 2 };
+
+// Bytes of a file looked at before deciding if its chunks are compressed
+constexpr qsizetype SAMPLE_SIZE = 16 * 1024;
+
+// Compressed chunk is sent only if it saves at least 1/8 of the raw chunk
+constexpr qsizetype MIN_SAVING_SHIFT = 3;
+
+QByteArray supportedCodecs();
+Codec codecFromName(QByteArrayView name);
+QByteArray codecName(Codec codec);
+
+// First codec of a comma separated list that this build supports, or None
+Codec chooseCodec(QByteArrayView offered);
+
+// Magic numbers of archives and media, then the byte entropy of the sample
+bool isCompressible(QByteArrayView sample);
+
+// Payload: codec (1 byte), raw size (4 bytes, big-endian), compressed data
+bool compressChunk(Codec codec, const QByteArray& chunk, QByteArray& payload);
+bool decompressChunk(const QByteArray& payload, QByteArray& chunk);
+
+}  // namespace compression
+
+#endif  // COMPRESSION_HPP
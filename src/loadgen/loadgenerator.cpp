@@ -0,0 +1,238 @@
+#include "loadgenerator.hpp"
+
+#include <QCoreApplication>
+#include <QRandomGenerator>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+
+// Connections are started in small batches, spread over every second
+#define CONNECT_INTERVAL_MS 10
+
+static double toMilliseconds(qint64 nanoseconds) {
+    return nanoseconds / 1e6;
+}
+
+static double toMebibytes(quint64 bytes) {
+    return bytes / double(1 << 20);
+}
+
+LoadGroup::LoadGroup(const Scenario* scenario, const QByteArray& contents, LoadCounters* counters,
+                     QObject* parent)
+    : QObject(parent), m_scenario(scenario), m_contents(contents), m_counters(counters) {}
+
+void LoadGroup::addClient(int index, const QString& address, quint16 port) {
+    SimClient* client = new SimClient(index, m_scenario, m_contents, m_counters, &m_stats, this);
+
+    m_clients.append(client);
+    client->start(address, port);
+}
+
+void LoadGroup::stop() {
+    // Sockets and timers have to be deleted by the thread they belong to
+    for (auto client : m_clients) {
+        client->stop();
+    }
+
+    qDeleteAll(m_clients);
+    m_clients.clear();
+}
+
+const GroupStats& LoadGroup::stats() const {
+    return m_stats;
+}
+
+LoadGenerator::LoadGenerator(const Scenario& scenario, const QString& address, quint16 port, QObject* parent)
+    : QObject(parent),
+      m_scenario(scenario),
+      m_address(address),
+      m_port(port),
+      m_phase(Phase::Connecting),
+      m_phaseStart(0),
+      m_started(0),
+      m_lastSent(0),
+      m_lastDelivered(0) {
+    m_contents.resize(protocol::FILE_CHUNK_SIZE);
+
+    if (m_scenario.isCompressible) {
+        // Text with a small vocabulary, so compressing transfers pays off like it does for logs or sources
+        static const char* words[] = {"wsted ", "room ", "file ", "chunk ", "server ", "client ", "\n"};
+
+        m_contents.clear();
+
+        while (m_contents.size() < protocol::FILE_CHUNK_SIZE) {
+            m_contents += words[QRandomGenerator::global()->bounded(int(std::size(words)))];
+        }
+
+        m_contents.truncate(protocol::FILE_CHUNK_SIZE);
+    } else {
+        QRandomGenerator::global()->fillRange(reinterpret_cast<quint32*>(m_contents.data()),
+                                              m_contents.size() / sizeof(quint32));
+    }
+
+    for (int i = 0; i < m_scenario.threadCount; i++) {
+        QThread* thread = new QThread(this);
+        LoadGroup* group = new LoadGroup(&m_scenario, m_contents, &m_counters);
+
+        group->moveToThread(thread);
+
+        m_threads.append(thread);
+        m_groups.append(group);
+    }
+
+    m_connectTimer.setInterval(CONNECT_INTERVAL_MS);
+    m_progressTimer.setInterval(1000);
+
+    connect(&m_connectTimer, SIGNAL(timeout()), this, SLOT(connectClients()));
+    connect(&m_progressTimer, SIGNAL(timeout()), this, SLOT(tick()));
+}
+
+LoadGenerator::~LoadGenerator() {
+    for (auto thread : m_threads) {
+        thread->quit();
+        thread->wait();
+    }
+
+    qDeleteAll(m_groups);
+}
+
+void LoadGenerator::start() {
+    for (auto thread : m_threads) {
+        thread->start();
+    }
+
+    std::cerr << "Connecting " << m_scenario.clientCount << " clients to " << m_address.toStdString() << ':'
+              << m_port << " at " << m_scenario.connectRate << "/s" << std::endl;
+
+    m_clock.start();
+    m_connectTimer.start();
+    m_progressTimer.start();
+
+    connectClients();
+}
+
+void LoadGenerator::connectClients() {
+    qint64 due = qMin<qint64>(m_clock.elapsed() * m_scenario.connectRate / 1000 + 1, m_scenario.clientCount);
+
+    for (; m_started < due; m_started++) {
+        LoadGroup* group = m_groups[m_started % m_groups.size()];
+        int index = m_started;
+        QString address = m_address;
+        quint16 port = m_port;
+
+        QMetaObject::invokeMethod(
+            group, [group, index, address, port] { group->addClient(index, address, port); },
+            Qt::QueuedConnection);
+    }
+
+    if (m_started == m_scenario.clientCount) {
+        // Warmup starts once every connection has been started
+        m_connectTimer.stop();
+        m_phase = Phase::Warmup;
+        m_phaseStart = m_clock.elapsed();
+    }
+}
+
+void LoadGenerator::tick() {
+    quint64 sent = m_counters.messagesSent;
+    quint64 delivered = m_counters.messagesDelivered;
+    qint64 phaseTime = m_clock.elapsed() - m_phaseStart;
+    const char* phaseName = "connecting";
+
+    if (m_phase == Phase::Warmup) {
+        phaseName = "warmup";
+
+        if (phaseTime >= m_scenario.warmup * 1000LL) {
+            m_phase = Phase::Measuring;
+            m_phaseStart = m_clock.elapsed();
+            m_counters.isMeasuring = true;
+        }
+    } else if (m_phase == Phase::Measuring) {
+        phaseName = "measuring";
+
+        if (phaseTime >= m_scenario.duration * 1000LL) {
+            finish();
+            return;
+        }
+    }
+
+    std::cerr << '[' << std::setw(5) << m_clock.elapsed() / 1000 << " s] " << std::left << std::setw(11)
+              << phaseName << std::right << m_counters.joined << '/' << m_scenario.clientCount << " joined, "
+              << m_counters.failed << " failed, " << m_counters.disconnected << " disconnected, "
+              << sent - m_lastSent << " msg/s sent, " << delivered - m_lastDelivered << " msg/s delivered"
+              << std::endl;
+
+    m_lastSent = sent;
+    m_lastDelivered = delivered;
+}
+
+void LoadGenerator::finish() {
+    double seconds = (m_clock.elapsed() - m_phaseStart) / 1000.0;
+    GroupStats stats;
+
+    m_counters.isMeasuring = false;
+    m_progressTimer.stop();
+
+    for (auto group : m_groups) {
+        QMetaObject::invokeMethod(group, [group] { group->stop(); }, Qt::BlockingQueuedConnection);
+    }
+
+    for (auto thread : m_threads) {
+        thread->quit();
+        thread->wait();
+    }
+
+    for (auto group : m_groups) {
+        stats.join.merge(group->stats().join);
+        stats.message.merge(group->stats().message);
+        stats.upload.merge(group->stats().upload);
+        stats.download.merge(group->stats().download);
+    }
+
+    printReport(stats, seconds);
+
+    QCoreApplication::exit(m_counters.joined > 0 ? EXIT_SUCCESS : EXIT_FAILURE);
+}
+
+void LoadGenerator::printReport(const GroupStats& stats, double seconds) const {
+    struct Row {
+        const char* name;
+        const LatencyStats* latency;
+    };
+
+    const Row rows[] = {{"join", &stats.join},
+                        {"message", &stats.message},
+                        {"upload", &stats.upload},
+                        {"download", &stats.download}};
+
+    std::cout << std::fixed << std::setprecision(1);
+
+    std::cout << "Scenario   " << m_scenario.clientCount << " clients in " << m_scenario.roomCount
+              << " rooms, protocol " << m_scenario.protocolVersion << ", " << m_scenario.stripeCount
+              << " stripes per download, " << m_scenario.threadCount << " threads, " << seconds
+              << " s measured after " << m_scenario.warmup << " s warmup" << std::endl;
+
+    std::cout << "Clients    " << m_counters.joined << " joined, " << m_counters.failed << " failed, "
+              << m_counters.disconnected << " disconnected" << std::endl;
+
+    std::cout << "Messages   " << m_counters.messagesSent << " sent (" << m_counters.messagesSent / seconds
+              << "/s), " << m_counters.messagesDelivered << " delivered ("
+              << m_counters.messagesDelivered / seconds << "/s)" << std::endl;
+
+    std::cout << "Files      " << m_counters.uploads << " uploaded ("
+              << toMebibytes(m_counters.uploadBytes) / seconds << " MiB/s), " << m_counters.downloads
+              << " downloaded (" << toMebibytes(m_counters.downloadBytes) / seconds << " MiB/s)" << std::endl;
+
+    std::cout << std::endl << std::setprecision(3);
+    std::cout << std::left << std::setw(12) << "Latency ms" << std::right << std::setw(12) << "count"
+              << std::setw(12) << "p50" << std::setw(12) << "p99" << std::setw(12) << "p999" << std::setw(12)
+              << "max" << std::endl;
+
+    for (const auto& row : rows) {
+        std::cout << std::left << std::setw(12) << row.name << std::right << std::setw(12)
+                  << row.latency->count() << std::setw(12) << toMilliseconds(row.latency->percentile(0.5))
+                  << std::setw(12) << toMilliseconds(row.latency->percentile(0.99)) << std::setw(12)
+                  << toMilliseconds(row.latency->percentile(0.999)) << std::setw(12)
+                  << toMilliseconds(row.latency->max()) << std::endl;
+    }
+}
@@ -0,0 +1,75 @@
+#ifndef LOADGENERATOR_HPP
+#define LOADGENERATOR_HPP
+
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QThread>
+#include <QTimer>
+
+#include "loadstats.hpp"
+#include "scenario.hpp"
+#include "simclient.hpp"
+
+// Clients that share one thread and its event loop, the stats are only read after the thread has ended
+class LoadGroup : public QObject {
+    Q_OBJECT
+   public:
+    LoadGroup(const Scenario* scenario, const QByteArray& contents, LoadCounters* counters,
+              QObject* parent = nullptr);
+
+    void addClient(int index, const QString& address, quint16 port);
+    void stop();
+
+    const GroupStats& stats() const;
+
+   private:
+    const Scenario* m_scenario;
+    QByteArray m_contents;
+    LoadCounters* m_counters;
+
+    QList<SimClient*> m_clients;
+    GroupStats m_stats;
+};
+
+// Connects the clients at the scenario's rate, measures after the warmup and prints the report
+class LoadGenerator : public QObject {
+    Q_OBJECT
+   public:
+    LoadGenerator(const Scenario& scenario, const QString& address, quint16 port, QObject* parent = nullptr);
+    ~LoadGenerator();
+
+    void start();
+
+   private:
+    enum class Phase { Connecting, Warmup, Measuring };
+
+    void finish();
+    void printReport(const GroupStats& stats, double seconds) const;
+
+    Scenario m_scenario;
+    QString m_address;
+    quint16 m_port;
+    QByteArray m_contents;  // data of every uploaded chunk
+
+    LoadCounters m_counters;
+    QList<QThread*> m_threads;
+    QList<LoadGroup*> m_groups;
+
+    QTimer m_connectTimer;
+    QTimer m_progressTimer;
+    QElapsedTimer m_clock;
+    Phase m_phase;
+    qint64 m_phaseStart;  // milliseconds
+    int m_started;
+
+    // Counters at the previous progress line
+    quint64 m_lastSent;
+    quint64 m_lastDelivered;
+
+   private slots:
+    void connectClients();
+    void tick();
+};
+
+#endif  // LOADGENERATOR_HPP
@@ -0,0 +1,78 @@
+#include "loadstats.hpp"
+
+#include <QtAlgorithms>
+#include <cmath>
+
+#define SUB_BUCKET_COUNT (1 << SUB_BUCKET_BITS)
+
+// Values up to 2^63 ns
+#define BUCKET_COUNT (LINEAR_BUCKET_COUNT + (63 - SUB_BUCKET_BITS) * SUB_BUCKET_COUNT)
+
+LatencyStats::LatencyStats() : buckets(BUCKET_COUNT, 0), total(0), maximum(0) {}
+
+int LatencyStats::bucketOf(qint64 value) {
+    if (value < LINEAR_BUCKET_COUNT) {
+        return qMax<qint64>(value, 0);
+    }
+
+    // Highest bit selects the power of two, the next SUB_BUCKET_BITS bits the bucket within it
+    int exponent = 63 - qCountLeadingZeroBits(quint64(value));
+    int shift = exponent - SUB_BUCKET_BITS;
+    int mantissa = int(value >> shift) - SUB_BUCKET_COUNT;
+
+    return LINEAR_BUCKET_COUNT + (exponent - SUB_BUCKET_BITS - 1) * SUB_BUCKET_COUNT + mantissa;
+}
+
+qint64 LatencyStats::bucketTop(int bucket) {
+    if (bucket < LINEAR_BUCKET_COUNT) {
+        return bucket;
+    }
+
+    int exponent = (bucket - LINEAR_BUCKET_COUNT) / SUB_BUCKET_COUNT + SUB_BUCKET_BITS + 1;
+    qint64 mantissa = (bucket - LINEAR_BUCKET_COUNT) % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+    int shift = exponent - SUB_BUCKET_BITS;
+
+    return ((mantissa + 1) << shift) - 1;
+}
+
+void LatencyStats::record(qint64 nanoseconds) {
+    buckets[bucketOf(nanoseconds)]++;
+    total++;
+    maximum = qMax(maximum, nanoseconds);
+}
+
+void LatencyStats::merge(const LatencyStats& other) {
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        buckets[i] += other.buckets[i];
+    }
+
+    total += other.total;
+    maximum = qMax(maximum, other.maximum);
+}
+
+quint64 LatencyStats::count() const {
+    return total;
+}
+
+qint64 LatencyStats::max() const {
+    return maximum;
+}
+
+qint64 LatencyStats::percentile(double fraction) const {
+    quint64 rank = qMax<quint64>(std::ceil(fraction * total), 1);
+    quint64 cumulative = 0;
+
+    if (total == 0) {
+        return 0;
+    }
+
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        cumulative += buckets[i];
+
+        if (cumulative >= rank) {
+            return qMin(bucketTop(i), maximum);
+        }
+    }
+
+    return maximum;
+}
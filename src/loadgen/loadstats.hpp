@@ -0,0 +1,60 @@
+#ifndef LOADSTATS_HPP
+#define LOADSTATS_HPP
+
+#include <QList>
+#include <atomic>
+
+// Values below 128 ns get a bucket each, above that every power of two is split into 64 buckets,
+// so a percentile is at most 1/64 above the recorded value
+#define LINEAR_BUCKET_COUNT 128
+#define SUB_BUCKET_BITS 6
+
+// Log-linear histogram like HDR histograms; every thread records into its own, they are merged for the report
+class LatencyStats {
+   public:
+    LatencyStats();
+
+    void record(qint64 nanoseconds);
+    void merge(const LatencyStats& other);
+
+    quint64 count() const;
+    qint64 max() const;
+
+    // Upper bound of the bucket holding the value at this fraction (0.5, 0.99, 0.999) of all values
+    qint64 percentile(double fraction) const;
+
+   private:
+    static int bucketOf(qint64 value);
+    static qint64 bucketTop(int bucket);
+
+    QList<quint64> buckets;
+    quint64 total;
+    qint64 maximum;
+};
+
+// Latencies recorded by the clients of one thread
+struct GroupStats {
+    LatencyStats join;      // connect until "/userid"
+    LatencyStats message;   // send until a room member receives it, once per member
+    LatencyStats upload;    // FileBegin until the file shows up in the room's file list
+    LatencyStats download;  // request until FileEnd
+};
+
+// Shared by all threads; events are only counted while isMeasuring is set, connections always are
+struct LoadCounters {
+    std::atomic<bool> isMeasuring{false};
+
+    std::atomic<quint64> connected{0};
+    std::atomic<quint64> joined{0};
+    std::atomic<quint64> failed{0};
+    std::atomic<quint64> disconnected{0};
+
+    std::atomic<quint64> messagesSent{0};
+    std::atomic<quint64> messagesDelivered{0};
+    std::atomic<quint64> uploads{0};
+    std::atomic<quint64> uploadBytes{0};
+    std::atomic<quint64> downloads{0};
+    std::atomic<quint64> downloadBytes{0};
+};
+
+#endif  // LOADSTATS_HPP
@@ -0,0 +1,74 @@
+#include <QtCore/QCoreApplication>
+#include <iomanip>
+#include <iostream>
+
+#ifdef Q_OS_UNIX
+#include <sys/resource.h>
+#endif
+
+#include "loadgenerator.hpp"
+
+#define DEFAULT_ADDRESS "127.0.0.1"
+#define DEFAULT_PORT 8044
+
+void usage(std::string exe) {
+    std::cout << std::left;
+
+    std::cout << "Usage: " << std::endl;
+    std::cout << exe << std::setw(32) << " SCENARIO [ADDRESS [PORT]]"
+              << "run the scenario file against the server at address and port" << std::endl;
+    std::cout << exe << std::setw(32) << " SCENARIO"
+              << "run the scenario file against " << DEFAULT_ADDRESS << ':' << DEFAULT_PORT << std::endl;
+}
+
+// Every simulated client holds a socket, the default soft limit is often 1024
+static void raiseFileLimit() {
+#ifdef Q_OS_UNIX
+    struct rlimit limit;
+
+    if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+#endif
+}
+
+int main(int argc, char* argv[]) {
+    QString address;
+    int port;
+    Scenario scenario;
+    QString error;
+
+    address = DEFAULT_ADDRESS;
+    port = DEFAULT_PORT;
+
+    if (argc < 2 || argc > 4) {
+        std::cout << (argc < 2 ? "Missing scenario" : "Too many arguments") << std::endl << std::endl;
+
+        usage(argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (argc >= 3) {
+        address = argv[2];
+    }
+
+    if (argc == 4) {
+        auto newPort = std::atoi(argv[3]);
+        port = newPort >= 1 && newPort <= 65535 ? newPort : DEFAULT_PORT;
+    }
+
+    QCoreApplication a(argc, argv);
+
+    if (!loadScenario(argv[1], scenario, error)) {
+        std::cout << error.toStdString() << std::endl;
+        exit(EXIT_FAILURE);
+    }
+
+    raiseFileLimit();
+
+    LoadGenerator generator(scenario, address, port);
+    generator.start();
+
+    return a.exec();
+}
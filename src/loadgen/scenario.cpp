@@ -0,0 +1,162 @@
+#include "scenario.hpp"
+
+#include <QFileInfo>
+#include <QRandomGenerator>
+#include <QSettings>
+#include <QThread>
+
+#include "../protocol.hpp"
+
+// Smallest message that still holds the send timestamp
+#define MIN_MESSAGE_SIZE 32
+
+// Data connections per download, like the client allows
+#define MAX_STRIPE_COUNT 16
+
+// "512", "64K", "16M" or "1G"
+static qint64 parseSize(QString text) {
+    qint64 multiplier = 1;
+    bool isValid;
+
+    text = text.trimmed().toUpper();
+
+    if (text.endsWith('K')) {
+        multiplier = 1LL << 10;
+    } else if (text.endsWith('M')) {
+        multiplier = 1LL << 20;
+    } else if (text.endsWith('G')) {
+        multiplier = 1LL << 30;
+    }
+
+    if (multiplier != 1) {
+        text.chop(1);
+    }
+
+    qint64 size = text.toLongLong(&isValid);
+
+    return isValid && size > 0 ? size * multiplier : -1;
+}
+
+qint64 Scenario::pickFileSize() const {
+    int total = 0;
+    int pick;
+
+    for (const auto& fileSize : fileSizes) {
+        total += fileSize.weight;
+    }
+
+    pick = QRandomGenerator::global()->bounded(total);
+
+    for (const auto& fileSize : fileSizes) {
+        if (pick < fileSize.weight) {
+            return fileSize.size;
+        }
+
+        pick -= fileSize.weight;
+    }
+
+    return fileSizes.last().size;
+}
+
+bool loadScenario(const QString& path, Scenario& scenario, QString& error) {
+    QSettings settings(path, QSettings::IniFormat);
+
+    if (!QFileInfo(path).isReadable() || settings.status() != QSettings::NoError) {
+        error = "Can't read scenario " + path;
+        return false;
+    }
+
+    settings.beginGroup("clients");
+    scenario.clientCount = settings.value("count", 100).toInt();
+    scenario.roomCount = settings.value("rooms", 10).toInt();
+    scenario.threadCount = settings.value("threads", 0).toInt();
+    scenario.connectRate = settings.value("connect_rate", 100).toDouble();
+    scenario.protocolVersion = settings.value("protocol", protocol::FRAMED_VERSION).toInt();
+
+    // Commas make QSettings return a list
+    scenario.codecs = settings.value("codecs").toStringList().join(',').toLatin1();
+    settings.endGroup();
+
+    settings.beginGroup("messages");
+    scenario.messageRate = settings.value("rate", 1.0).toDouble();
+    scenario.messageSize = qMax(settings.value("size", 64).toInt(), MIN_MESSAGE_SIZE);
+    settings.endGroup();
+
+    settings.beginGroup("files");
+    scenario.uploadRate = settings.value("upload_rate", 0.0).toDouble();
+    scenario.downloadRate = settings.value("download_rate", 0.0).toDouble();
+    scenario.isCompressible = settings.value("contents", "random").toString() == "text";
+    scenario.stripeCount = settings.value("stripes", 1).toInt();
+
+    scenario.fileSizes.clear();
+
+    for (const auto& item : settings.value("sizes", "64K").toStringList()) {
+        // "size:weight", the weight is 1 when it is left out
+        QStringList parts = item.split(':');
+        FileSize fileSize{parseSize(parts[0]), parts.size() > 1 ? parts[1].trimmed().toInt() : 1};
+
+        if (fileSize.size <= 0 || fileSize.weight <= 0 || parts.size() > 2) {
+            error = "Invalid file size \"" + item + "\" in [files] sizes";
+            return false;
+        }
+
+        scenario.fileSizes.append(fileSize);
+    }
+    settings.endGroup();
+
+    settings.beginGroup("run");
+    scenario.warmup = settings.value("warmup", 5).toInt();
+    scenario.duration = settings.value("duration", 30).toInt();
+    settings.endGroup();
+
+    if (scenario.threadCount <= 0) {
+        scenario.threadCount = QThread::idealThreadCount();
+    }
+
+    if (scenario.clientCount < 1 || scenario.roomCount < 1 || scenario.connectRate <= 0) {
+        error = "[clients] needs count, rooms and connect_rate above 0";
+        return false;
+    }
+
+    if (scenario.protocolVersion < protocol::TEXT_VERSION ||
+        scenario.protocolVersion > protocol::CURRENT_VERSION) {
+        error = "[clients] protocol must be between " + QString::number(protocol::TEXT_VERSION) + " and " +
+                QString::number(protocol::CURRENT_VERSION);
+        return false;
+    }
+
+    if (scenario.messageRate < 0 || scenario.uploadRate < 0 || scenario.downloadRate < 0) {
+        error = "Rates can't be negative";
+        return false;
+    }
+
+    if (scenario.stripeCount < 1 || scenario.stripeCount > MAX_STRIPE_COUNT) {
+        error = "[files] stripes must be between 1 and " + QString::number(MAX_STRIPE_COUNT);
+        return false;
+    }
+
+    if (scenario.stripeCount > 1 && scenario.protocolVersion < protocol::STRIPED_VERSION) {
+        error = "[files] stripes above 1 need protocol " + QString::number(protocol::STRIPED_VERSION) +
+                " or newer";
+        return false;
+    }
+
+    for (const auto& fileSize : scenario.fileSizes) {
+        if (scenario.protocolVersion == protocol::TEXT_VERSION &&
+            fileSize.size > protocol::MAX_TEXT_FILE_SIZE) {
+            error = "Text protocol servers don't accept files above " +
+                    QString::number(protocol::MAX_TEXT_FILE_SIZE) + " bytes";
+            return false;
+        }
+    }
+
+    if (scenario.warmup < 0 || scenario.duration < 1) {
+        error = "[run] needs warmup of at least 0 and duration of at least 1 second";
+        return false;
+    }
+
+    scenario.roomCount = qMin(scenario.roomCount, scenario.clientCount);
+    scenario.threadCount = qMin(scenario.threadCount, scenario.clientCount);
+
+    return true;
+}
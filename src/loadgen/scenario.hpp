@@ -0,0 +1,44 @@
+#ifndef SCENARIO_HPP
+#define SCENARIO_HPP
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+// Uploaded files get one of these sizes, picked with probability weight / sum of weights
+struct FileSize {
+    qint64 size;
+    int weight;
+};
+
+// Load of one run, read from an INI file like scenarios/chat.ini
+struct Scenario {
+    // [clients]
+    int clientCount;
+    int roomCount;
+    int threadCount;
+    double connectRate;  // new connections per second
+    int protocolVersion;
+    QByteArray codecs;  // offered in "/protocol 5:codecs"
+
+    // [messages], rates are per client and second
+    double messageRate;
+    int messageSize;
+
+    // [files]
+    double uploadRate;
+    double downloadRate;
+    QList<FileSize> fileSizes;
+    bool isCompressible;  // text-like contents instead of random bytes
+    int stripeCount;      // data connections per download, 1 keeps downloads on the main connection
+
+    // [run], in seconds
+    int warmup;    // after the last client has connected, nothing is measured yet
+    int duration;  // measured part of the run
+
+    qint64 pickFileSize() const;
+};
+
+bool loadScenario(const QString& path, Scenario& scenario, QString& error);
+
+#endif  // SCENARIO_HPP
@@ -0,0 +1,565 @@
+#include "simclient.hpp"
+
+#include <QDebug>
+#include <QRandomGenerator>
+#include <chrono>
+#include <climits>
+#include <random>
+
+#include "../base64.hpp"
+
+// Marks messages of the load generator, followed by the send time in nanoseconds
+#define MESSAGE_STAMP "#lg "
+
+// Monotonic and shared by all threads, so a message can be timed by any member of the room
+static qint64 now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+
+SimClient::SimClient(int index, const Scenario* scenario, const QByteArray& contents, LoadCounters* counters,
+                     GroupStats* stats, QObject* parent)
+    : QObject(parent),
+      m_scenario(scenario),
+      m_contents(contents),
+      m_counters(counters),
+      m_stats(stats),
+      m_socket(new QTcpSocket(this)),
+      m_port(0),
+      m_messagePadding(scenario->messageSize, 'x'),
+      m_protocolVersion(protocol::TEXT_VERSION),
+      m_isJoined(false),
+      m_isStopped(false),
+      m_connectStart(0),
+      m_uploadSize(0),
+      m_uploadSent(0),
+      m_uploadStart(0),
+      m_uploadCount(0),
+      m_isUploadOpen(false),
+      m_isDownloading(false),
+      m_downloadStart(0),
+      m_isProbing(false),
+      m_downloadSize(0),
+      m_downloadTransferId(0) {
+    // Clients of a room are spread over all threads
+    m_roomId = "loadgen-" + QByteArray::number(index % scenario->roomCount).rightJustified(5, '0');
+    m_userName = "lg" + QByteArray::number(index);
+
+    m_messageTimer.setSingleShot(true);
+    m_uploadTimer.setSingleShot(true);
+    m_downloadTimer.setSingleShot(true);
+
+    connect(&m_messageTimer, SIGNAL(timeout()), this, SLOT(sendMessage()));
+    connect(&m_uploadTimer, SIGNAL(timeout()), this, SLOT(beginUpload()));
+    connect(&m_downloadTimer, SIGNAL(timeout()), this, SLOT(requestFile()));
+
+    connect(m_socket, SIGNAL(connected()), this, SLOT(connected()));
+    connect(m_socket, SIGNAL(readyRead()), this, SLOT(readyRead()));
+    connect(m_socket, SIGNAL(bytesWritten(qint64)), this, SLOT(bytesWritten(qint64)));
+    connect(m_socket, SIGNAL(disconnected()), this, SLOT(connectionLost()));
+    connect(m_socket, SIGNAL(errorOccurred(QAbstractSocket::SocketError)), this, SLOT(connectionLost()));
+}
+
+void SimClient::start(const QString& address, quint16 port) {
+    m_address = address;
+    m_port = port;
+    m_connectStart = now();
+    m_socket->connectToHost(address, port);
+}
+
+void SimClient::stop() {
+    m_isStopped = true;
+
+    m_messageTimer.stop();
+    m_uploadTimer.stop();
+    m_downloadTimer.stop();
+
+    closeStripes();
+    m_socket->abort();
+}
+
+void SimClient::connected() {
+    QByteArray lines;
+
+    m_counters->connected++;
+
+    // Small messages would otherwise wait for the ACK of the previous one, which is not the server's latency
+    m_socket->setSocketOption(QAbstractSocket::LowDelayOption, 1);
+
+    if (m_scenario->protocolVersion > protocol::TEXT_VERSION) {
+        lines = "/protocol " + QByteArray::number(m_scenario->protocolVersion) + ':' + m_scenario->codecs;
+        lines += '\n';
+    }
+
+    lines += "/join " + m_roomId + ':' + m_userName + '\n';
+    m_socket->write(lines);
+}
+
+void SimClient::readyRead() {
+    char firstByte;
+
+    while (!m_isStopped && m_socket->peek(&firstByte, 1) == 1) {
+        if (protocol::isFrameStart(firstByte)) {
+            protocol::Frame frame;
+            auto result = protocol::readFrame(m_socket, frame);
+
+            if (result == protocol::ReadResult::Incomplete) {
+                break;
+            } else if (result == protocol::ReadResult::Error) {
+                qDebug() << m_userName << "received a malformed frame";
+                m_socket->abort();
+                return;
+            }
+
+            processFrame(frame);
+        } else if (m_socket->canReadLine()) {
+            processTextLine(protocol::readLine(m_socket, m_lineBuffer));
+        } else {
+            break;
+        }
+    }
+}
+
+void SimClient::processTextLine(QByteArrayView line) {
+    protocol::TextCommand command;
+
+    if (!protocol::parseTextLine(line, command)) {
+        // Text message "hh:mm user:text"
+        receiveMessage(line);
+        return;
+    }
+
+    switch (command.command) {
+        case protocol::Command::Protocol:
+            m_protocolVersion =
+                qBound(protocol::TEXT_VERSION, command.room.toInt(), protocol::CURRENT_VERSION);
+            break;
+        case protocol::Command::UserId:
+            joined();
+            break;
+        case protocol::Command::Files:
+            if (command.room == m_roomId) {
+                receiveFileList(command.data);
+            }
+            break;
+        case protocol::Command::SendFile:
+            // Whole file in one base64 line
+            if (m_isDownloading && m_counters->isMeasuring) {
+                m_counters->downloadBytes += command.data.size() / 4 * 3;
+            }
+
+            finishDownload();
+            break;
+        default:
+            break;
+    }
+}
+
+void SimClient::processFrame(const protocol::Frame& frame) {
+    QString fileName;
+    qint64 position;
+
+    switch (frame.type) {
+        case protocol::FrameType::Message:
+            receiveMessage(frame.payload);
+            break;
+        case protocol::FrameType::UserId:
+            joined();
+            break;
+        case protocol::FrameType::Files:
+            if (frame.room == m_roomId) {
+                receiveFileList(frame.payload);
+            }
+            break;
+        case protocol::FrameType::RoomState:
+            if (frame.room == m_roomId) {
+                receiveRoomState(frame.payload);
+            }
+            break;
+        case protocol::FrameType::RoomEvent:
+            if (frame.room == m_roomId) {
+                receiveRoomEvent(frame.payload);
+            }
+            break;
+        case protocol::FrameType::FileChunk:
+        case protocol::FrameType::PackedChunk:
+            // Compressed chunks are counted as sent, the load generator does not unpack them
+            if (m_counters->isMeasuring) {
+                m_counters->downloadBytes += frame.payload.size();
+            }
+            break;
+        case protocol::FrameType::FileBegin:
+            if (m_isProbing) {
+                protocol::decodeFileBegin(frame.payload, fileName, m_downloadSize);
+            }
+            break;
+        case protocol::FrameType::FileOffset:
+            if (m_isProbing) {
+                protocol::decodeTransfer(frame.payload, m_downloadTransferId, position, fileName);
+            }
+            break;
+        case protocol::FrameType::FileEnd:
+            if (m_isProbing) {
+                m_isProbing = false;
+                beginStripedDownload();
+            } else {
+                finishDownload();
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+void SimClient::joined() {
+    if (m_isJoined) {
+        return;
+    }
+
+    m_isJoined = true;
+    m_counters->joined++;
+    m_stats->join.record(now() - m_connectStart);
+
+    scheduleNext(&m_messageTimer, m_scenario->messageRate);
+    scheduleNext(&m_uploadTimer, m_scenario->uploadRate);
+    scheduleNext(&m_downloadTimer, m_scenario->downloadRate);
+}
+
+void SimClient::receiveMessage(QByteArrayView text) {
+    qsizetype start = text.indexOf(MESSAGE_STAMP);
+    qsizetype end;
+    qint64 sentAt;
+    bool isValid;
+
+    // Notices of the server and messages of other programs carry no stamp
+    if (start == -1 || !m_counters->isMeasuring) {
+        return;
+    }
+
+    start += qstrlen(MESSAGE_STAMP);
+    end = text.indexOf(' ', start);
+    sentAt = text.sliced(start, (end == -1 ? text.size() : end) - start).toLongLong(&isValid);
+
+    if (isValid) {
+        m_counters->messagesDelivered++;
+        m_stats->message.record(now() - sentAt);
+    }
+}
+
+void SimClient::receiveFileList(QByteArrayView names) {
+    m_fileNames = QByteArray(names.data(), names.size()).split('/');
+    m_fileNames.removeAll(QByteArray());
+
+    checkUploadListed();
+}
+
+void SimClient::receiveRoomState(const QByteArray& payload) {
+    QString users;
+    QString files;
+    quint64 sequence;
+
+    if (protocol::decodeRoomState(payload, sequence, users, files)) {
+        receiveFileList(files.toUtf8());
+    }
+}
+
+void SimClient::receiveRoomEvent(const QByteArray& payload) {
+    protocol::RoomEventKind kind;
+    QString name;
+    quint64 sequence;
+
+    // Events of one connection arrive in order, so sequence numbers are not checked here
+    if (!protocol::decodeRoomEvent(payload, sequence, kind, name)) {
+        return;
+    }
+
+    if (kind == protocol::RoomEventKind::FileAdded) {
+        m_fileNames.append(name.toUtf8());
+        checkUploadListed();
+    } else if (kind == protocol::RoomEventKind::FileRemoved) {
+        m_fileNames.removeOne(name.toUtf8());
+    }
+}
+
+void SimClient::checkUploadListed() {
+    // Server lists a file once it has stored all of it
+    if (!m_uploadName.isEmpty() && !m_isUploadOpen && m_fileNames.contains(m_uploadName)) {
+        if (m_counters->isMeasuring) {
+            m_counters->uploads++;
+            m_stats->upload.record(now() - m_uploadStart);
+        }
+
+        m_uploadName.clear();
+    }
+}
+
+void SimClient::finishDownload() {
+    if (!m_isDownloading) {
+        return;
+    }
+
+    m_isDownloading = false;
+
+    if (m_counters->isMeasuring) {
+        m_counters->downloads++;
+        m_stats->download.record(now() - m_downloadStart);
+    }
+}
+
+void SimClient::beginStripedDownload() {
+    QByteArray lines;
+    qint64 stripeSize;
+
+    lines = "/protocol " + QByteArray::number(protocol::STRIPED_VERSION) + ":\n/attach " + m_roomId + ':' +
+            m_userName + '\n';
+
+    // Ranges are whole chunks like those of the client, so every data connection sends full frames
+    stripeSize = (m_downloadSize + m_scenario->stripeCount - 1) / m_scenario->stripeCount;
+    stripeSize = (stripeSize + protocol::FILE_CHUNK_SIZE - 1) / protocol::FILE_CHUNK_SIZE *
+                 protocol::FILE_CHUNK_SIZE;
+
+    for (qint64 offset = 0; offset < m_downloadSize; offset += stripeSize) {
+        QTcpSocket* stripe = new QTcpSocket(this);
+        QByteArray request =
+            lines + protocol::encodeFrame(protocol::FrameType::GetFileSlice, m_roomId,
+                                          protocol::encodeSlice(m_downloadTransferId, offset,
+                                                                qMin(stripeSize, m_downloadSize - offset),
+                                                                QString::fromUtf8(m_downloadName)));
+
+        m_stripes.append(stripe);
+
+        // Server reads the range only after it has attached the connection to the room
+        connect(stripe, &QTcpSocket::connected, this, [stripe, request] { stripe->write(request); });
+        connect(stripe, &QTcpSocket::readyRead, this, [this, stripe] { readStripe(stripe); });
+        connect(stripe, &QTcpSocket::errorOccurred, this, [this, stripe] { stripeLost(stripe); });
+
+        stripe->connectToHost(m_address, m_port);
+    }
+
+    // Empty file has no ranges
+    if (m_stripes.isEmpty()) {
+        finishDownload();
+    }
+}
+
+void SimClient::readStripe(QTcpSocket* stripe) {
+    char firstByte;
+
+    while (!m_isStopped && stripe->peek(&firstByte, 1) == 1) {
+        if (protocol::isFrameStart(firstByte)) {
+            protocol::Frame frame;
+            auto result = protocol::readFrame(stripe, frame);
+
+            if (result == protocol::ReadResult::Incomplete) {
+                break;
+            } else if (result == protocol::ReadResult::Error) {
+                qDebug() << m_userName << "received a malformed frame on a data connection";
+                closeStripes();
+                m_isDownloading = false;
+                return;
+            }
+
+            if (frame.type == protocol::FrameType::FileChunk && m_counters->isMeasuring) {
+                m_counters->downloadBytes += frame.payload.size();
+            } else if (frame.type == protocol::FrameType::FileEnd) {
+                finishStripe(stripe);
+                return;
+            }
+        } else if (stripe->canReadLine()) {
+            // Only the answer to "/protocol" comes as a text line
+            protocol::readLine(stripe, m_lineBuffer);
+        } else {
+            break;
+        }
+    }
+}
+
+void SimClient::finishStripe(QTcpSocket* stripe) {
+    m_stripes.removeOne(stripe);
+
+    stripe->disconnect(this);
+    stripe->disconnectFromHost();
+    stripe->deleteLater();
+
+    // Download is done when the last range has ended
+    if (m_stripes.isEmpty()) {
+        finishDownload();
+    }
+}
+
+void SimClient::stripeLost(QTcpSocket* stripe) {
+    qDebug() << m_userName << "lost a data connection:" << stripe->errorString();
+
+    closeStripes();
+    m_isDownloading = false;
+}
+
+void SimClient::closeStripes() {
+    for (auto stripe : std::as_const(m_stripes)) {
+        stripe->disconnect(this);
+        stripe->abort();
+        stripe->deleteLater();
+    }
+
+    m_stripes.clear();
+}
+
+void SimClient::sendMessage() {
+    QByteArray text;
+
+    scheduleNext(&m_messageTimer, m_scenario->messageRate);
+
+    // Message would end up inside the open "/sendfile" line
+    if (isTextUploadOpen()) {
+        return;
+    }
+
+    text = MESSAGE_STAMP + QByteArray::number(now()) + ' ';
+    text += m_messagePadding.left(qMax<qsizetype>(m_scenario->messageSize - text.size(), 0));
+
+    if (m_protocolVersion >= protocol::FRAMED_VERSION) {
+        m_socket->write(protocol::encodeFrame(protocol::FrameType::Message, m_roomId, text));
+    } else {
+        m_socket->write("/msg " + m_roomId + ':' + text + '\n');
+    }
+
+    if (m_counters->isMeasuring) {
+        m_counters->messagesSent++;
+    }
+}
+
+void SimClient::beginUpload() {
+    scheduleNext(&m_uploadTimer, m_scenario->uploadRate);
+
+    // One upload at a time, like the client
+    if (!m_uploadName.isEmpty()) {
+        return;
+    }
+
+    m_uploadCount++;
+    m_uploadName = m_userName + '-' + QByteArray::number(m_uploadCount) + ".bin";
+    m_uploadSize = m_scenario->pickFileSize();
+    m_uploadSent = 0;
+    m_uploadStart = now();
+    m_isUploadOpen = true;
+
+    if (m_protocolVersion >= protocol::FRAMED_VERSION) {
+        m_socket->write(protocol::encodeFrame(protocol::FrameType::FileBegin, m_roomId,
+                                              protocol::encodeFileBegin(m_uploadName, m_uploadSize)));
+    } else {
+        m_socket->write("/sendfile '" + m_uploadName + "' " + m_roomId + ':');
+    }
+
+    sendUploadChunks();
+}
+
+void SimClient::sendUploadChunks() {
+    QByteArray chunk;
+
+    // Contents are read only as fast as the socket drains, like uploads of the client
+    while (m_isUploadOpen && !m_isStopped && m_socket->bytesToWrite() < protocol::FILE_HIGH_WATER_MARK) {
+        qint64 size = qMin(protocol::FILE_CHUNK_SIZE, m_uploadSize - m_uploadSent);
+
+        if (size == 0) {
+            if (m_protocolVersion >= protocol::FRAMED_VERSION) {
+                m_socket->write(protocol::encodeFrame(protocol::FrameType::FileEnd, m_roomId));
+            } else {
+                m_socket->write("\n");
+            }
+
+            m_isUploadOpen = false;
+            return;
+        }
+
+        chunk = m_contents.left(size);
+
+        if (m_uploadSent == 0) {
+            // Server stores equal contents once, every upload starts with its own name to get a blob
+            chunk.replace(0, qMin<qsizetype>(m_uploadName.size(), size), m_uploadName.left(size));
+        }
+
+        if (m_protocolVersion >= protocol::FRAMED_VERSION) {
+            m_socket->write(protocol::encodeFrame(protocol::FrameType::FileChunk, m_roomId, chunk));
+        } else {
+            m_socket->write(base64::encode(chunk));
+        }
+
+        m_uploadSent += size;
+
+        if (m_counters->isMeasuring) {
+            m_counters->uploadBytes += size;
+        }
+    }
+}
+
+void SimClient::requestFile() {
+    QByteArray fileName;
+
+    scheduleNext(&m_downloadTimer, m_scenario->downloadRate);
+
+    if (m_isDownloading || m_fileNames.isEmpty() || isTextUploadOpen()) {
+        return;
+    }
+
+    fileName = m_fileNames[QRandomGenerator::global()->bounded(int(m_fileNames.size()))];
+    m_isDownloading = true;
+    m_downloadStart = now();
+
+    if (m_protocolVersion >= protocol::STRIPED_VERSION && m_scenario->stripeCount > 1) {
+        // Empty range tells the size and ID of the file, the ranges follow over data connections
+        m_isProbing = true;
+        m_downloadName = fileName;
+        m_socket->write(protocol::encodeFrame(protocol::FrameType::GetFileSlice, m_roomId,
+                                              protocol::encodeSlice(0, 0, 0, QString::fromUtf8(fileName))));
+    } else if (m_protocolVersion >= protocol::FRAMED_VERSION) {
+        m_socket->write(protocol::encodeFrame(protocol::FrameType::GetFile, m_roomId, fileName));
+    } else {
+        m_socket->write("/getfile '" + fileName + "' " + m_roomId + ":.\n");
+    }
+}
+
+void SimClient::bytesWritten(qint64 bytes) {
+    Q_UNUSED(bytes);
+
+    sendUploadChunks();
+}
+
+void SimClient::connectionLost() {
+    if (m_isStopped) {
+        return;
+    }
+
+    // Both disconnected() and errorOccurred() end up here
+    m_isStopped = true;
+
+    m_messageTimer.stop();
+    m_uploadTimer.stop();
+    m_downloadTimer.stop();
+
+    closeStripes();
+
+    if (m_isJoined) {
+        m_counters->disconnected++;
+    } else {
+        m_counters->failed++;
+    }
+
+    qDebug() << m_userName << "lost its connection:" << m_socket->errorString();
+}
+
+void SimClient::scheduleNext(QTimer* timer, double rate) {
+    if (rate <= 0 || m_isStopped) {
+        return;
+    }
+
+    // Exponential gaps make the arrivals of every client a Poisson process
+    std::exponential_distribution<double> gap(rate);
+    double milliseconds = gap(*QRandomGenerator::global()) * 1000;
+
+    timer->start(qBound(1, qRound(qMin(milliseconds, 1e9)), INT_MAX));
+}
+
+bool SimClient::isTextUploadOpen() const {
+    return m_isUploadOpen && m_protocolVersion < protocol::FRAMED_VERSION;
+}
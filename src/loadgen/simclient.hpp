@@ -0,0 +1,100 @@
+#ifndef SIMCLIENT_HPP
+#define SIMCLIENT_HPP
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+
+#include "../protocol.hpp"
+#include "loadstats.hpp"
+#include "scenario.hpp"
+
+// One simulated user: joins its room, then sends messages, uploads and downloads files at the
+// scenario's rates (Poisson arrivals) and measures how long the server takes to deliver them.
+// Downloads are striped over data connections when the scenario asks for more than one stripe.
+class SimClient : public QObject {
+    Q_OBJECT
+   public:
+    SimClient(int index, const Scenario* scenario, const QByteArray& contents, LoadCounters* counters,
+              GroupStats* stats, QObject* parent = nullptr);
+
+    void start(const QString& address, quint16 port);
+    void stop();
+
+   private:
+    void processTextLine(QByteArrayView line);
+    void processFrame(const protocol::Frame& frame);
+
+    void joined();
+    void receiveMessage(QByteArrayView text);
+    void receiveFileList(QByteArrayView names);
+    void receiveRoomState(const QByteArray& payload);
+    void receiveRoomEvent(const QByteArray& payload);
+    void checkUploadListed();
+    void finishDownload();
+
+    void beginStripedDownload();
+    void readStripe(QTcpSocket* stripe);
+    void finishStripe(QTcpSocket* stripe);
+    void stripeLost(QTcpSocket* stripe);
+    void closeStripes();
+
+    void sendUploadChunks();
+    void scheduleNext(QTimer* timer, double rate);
+
+    bool isTextUploadOpen() const;
+
+    const Scenario* m_scenario;
+    QByteArray m_contents;
+    LoadCounters* m_counters;
+    GroupStats* m_stats;
+
+    QTcpSocket* m_socket;
+    QString m_address;
+    quint16 m_port;
+    QByteArray m_roomId;
+    QByteArray m_userName;
+    QByteArray m_lineBuffer;
+    QByteArray m_messagePadding;
+    int m_protocolVersion;
+    bool m_isJoined;
+    bool m_isStopped;
+    qint64 m_connectStart;
+
+    QList<QByteArray> m_fileNames;  // last file list of the room
+
+    QByteArray m_uploadName;  // set from FileBegin until the file is listed
+    qint64 m_uploadSize;
+    qint64 m_uploadSent;
+    qint64 m_uploadStart;
+    int m_uploadCount;
+    bool m_isUploadOpen;  // chunks are still being written
+
+    bool m_isDownloading;
+    qint64 m_downloadStart;
+
+    // Striped downloads: an empty range tells size and ID, then each data connection fetches one range
+    bool m_isProbing;
+    QByteArray m_downloadName;
+    qint64 m_downloadSize;
+    quint64 m_downloadTransferId;
+    QList<QTcpSocket*> m_stripes;  // data connections whose range has not ended yet
+
+    QTimer m_messageTimer;
+    QTimer m_uploadTimer;
+    QTimer m_downloadTimer;
+
+   private slots:
+    void connected();
+    void readyRead();
+    void bytesWritten(qint64 bytes);
+    void connectionLost();
+
+    void sendMessage();
+    void beginUpload();
+    void requestFile();
+};
+
+#endif  // SIMCLIENT_HPP
@@ -1,31 +1,323 @@
 #include "logger.hpp"
 
-void messageLogger(const QString& action, const QString& clientName, const QString& msg) {
-    QString actionLower;
-    QString borderString;
-    QTime time;
-    QString where;
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <thread>
 
-    actionLower = action.toLower();
-    borderString = QString(8, '-');
-    time = QDateTime().currentDateTime().time();
+// Must be a power of two
+#define LOG_QUEUE_CAPACITY 8192
+#define LOG_CATEGORY_COUNT 4
 
-    if (actionLower.startsWith("sent")) {
-        where = "to";
-    } else if (actionLower.startsWith("received") || actionLower.startsWith("bad")) {
-        where = "from";
-    } else {
-        where = "?";
+struct LogRecord {
+    qint64 time;
+    const char* action;
+    LogLevel level;
+    LogCategory category;
+    QString clientName;
+    QString msg;
+};
+
+// Bounded multi-producer single-consumer queue, producers never block and drop records when full
+class LogQueue {
+   public:
+    LogQueue() : enqueuePos(0), dequeuePos(0) {
+        for (size_t i = 0; i < LOG_QUEUE_CAPACITY; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(LogRecord& record) {
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Slot* slot;
+
+        forever {
+            slot = &slots[pos & (LOG_QUEUE_CAPACITY - 1)];
+
+            size_t sequence = slot->sequence.load(std::memory_order_acquire);
+            auto diff = (qint64) sequence - (qint64) pos;
+
+            if (diff == 0) {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->record = std::move(record);
+        slot->sequence.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool pop(LogRecord& record) {
+        Slot* slot = &slots[dequeuePos & (LOG_QUEUE_CAPACITY - 1)];
+
+        if (slot->sequence.load(std::memory_order_acquire) != dequeuePos + 1) {
+            return false;
+        }
+
+        record = std::move(slot->record);
+        slot->sequence.store(dequeuePos + LOG_QUEUE_CAPACITY, std::memory_order_release);
+        dequeuePos++;
+
+        return true;
+    }
+
+   private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    Slot slots[LOG_QUEUE_CAPACITY];
+    std::atomic<size_t> enqueuePos;
+    size_t dequeuePos;  // only touched by the flush thread
+};
+
+static const char* levelNames[] = {"debug", "info", "warning", "error", "off"};
+
+static bool parseLogLevel(const QString& name, LogLevel& level) {
+    for (int i = 0; i <= (int) LogLevel::Off; i++) {
+        if (name.compare(QLatin1String(levelNames[i]), Qt::CaseInsensitive) == 0) {
+            level = (LogLevel) i;
+            return true;
+        }
+    }
+
+    qDebug() << "Unknown log level" << name;
+    return false;
+}
+
+class Logger {
+   public:
+    Logger() : level((int) LogLevel::Info), dropped(0), running(true) {
+        for (int i = 0; i < LOG_CATEGORY_COUNT; i++) {
+            sampleRates[i].store(1);
+            sampleCounters[i].store(0);
+        }
+
+        // Public setters go through logger(), which is still being initialized here
+        LogLevel envLevel;
+
+        if (qEnvironmentVariableIsSet("WSTED_LOG_LEVEL") &&
+            parseLogLevel(qEnvironmentVariable("WSTED_LOG_LEVEL"), envLevel)) {
+            level.store((int) envLevel);
+        }
+
+        if (qEnvironmentVariableIsSet("WSTED_LOG_SAMPLE_TEXT")) {
+            sampleRates[(int) LogCategory::Text].store(
+                qMax(qEnvironmentVariableIntValue("WSTED_LOG_SAMPLE_TEXT"), 1));
+        }
+
+        if (qEnvironmentVariableIsSet("WSTED_LOG_SAMPLE_FILE")) {
+            sampleRates[(int) LogCategory::File].store(
+                qMax(qEnvironmentVariableIntValue("WSTED_LOG_SAMPLE_FILE"), 1));
+        }
+
+        flushThread = std::thread([this] { flushLoop(); });
+    }
+
+    ~Logger() {
+        running.store(false);
+        flushThread.join();
+    }
+
+    bool accepts(LogLevel recordLevel, LogCategory category) {
+        if ((int) recordLevel < level.load(std::memory_order_relaxed)) {
+            return false;
+        }
+
+        int rate = sampleRates[(int) category].load(std::memory_order_relaxed);
+
+        return rate <= 1 ||
+               sampleCounters[(int) category].fetch_add(1, std::memory_order_relaxed) % rate == 0;
+    }
+
+    void log(LogRecord& record) {
+        if (!queue.push(record)) {
+            dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    std::atomic<int> level;
+    std::atomic<int> sampleRates[LOG_CATEGORY_COUNT];
+
+   private:
+    void flushLoop() {
+        LogRecord record;
+        QByteArray buffer;
+
+        forever {
+            bool isRunning = running.load();
+
+            while (queue.pop(record)) {
+                appendRecord(buffer, record);
+
+                // Strings are released here, not in the slot, so a full queue holds no stale data
+                record = LogRecord();
+            }
+
+            quint64 droppedCount = dropped.exchange(0, std::memory_order_relaxed);
+            if (droppedCount != 0) {
+                buffer += "{\"ts\":\"" + QDateTime::currentDateTime().toString(Qt::ISODateWithMs).toUtf8() +
+                          "\",\"level\":\"warning\",\"category\":\"logger\",\"msg\":\"dropped " +
+                          QByteArray::number(droppedCount) + " records\"}\n";
+            }
+
+            if (!buffer.isEmpty()) {
+                fwrite(buffer.constData(), 1, buffer.size(), stderr);
+                fflush(stderr);
+                buffer.clear();
+            } else if (!isRunning) {
+                break;
+            } else {
+                std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            }
+        }
+    }
+
+    static void appendRecord(QByteArray& buffer, const LogRecord& record) {
+        static const char* categoryNames[] = {"control", "text", "file", "bad"};
+
+        buffer += "{\"ts\":\"";
+        buffer += QDateTime::fromMSecsSinceEpoch(record.time).toString(Qt::ISODateWithMs).toUtf8();
+        buffer += "\",\"level\":\"";
+        buffer += levelNames[(int) record.level];
+        buffer += "\",\"category\":\"";
+        buffer += categoryNames[(int) record.category];
+        buffer += "\",\"action\":\"";
+        appendEscaped(buffer, QString::fromLatin1(record.action));
+        buffer += "\",\"peer\":\"";
+        appendEscaped(buffer, record.clientName);
+        buffer += "\",\"msg\":\"";
+        appendEscaped(buffer, record.msg.trimmed());
+        buffer += "\"}\n";
+    }
+
+    static void appendEscaped(QByteArray& buffer, const QString& string) {
+        static const char hexDigits[] = "0123456789abcdef";
+
+        for (char c : string.toUtf8()) {
+            switch (c) {
+                case '"':
+                    buffer += "\\\"";
+                    break;
+                case '\\':
+                    buffer += "\\\\";
+                    break;
+                case '\n':
+                    buffer += "\\n";
+                    break;
+                case '\r':
+                    buffer += "\\r";
+                    break;
+                case '\t':
+                    buffer += "\\t";
+                    break;
+                default:
+                    if (static_cast<quint8>(c) < 0x20) {
+                        buffer += "\\u00";
+                        buffer += hexDigits[c >> 4];
+                        buffer += hexDigits[c & 0xf];
+                    } else {
+                        buffer += c;
+                    }
+                    break;
+            }
+        }
+    }
+
+    LogQueue queue;
+    std::atomic<int> sampleCounters[LOG_CATEGORY_COUNT];
+    std::atomic<quint64> dropped;
+    std::atomic<bool> running;
+    std::thread flushThread;
+};
+
+static Logger& logger() {
+    static Logger instance;
+    return instance;
+}
+
+static LogCategory actionCategory(const char* action) {
+    const char* word = strrchr(action, ' ');
+    word = word ? word + 1 : action;
+
+    if (strcmp(word, "TEXT") == 0) {
+        return LogCategory::Text;
+    } else if (strcmp(word, "FILE") == 0 || strcmp(word, "REQUEST") == 0) {
+        return LogCategory::File;
+    } else if (strcmp(word, "BAD") == 0) {
+        return LogCategory::Bad;
+    }
+
+    return LogCategory::Control;
+}
+
+static LogLevel actionLevel(LogCategory category) {
+    return category == LogCategory::Bad ? LogLevel::Warning : LogLevel::Info;
+}
+
+void setLogLevel(LogLevel level) {
+    logger().level.store((int) level);
+}
+
+bool setLogLevel(const QString& name) {
+    LogLevel level;
+
+    if (!parseLogLevel(name, level)) {
+        return false;
     }
 
-    qDebug().noquote().nospace() << borderString << time.toString() << borderString;
-    qDebug().noquote().nospace() << action << " message " << where + ' ' << clientName << ":\n'"
-                                 << msg.trimmed() << "'";
-    qDebug().noquote().nospace() << borderString << borderString << borderString << Qt::endl;
+    setLogLevel(level);
+    return true;
+}
+
+void setLogSampling(LogCategory category, int rate) {
+    logger().sampleRates[(int) category].store(qMax(rate, 1));
+}
+
+LogLevel logLevel() {
+    return (LogLevel) logger().level.load();
+}
+
+QString logLevelName(LogLevel level) {
+    return QLatin1String(levelNames[(int) level]);
 }
 
-void messageLogger(const QString& action, const QTcpSocket* socket, const QString& msg) {
-    if (socket) {
-        messageLogger(action, socket->peerAddress().toString(), msg);
+int logSampling(LogCategory category) {
+    return logger().sampleRates[(int) category].load();
+}
+
+bool isLogged(const char* action) {
+    LogCategory category = actionCategory(action);
+
+    return logger().accepts(actionLevel(category), category);
+}
+
+void writeLog(const char* action, const QString& clientName, const QString& msg) {
+    LogCategory category = actionCategory(action);
+    LogRecord record{QDateTime::currentMSecsSinceEpoch(), action, actionLevel(category), category, clientName,
+                     msg};
+
+    logger().log(record);
+}
+
+void writeLog(const char* action, const QTcpSocket* socket, const QString& msg) {
+    LogCategory category = actionCategory(action);
+
+    // Peer address is only resolved for records that are actually written
+    if (!socket) {
+        return;
     }
+
+    LogRecord record{QDateTime::currentMSecsSinceEpoch(), action, actionLevel(category), category,
+                     socket->peerAddress().toString(), msg};
+    logger().log(record);
 }
@@ -6,7 +6,34 @@
 #include <QString>
 #include <QTcpSocket>
 
-void messageLogger(const QString& action, const QString& clientName, const QString& msg);
-void messageLogger(const QString& action, const QTcpSocket* socket, const QString& msg);
+enum class LogLevel { Debug, Info, Warning, Error, Off };
+
+// Category is taken from the last word of the action ("Received TEXT" is Text)
+enum class LogCategory { Control, Text, File, Bad };
+
+// Defaults come from WSTED_LOG_LEVEL (debug, info, warning, error, off),
+// WSTED_LOG_SAMPLE_TEXT and WSTED_LOG_SAMPLE_FILE (log every Nth event)
+void setLogLevel(LogLevel level);
+bool setLogLevel(const QString& name);
+void setLogSampling(LogCategory category, int rate);
+LogLevel logLevel();
+QString logLevelName(LogLevel level);
+int logSampling(LogCategory category);
+
+// Level and sampling check of one record, every call counts towards the sample rate
+bool isLogged(const char* action);
+
+// Records are queued and written by a background thread as JSON lines to stderr,
+// action must be a string literal because only the pointer is queued
+void writeLog(const char* action, const QString& clientName, const QString& msg);
+void writeLog(const char* action, const QTcpSocket* socket, const QString& msg);
+
+// messageLogger(action, clientName or socket, msg): msg is only formatted for records that are written
+#define messageLogger(action, ...)          \
+    do {                                    \
+        if (isLogged(action)) {             \
+            writeLog(action, __VA_ARGS__);  \
+        }                                   \
+    } while (0)
 
 #endif
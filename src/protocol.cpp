@@ -0,0 +1,513 @@
+#include "protocol.hpp"
+
+#include <QtEndian>
+#include <limits>
+
+namespace protocol {
+
+bool isFrameStart(char c) {
+    auto type = static_cast<quint8>(c);
+
+    return type >= static_cast<quint8>(FrameType::Message) &&
+           type <= static_cast<quint8>(FrameType::GetRoomState);
+}
+
+QByteArray commandName(FrameType type) {
+    switch (type) {
+        case FrameType::Message:
+            return "msg";
+        case FrameType::RoomId:
+            return "roomid";
+        case FrameType::UserId:
+            return "userid";
+        case FrameType::Users:
+            return "users";
+        case FrameType::Files:
+            return "files";
+        case FrameType::FileBegin:
+            return "sendfile";
+        case FrameType::FileChunk:
+            return "filechunk";
+        case FrameType::FileEnd:
+            return "fileend";
+        case FrameType::GetFile:
+            return "getfile";
+        case FrameType::FileResume:
+            return "fileresume";
+        case FrameType::FileOffset:
+            return "fileoffset";
+        case FrameType::GetFileRange:
+            return "getfilerange";
+        case FrameType::GetFileSlice:
+            return "getfileslice";
+        case FrameType::PutFileSlice:
+            return "putfileslice";
+        case FrameType::PackedChunk:
+            return "packedchunk";
+        case FrameType::RoomState:
+            return "roomstate";
+        case FrameType::RoomEvent:
+            return "roomevent";
+        case FrameType::GetRoomState:
+            return "getroomstate";
+    }
+
+    return "unknown";
+}
+
+QString describeFrame(const Frame& frame) {
+    QString description =
+        '[' + QString::fromLatin1(commandName(frame.type)) + ' ' + QString::fromUtf8(frame.room) + "] ";
+
+    if (frame.type == FrameType::FileBegin) {
+        QString fileName;
+        qint64 size = 0;
+
+        decodeFileBegin(frame.payload, fileName, size);
+        description += '\'' + fileName + "' (" + QString::number(size) + " bytes)";
+    } else if (frame.type == FrameType::FileResume || frame.type == FrameType::FileOffset ||
+               frame.type == FrameType::GetFileRange) {
+        QString fileName;
+        quint64 transferId = 0;
+        qint64 position = 0;
+
+        decodeTransfer(frame.payload, transferId, position, fileName);
+        description += '#' + QString::number(transferId, 16) + " @" + QString::number(position);
+
+        if (!fileName.isEmpty()) {
+            description += " '" + fileName + '\'';
+        }
+    } else if (frame.type == FrameType::GetFileSlice || frame.type == FrameType::PutFileSlice) {
+        QString fileName;
+        quint64 transferId = 0;
+        qint64 offset = 0;
+        qint64 length = 0;
+
+        decodeSlice(frame.payload, transferId, offset, length, fileName);
+        description += '#' + QString::number(transferId, 16) + " @" + QString::number(offset) + '+' +
+                       QString::number(length);
+
+        if (!fileName.isEmpty()) {
+            description += " '" + fileName + '\'';
+        }
+    } else if (frame.type == FrameType::FileChunk) {
+        description += "_RAW_DATA_ (" + QString::number(frame.payload.size()) + " bytes)";
+    } else if (frame.type == FrameType::PackedChunk) {
+        description += "_COMPRESSED_DATA_ (" + QString::number(frame.payload.size()) + " bytes)";
+    } else if (frame.type == FrameType::RoomState) {
+        QString users;
+        QString files;
+        quint64 sequence = 0;
+
+        decodeRoomState(frame.payload, sequence, users, files);
+        description += '#' + QString::number(sequence) + " users:" + users + " files:" + files;
+    } else if (frame.type == FrameType::RoomEvent) {
+        static const char* kindNames[] = {"?", "+user", "-user", "+file", "-file"};
+        RoomEventKind kind = RoomEventKind::UserJoined;
+        QString name;
+        quint64 sequence = 0;
+
+        if (decodeRoomEvent(frame.payload, sequence, kind, name)) {
+            description += '#' + QString::number(sequence) + ' ' + kindNames[static_cast<quint8>(kind)] +
+                           " '" + name + '\'';
+        }
+    } else {
+        description += QString::fromUtf8(frame.payload);
+    }
+
+    return description;
+}
+
+Command commandFromName(QByteArrayView name) {
+    Command command;
+    std::string_view expectedName;
+
+    // Case labels are hashed at compile time, a match is confirmed by comparing the name
+    switch (commandHash(std::string_view(name.data(), name.size()))) {
+        case commandHash("protocol"):
+            command = Command::Protocol;
+            expectedName = "protocol";
+            break;
+        case commandHash("join"):
+            command = Command::Join;
+            expectedName = "join";
+            break;
+        case commandHash("attach"):
+            command = Command::Attach;
+            expectedName = "attach";
+            break;
+        case commandHash("msg"):
+            command = Command::Msg;
+            expectedName = "msg";
+            break;
+        case commandHash("sendfile"):
+            command = Command::SendFile;
+            expectedName = "sendfile";
+            break;
+        case commandHash("getfile"):
+            command = Command::GetFile;
+            expectedName = "getfile";
+            break;
+        case commandHash("roomid"):
+            command = Command::RoomId;
+            expectedName = "roomid";
+            break;
+        case commandHash("userid"):
+            command = Command::UserId;
+            expectedName = "userid";
+            break;
+        case commandHash("users"):
+            command = Command::Users;
+            expectedName = "users";
+            break;
+        case commandHash("files"):
+            command = Command::Files;
+            expectedName = "files";
+            break;
+        default:
+            return Command::Unknown;
+    }
+
+    return std::string_view(name.data(), name.size()) == expectedName ? command : Command::Unknown;
+}
+
+static bool isLowerLetter(char c) {
+    return c >= 'a' && c <= 'z';
+}
+
+static bool isRoomChar(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+// Returns the position of ':' that ends the room ID starting at pos, or -1
+static qsizetype scanRoom(QByteArrayView line, qsizetype pos) {
+    qsizetype start = pos;
+
+    while (pos < line.size() && isRoomChar(line[pos])) {
+        pos++;
+    }
+
+    return pos > start && pos < line.size() && line[pos] == ':' ? pos : -1;
+}
+
+bool parseTextLine(QByteArrayView line, TextCommand& result) {
+    qsizetype pos;
+    qsizetype colon;
+
+    result = TextCommand{Command::Unknown, {}, {}, {}, {}, false};
+
+    if (line.size() < 2 || line[0] != '/') {
+        return false;
+    }
+
+    // Command name
+    pos = 1;
+
+    while (pos < line.size() && isLowerLetter(line[pos])) {
+        pos++;
+    }
+
+    if (pos == 1 || pos + 1 >= line.size() || line[pos] != ' ') {
+        return false;
+    }
+
+    result.name = line.sliced(1, pos - 1);
+    result.command = commandFromName(result.name);
+    pos++;
+
+    if (line[pos] == '\'') {
+        // Filename ends at the first quote followed by " room:"
+        qsizetype nameStart = pos + 1;
+
+        for (pos = nameStart; pos + 1 < line.size(); pos++) {
+            if (line[pos] == '\'' && line[pos + 1] == ' ' && scanRoom(line, pos + 2) != -1) {
+                break;
+            }
+        }
+
+        if (pos + 1 >= line.size()) {
+            return false;
+        }
+
+        result.fileName = line.sliced(nameStart, pos - nameStart);
+        result.hasFileName = true;
+        pos += 2;
+    }
+
+    colon = scanRoom(line, pos);
+    if (colon == -1) {
+        return false;
+    }
+
+    result.room = line.sliced(pos, colon - pos);
+    result.data = line.sliced(colon + 1);
+
+    return true;
+}
+
+QByteArrayView readLine(QIODevice* device, QByteArray& buffer) {
+    qint64 length = 0;
+
+    if (buffer.size() < 4096) {
+        buffer.resize(4096);
+    }
+
+    // Buffer is reused between calls and only grows for lines longer than any seen before
+    forever {
+        qint64 bytesRead = device->readLine(buffer.data() + length, buffer.size() - length);
+
+        if (bytesRead <= 0) {
+            break;
+        }
+
+        length += bytesRead;
+
+        if (buffer[length - 1] == '\n') {
+            break;
+        }
+
+        buffer.resize(buffer.size() * 2);
+    }
+
+    return QByteArrayView(buffer.constData(), length).trimmed();
+}
+
+QByteArray encodeFrameHeader(FrameType type, const QByteArray& room, quint32 payloadLength) {
+    QByteArray header;
+
+    Q_ASSERT(room.size() <= MAX_ROOM_ID_LENGTH);
+    header.reserve(FRAME_HEADER_SIZE + room.size());
+
+    header.append(static_cast<char>(type));
+    header.append(static_cast<char>(room.size()));
+
+    char length[4];
+    qToBigEndian<quint32>(payloadLength, length);
+    header.append(length, sizeof(length));
+
+    header.append(room);
+
+    return header;
+}
+
+QByteArray encodeFrame(FrameType type, const QByteArray& room, const QByteArray& payload) {
+    QByteArray frame;
+    frame.reserve(FRAME_HEADER_SIZE + room.size() + payload.size());
+
+    frame.append(encodeFrameHeader(type, room, payload.size()));
+    frame.append(payload);
+
+    return frame;
+}
+
+QByteArray encodeMessage(int version, FrameType type, const QByteArray& room, const QByteArray& payload) {
+    if (version >= FRAMED_VERSION) {
+        return encodeFrame(type, room, payload);
+    } else if (type == FrameType::Message) {
+        return payload + '\n';
+    }
+
+    return '/' + commandName(type) + ' ' + room + ':' + payload + '\n';
+}
+
+ReadResult readFrame(QIODevice* device, Frame& frame) {
+    char header[FRAME_HEADER_SIZE];
+
+    if (device->peek(header, FRAME_HEADER_SIZE) < FRAME_HEADER_SIZE) {
+        return ReadResult::Incomplete;
+    }
+
+    auto roomLength = static_cast<quint8>(header[1]);
+    auto payloadLength = qFromBigEndian<quint32>(header + 2);
+
+    if (!isFrameStart(header[0]) || roomLength > MAX_ROOM_ID_LENGTH || payloadLength > MAX_FRAME_PAYLOAD) {
+        return ReadResult::Error;
+    }
+
+    if (device->bytesAvailable() < FRAME_HEADER_SIZE + roomLength + (qint64) payloadLength) {
+        return ReadResult::Incomplete;
+    }
+
+    device->skip(FRAME_HEADER_SIZE);
+
+    frame.type = static_cast<FrameType>(header[0]);
+    frame.room = device->read(roomLength);
+    frame.payload = device->read(payloadLength);
+
+    return ReadResult::Ok;
+}
+
+QByteArray encodeFileBegin(const QString& fileName, qint64 size) {
+    QByteArray payload;
+
+    char length[8];
+    qToBigEndian<qint64>(size, length);
+    payload.append(length, sizeof(length));
+
+    payload.append(fileName.toUtf8());
+
+    return payload;
+}
+
+bool decodeFileBegin(const QByteArray& payload, QString& fileName, qint64& size) {
+    if (payload.size() < 8) {
+        return false;
+    }
+
+    size = qFromBigEndian<qint64>(payload.constData());
+    fileName = QString::fromUtf8(payload.mid(8));
+
+    return size >= 0;
+}
+
+QByteArray encodeTransfer(quint64 transferId, qint64 position, const QString& fileName) {
+    QByteArray payload;
+
+    char number[8];
+    qToBigEndian<quint64>(transferId, number);
+    payload.append(number, sizeof(number));
+    qToBigEndian<qint64>(position, number);
+    payload.append(number, sizeof(number));
+
+    payload.append(fileName.toUtf8());
+
+    return payload;
+}
+
+bool decodeTransfer(const QByteArray& payload, quint64& transferId, qint64& position, QString& fileName) {
+    qsizetype end;
+
+    if (payload.size() < 16) {
+        return false;
+    }
+
+    transferId = qFromBigEndian<quint64>(payload.constData());
+    position = qFromBigEndian<qint64>(payload.constData() + 8);
+
+    // Filenames never contain '\0', a content hash may follow it
+    end = payload.indexOf('\0', 16);
+    fileName = QString::fromUtf8(payload.mid(16, end == -1 ? -1 : end - 16));
+
+    return position >= 0;
+}
+
+QByteArray encodeResume(quint64 transferId, qint64 size, const QString& fileName, const QByteArray& hash) {
+    QByteArray payload = encodeTransfer(transferId, size, fileName);
+
+    if (!hash.isEmpty()) {
+        payload.append('\0');
+        payload.append(hash);
+    }
+
+    return payload;
+}
+
+bool decodeResume(const QByteArray& payload, quint64& transferId, qint64& size, QString& fileName,
+                  QByteArray& hash) {
+    qsizetype separator = payload.indexOf('\0', 16);
+
+    if (!decodeTransfer(payload, transferId, size, fileName)) {
+        return false;
+    }
+
+    hash = separator == -1 ? QByteArray() : payload.mid(separator + 1);
+
+    return hash.isEmpty() || hash.size() == CONTENT_HASH_SIZE;
+}
+
+QByteArray encodeSlice(quint64 transferId, qint64 offset, qint64 length, const QString& fileName) {
+    QByteArray payload = encodeTransfer(transferId, offset);
+
+    char number[8];
+    qToBigEndian<qint64>(length, number);
+    payload.append(number, sizeof(number));
+
+    payload.append(fileName.toUtf8());
+
+    return payload;
+}
+
+bool decodeSlice(const QByteArray& payload, quint64& transferId, qint64& offset, qint64& length,
+                 QString& fileName) {
+    if (payload.size() < 24) {
+        return false;
+    }
+
+    transferId = qFromBigEndian<quint64>(payload.constData());
+    offset = qFromBigEndian<qint64>(payload.constData() + 8);
+    length = qFromBigEndian<qint64>(payload.constData() + 16);
+    fileName = QString::fromUtf8(payload.mid(24));
+
+    // End of the range is computed by the receiver, it has to fit in qint64
+    return offset >= 0 && length >= 0 && length <= std::numeric_limits<qint64>::max() - offset;
+}
+
+QByteArray encodeRoomState(quint64 sequence, const QString& users, const QString& files) {
+    QByteArray payload;
+    QByteArray userList = users.toUtf8();
+
+    char number[8];
+    qToBigEndian<quint64>(sequence, number);
+    payload.append(number, sizeof(number));
+    qToBigEndian<quint32>(userList.size(), number);
+    payload.append(number, 4);
+
+    payload.append(userList);
+    payload.append(files.toUtf8());
+
+    return payload;
+}
+
+bool decodeRoomState(const QByteArray& payload, quint64& sequence, QString& users, QString& files) {
+    quint32 userListSize;
+
+    if (payload.size() < 12) {
+        return false;
+    }
+
+    sequence = qFromBigEndian<quint64>(payload.constData());
+    userListSize = qFromBigEndian<quint32>(payload.constData() + 8);
+
+    if (userListSize > payload.size() - 12) {
+        return false;
+    }
+
+    users = QString::fromUtf8(payload.mid(12, userListSize));
+    files = QString::fromUtf8(payload.mid(12 + userListSize));
+
+    return true;
+}
+
+QByteArray encodeRoomEvent(quint64 sequence, RoomEventKind kind, const QString& name) {
+    QByteArray payload;
+
+    char number[8];
+    qToBigEndian<quint64>(sequence, number);
+    payload.append(number, sizeof(number));
+    payload.append(static_cast<char>(kind));
+
+    payload.append(name.toUtf8());
+
+    return payload;
+}
+
+bool decodeRoomEvent(const QByteArray& payload, quint64& sequence, RoomEventKind& kind, QString& name) {
+    if (payload.size() < 9) {
+        return false;
+    }
+
+    auto kindValue = static_cast<quint8>(payload[8]);
+
+    if (kindValue < static_cast<quint8>(RoomEventKind::UserJoined) ||
+        kindValue > static_cast<quint8>(RoomEventKind::FileRemoved)) {
+        return false;
+    }
+
+    sequence = qFromBigEndian<quint64>(payload.constData());
+    kind = static_cast<RoomEventKind>(kindValue);
+    name = QString::fromUtf8(payload.mid(9));
+
+    return true;
+}
+
+}  // namespace protocol
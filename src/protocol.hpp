@@ -0,0 +1,156 @@
+#ifndef PROTOCOL_HPP
+#define PROTOCOL_HPP
+
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QIODevice>
+#include <QString>
+#include <string_view>
+
+namespace protocol {
+
+// Version 1 is the original newline-delimited text protocol ("/command room:data").
+// Version 2 adds length-prefixed binary frames, it is negotiated with "/protocol 2:" before "/join".
+// Version 3 adds transfer IDs and offsets, so interrupted uploads and downloads can be resumed.
+// Version 4 adds data connections ("/attach room:user") that move byte ranges of one file in parallel.
+// Version 5 adds compressed file chunks, the codec is negotiated with "/protocol 5:zstd,zlib".
+// Version 6 replaces the user and file lists sent on every change with numbered room events, the whole
+// state is sent on join and when the client notices a gap in the numbers.
+// Version 7 lets FileResume carry the SHA-256 of the file, content the server already stores is not sent.
+constexpr int TEXT_VERSION = 1;
+constexpr int FRAMED_VERSION = 2;
+constexpr int RESUMABLE_VERSION = 3;
+constexpr int STRIPED_VERSION = 4;
+constexpr int COMPRESSED_VERSION = 5;
+constexpr int EVENTS_VERSION = 6;
+constexpr int CONTENT_HASH_VERSION = 7;
+constexpr int CURRENT_VERSION = CONTENT_HASH_VERSION;
+
+// Frame types never collide with the first byte of a text line, so both can share one stream
+enum class FrameType : quint8 {
+    Message = 0x10,    // client: chat text, server: "hh:mm user:text" line
+    RoomId = 0x11,     // payload: username
+    UserId = 0x12,     // payload: username
+    Users = 0x13,      // payload: usernames separated by ','
+    Files = 0x14,      // payload: filenames separated by '/'
+    FileBegin = 0x15,  // payload: file size (8 bytes, big-endian), filename
+    FileChunk = 0x16,  // payload: raw file contents, follows FileBegin
+    FileEnd = 0x17,    // no payload, closes the file opened by FileBegin
+    GetFile = 0x18,    // payload: filename
+
+    // Version 3, payloads are encoded with encodeTransfer()
+    FileResume = 0x19,    // client: upload ID, file size, filename; answered with FileOffset
+    FileOffset = 0x1A,    // server: transfer ID, offset the data continues from
+    GetFileRange = 0x1B,  // client: download ID of the partial file (0 if none), its size, filename
+
+    // Version 4, payloads are encoded with encodeSlice()
+    GetFileSlice = 0x1C,  // client: download ID (0 if unknown), offset, length, filename
+    PutFileSlice = 0x1D,  // client: upload ID, offset, length; FileChunks follow, answered with FileOffset
+
+    // Version 5, payload is encoded with compression::compressChunk()
+    PackedChunk = 0x1E,  // codec, raw size, compressed file contents; used in place of FileChunk
+
+    // Version 6, payloads are encoded with encodeRoomState() and encodeRoomEvent()
+    RoomState = 0x1F,     // server: sequence number of the last event, user list, file list
+    RoomEvent = 0x20,     // server: sequence number, RoomEventKind, username or filename
+    GetRoomState = 0x21,  // client: no payload, answered with RoomState
+
+    // Version 7 adds the content hash to FileResume (encodeResume()), FileOffset is the file size when the
+    // server already stores that content
+};
+
+// Changes of a room sent in RoomEvent frames, in place of Users and Files
+enum class RoomEventKind : quint8 { UserJoined = 1, UserLeft = 2, FileAdded = 3, FileRemoved = 4 };
+
+// Header: type (1 byte), room length (1 byte), payload length (4 bytes, big-endian)
+constexpr int FRAME_HEADER_SIZE = 6;
+constexpr quint32 MAX_FRAME_PAYLOAD = 1 << 20;
+
+// Room IDs are sent in frame headers, longer IDs are rejected on join
+constexpr int MAX_ROOM_ID_LENGTH = 64;
+
+// Files are streamed in chunks, the size is a multiple of 3 so base64 chunks can be concatenated
+constexpr qint64 FILE_CHUNK_SIZE = 3 << 14;
+constexpr qint64 FILE_HIGH_WATER_MARK = FILE_CHUNK_SIZE * 8;
+
+// Header of a "/sendfile" line has to fit these bounds before its data is decoded
+constexpr int MAX_FILE_NAME_LENGTH = 255;
+
+// Text protocol servers buffer a whole "/sendfile" line before decoding it
+constexpr qint64 MAX_TEXT_FILE_SIZE = (1 << 20) * 512LL;
+
+struct Frame {
+    FrameType type;
+    QByteArray room;
+    QByteArray payload;
+};
+
+enum class ReadResult { Ok, Incomplete, Error };
+
+// Commands of the text protocol: "/command room:data" or "/command 'filename' room:data"
+enum class Command { Unknown, Protocol, Join, Attach, Msg, SendFile, GetFile, RoomId, UserId, Users, Files };
+
+// Views point into the parsed line, nothing is copied
+struct TextCommand {
+    Command command;
+    QByteArrayView name;
+    QByteArrayView fileName;
+    QByteArrayView room;
+    QByteArrayView data;
+    bool hasFileName;
+};
+
+constexpr quint32 commandHash(std::string_view name) {
+    quint32 hash = 2166136261u;  // FNV-1a
+
+    for (char c : name) {
+        hash = (hash ^ static_cast<quint8>(c)) * 16777619u;
+    }
+
+    return hash;
+}
+
+Command commandFromName(QByteArrayView name);
+bool parseTextLine(QByteArrayView line, TextCommand& result);
+QByteArrayView readLine(QIODevice* device, QByteArray& buffer);
+
+bool isFrameStart(char c);
+QByteArray commandName(FrameType type);
+QString describeFrame(const Frame& frame);
+
+QByteArray encodeFrameHeader(FrameType type, const QByteArray& room, quint32 payloadLength);
+QByteArray encodeFrame(FrameType type, const QByteArray& room, const QByteArray& payload = QByteArray());
+ReadResult readFrame(QIODevice* device, Frame& frame);
+
+// Frame for version 2 peers, "/command room:data" line (or bare line for Message) for version 1
+QByteArray encodeMessage(int version, FrameType type, const QByteArray& room, const QByteArray& payload);
+
+QByteArray encodeFileBegin(const QString& fileName, qint64 size);
+bool decodeFileBegin(const QByteArray& payload, QString& fileName, qint64& size);
+
+// Transfer ID (8 bytes, big-endian), size or offset (8 bytes, big-endian), optional filename
+QByteArray encodeTransfer(quint64 transferId, qint64 position, const QString& fileName = QString());
+bool decodeTransfer(const QByteArray& payload, quint64& transferId, qint64& position, QString& fileName);
+
+// Same as encodeTransfer(), followed by '\0' and the SHA-256 of the file unless hash is empty
+constexpr int CONTENT_HASH_SIZE = 32;
+QByteArray encodeResume(quint64 transferId, qint64 size, const QString& fileName, const QByteArray& hash);
+bool decodeResume(const QByteArray& payload, quint64& transferId, qint64& size, QString& fileName,
+                  QByteArray& hash);
+
+// Transfer ID, offset, length (8 bytes each, big-endian), optional filename
+QByteArray encodeSlice(quint64 transferId, qint64 offset, qint64 length, const QString& fileName = QString());
+bool decodeSlice(const QByteArray& payload, quint64& transferId, qint64& offset, qint64& length,
+                 QString& fileName);
+
+// Sequence number (8 bytes, big-endian), user list length (4 bytes, big-endian), user list, file list
+QByteArray encodeRoomState(quint64 sequence, const QString& users, const QString& files);
+bool decodeRoomState(const QByteArray& payload, quint64& sequence, QString& users, QString& files);
+
+// Sequence number (8 bytes, big-endian), kind (1 byte), name
+QByteArray encodeRoomEvent(quint64 sequence, RoomEventKind kind, const QString& name);
+bool decodeRoomEvent(const QByteArray& payload, quint64& sequence, RoomEventKind& kind, QString& name);
+
+}  // namespace protocol
+
+#endif  // PROTOCOL_HPP
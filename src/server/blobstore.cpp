@@ -0,0 +1,197 @@
+#include "blobstore.hpp"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+
+BlobStore::BlobStore(const QString& _path, DiskPool* _disks)
+    : storePath(_path), disks(_disks), nextUpload(0) {
+    QString cleanPath = QDir::cleanPath(storePath);
+    QFileInfo info(cleanPath);
+    QDir dir(storePath);
+
+    // Catalogs live in memory, blobs of a previous run can't be referenced again. They are moved aside and
+    // removed in the background together with what an interrupted run has left there.
+    if (dir.exists()) {
+        QString oldPath = cleanPath + ".old-" + QString::number(QDateTime::currentMSecsSinceEpoch());
+
+        qDebug().nospace() << "Moved directory " << storePath << " to " << oldPath << ": "
+                           << dir.rename(cleanPath, oldPath);
+    }
+
+    qDebug().nospace() << "Created directory " << storePath << ": " << dir.mkpath(storePath);
+
+    for (const auto& name : info.dir().entryList({info.fileName() + ".old-*"}, QDir::Dirs)) {
+        QString oldPath = info.dir().filePath(name);
+
+        disks->run([oldPath] {
+            bool isRemoved = QDir(oldPath).removeRecursively();
+
+            qDebug().nospace() << "Removed directory " << oldPath << ": " << isRemoved;
+        });
+    }
+}
+
+BlobStore::~BlobStore() {
+    qDeleteAll(mappings);
+}
+
+QString BlobStore::temporaryPath() {
+    return storePath + "upload-" + QString::number(nextUpload++) + ".part";
+}
+
+QString BlobStore::path(const QByteArray& hash) {
+    QMutexLocker locker(&mutex);
+
+    return blobs.value(hash).path;
+}
+
+bool BlobStore::commit(const QString& temporaryPath, const QByteArray& hash) {
+    QString blobPath;
+    int refCount = 0;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        auto it = blobs.find(hash);
+        if (it != blobs.end()) {
+            refCount = ++it.value().refCount;
+        }
+    }
+
+    if (refCount > 0) {
+        // Same content is already stored, the new copy is not needed
+        QFile::remove(temporaryPath);
+
+        qDebug() << "Deduplicated upload" << hash.toHex() << "references:" << refCount;
+        return true;
+    }
+
+    // Mutex is not held while renaming, workers only wait for the bookkeeping
+    blobPath = storePath + QString::fromLatin1(hash.toHex()) + '-' + QString::number(nextUpload++);
+
+    if (!QFile::rename(temporaryPath, blobPath)) {
+        qDebug() << "Failed to store blob" << hash.toHex();
+
+        QFile::remove(temporaryPath);
+        return false;
+    }
+
+    {
+        QMutexLocker locker(&mutex);
+        StoredBlob& blob = blobs[hash];
+
+        if (blob.refCount == 0) {
+            blob.path = blobPath;
+            blob.refCount = 1;
+            return true;
+        }
+
+        // Same content was committed by another upload meanwhile
+        refCount = ++blob.refCount;
+    }
+
+    QFile::remove(blobPath);
+
+    qDebug() << "Deduplicated upload" << hash.toHex() << "references:" << refCount;
+    return true;
+}
+
+bool BlobStore::acquire(const QByteArray& hash) {
+    QMutexLocker locker(&mutex);
+
+    auto it = blobs.find(hash);
+    if (it == blobs.end()) {
+        return false;
+    }
+
+    it.value().refCount++;
+    return true;
+}
+
+void BlobStore::release(const QByteArray& hash) {
+    QMutexLocker locker(&mutex);
+    QString blobPath;
+
+    auto it = blobs.find(hash);
+    if (it == blobs.end()) {
+        return;
+    }
+
+    if (--it.value().refCount == 0) {
+        blobPath = it.value().path;
+        blobs.erase(it);
+
+        // Open downloads keep reading the unlinked file until they finish
+        disks->run([hash, blobPath] {
+            qDebug().nospace() << "Removed blob " << hash.toHex() << ": " << QFile::remove(blobPath);
+        });
+    }
+}
+
+const MappedBlob* BlobStore::acquireMapping(const QByteArray& hash) {
+    MappedBlob* mapping;
+    MappedBlob* other;
+    uchar* data;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        mapping = mappings.value(hash, nullptr);
+
+        if (mapping) {
+            mapping->refCount++;
+            return mapping;
+        }
+
+        mapping = new MappedBlob;
+        mapping->file.setFileName(blobs.value(hash).path);
+    }
+
+    // Empty files can't be mapped, and neither can files larger than the address space
+    if (!mapping->file.open(QIODevice::ReadOnly) || mapping->file.size() == 0 ||
+        !(data = mapping->file.map(0, mapping->file.size()))) {
+        qDebug() << "Failed to map blob" << hash.toHex() << mapping->file.errorString();
+
+        delete mapping;
+        return nullptr;
+    }
+
+    mapping->data = reinterpret_cast<const char*>(data);
+    mapping->size = mapping->file.size();
+    mapping->refCount = 1;
+
+    {
+        QMutexLocker locker(&mutex);
+
+        other = mappings.value(hash, nullptr);
+
+        if (!other) {
+            mappings.insert(hash, mapping);
+            return mapping;
+        }
+
+        // Another download has mapped the blob meanwhile
+        other->refCount++;
+    }
+
+    delete mapping;
+    return other;
+}
+
+void BlobStore::releaseMapping(const QByteArray& hash) {
+    QMutexLocker locker(&mutex);
+
+    auto it = mappings.find(hash);
+    if (it == mappings.end()) {
+        return;
+    }
+
+    // Mapping of a removed blob stays valid until its last download has finished
+    if (--it.value()->refCount == 0) {
+        delete it.value();
+        mappings.erase(it);
+    }
+}
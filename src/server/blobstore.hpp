@@ -0,0 +1,56 @@
+#ifndef BLOBSTORE_HPP
+#define BLOBSTORE_HPP
+
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+#include <atomic>
+
+#include "diskpool.hpp"
+
+// Read-only mapping of a blob, one per blob no matter how many clients download it
+struct MappedBlob {
+    QFile file;
+    const char* data;
+    qint64 size;
+    int refCount;  // downloads using the mapping
+};
+
+struct StoredBlob {
+    QString path;  // content that is uploaded again after its removal gets a new file
+    int refCount;
+};
+
+// Uploaded files are stored once per content hash, rooms only keep name -> hash catalogs.
+// Shared by all workers, every room that lists a blob holds one reference to it. Files are committed
+// by DiskPool tasks and removed in the background, the workers only take the mutex.
+class BlobStore {
+   public:
+    BlobStore(const QString& _path, DiskPool* _disks);
+    ~BlobStore();
+
+    QString temporaryPath();
+    QString path(const QByteArray& hash);
+
+    // Blocks on the filesystem, called from DiskPool tasks
+    bool commit(const QString& temporaryPath, const QByteArray& hash);
+    const MappedBlob* acquireMapping(const QByteArray& hash);
+
+    // Another reference to content that is already stored, false if there is none
+    bool acquire(const QByteArray& hash);
+    void release(const QByteArray& hash);
+    void releaseMapping(const QByteArray& hash);
+
+   private:
+    QString storePath;
+    DiskPool* disks;
+    std::atomic<quint64> nextUpload;
+
+    QMutex mutex;
+    QHash<QByteArray, StoredBlob> blobs;
+    QHash<QByteArray, MappedBlob*> mappings;
+};
+
+#endif  // BLOBSTORE_HPP
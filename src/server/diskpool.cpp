@@ -0,0 +1,29 @@
+#include "diskpool.hpp"
+
+DiskPool::DiskPool(int threadCount) {
+    pool.setMaxThreadCount(threadCount);
+}
+
+DiskPool::~DiskPool() {
+    pool.waitForDone();
+}
+
+void DiskPool::run(std::function<void()> work) {
+    pool.start(std::move(work));
+}
+
+void DiskPool::run(QObject* context, std::function<void()> work, std::function<void()> done) {
+    pool.start([context, work = std::move(work), done = std::move(done)] {
+        work();
+        QMetaObject::invokeMethod(context, done, Qt::QueuedConnection);
+    });
+}
+
+void DiskPool::waitForDone() {
+    pool.waitForDone();
+}
+
+bool DiskPool::isIdle() const {
+    // Tasks are only queued while every thread is busy
+    return pool.activeThreadCount() == 0;
+}
@@ -0,0 +1,29 @@
+#ifndef DISKPOOL_HPP
+#define DISKPOOL_HPP
+
+#include <QObject>
+#include <QThreadPool>
+#include <functional>
+
+// Threads for blocking filesystem calls, so a slow disk stalls the transfers waiting for it instead of
+// every connection of a worker. Shared by all workers and the BlobStore.
+class DiskPool {
+   public:
+    explicit DiskPool(int threadCount);
+    ~DiskPool();
+
+    // Work nobody waits for, e.g. removing a file
+    void run(std::function<void()> work);
+
+    // Done is posted to the thread of context once work has finished. Context has to outlive the task, a
+    // Worker waits for the pool in its destructor until no more completions follow.
+    void run(QObject* context, std::function<void()> work, std::function<void()> done);
+
+    void waitForDone();
+    bool isIdle() const;  // no task is running or queued
+
+   private:
+    QThreadPool pool;
+};
+
+#endif  // DISKPOOL_HPP
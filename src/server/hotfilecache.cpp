@@ -0,0 +1,74 @@
+#include "hotfilecache.hpp"
+
+#include "metrics.hpp"
+
+HotFileCache::HotFileCache(qint64 _budget) : budget(_budget), bytes(0) {}
+
+QString HotFileCache::key(const QString& roomId, const QString& fileName, int variant) {
+    // Room IDs have no '/' and the variant is a number, so the key can't be ambiguous
+    return roomId + '/' + fileName + '/' + QString::number(variant);
+}
+
+QByteArray HotFileCache::find(const QString& roomId, const QString& fileName, int variant) {
+    auto it = index.constFind(key(roomId, fileName, variant));
+
+    if (it == index.constEnd()) {
+        Metrics::instance().hotFileMisses++;
+        return QByteArray();
+    }
+
+    Metrics::instance().hotFileHits++;
+
+    // Entry moves to the front without being copied
+    entries.splice(entries.begin(), entries, it.value());
+
+    return it.value()->data;
+}
+
+void HotFileCache::insert(const QString& roomId, const QString& fileName, int variant,
+                          const QByteArray& data) {
+    QString entryKey = key(roomId, fileName, variant);
+    auto it = index.find(entryKey);
+
+    if (it != index.end()) {
+        remove(it.value());
+    }
+
+    if (data.size() > budget) {
+        return;
+    }
+
+    while (bytes + data.size() > budget) {
+        remove(std::prev(entries.end()));
+    }
+
+    entries.push_front(Entry{entryKey, roomId, data});
+    index.insert(entryKey, entries.begin());
+
+    bytes += data.size();
+    Metrics::instance().hotFileBytes += data.size();
+}
+
+void HotFileCache::removeRoom(const QString& roomId) {
+    for (auto it = entries.begin(); it != entries.end();) {
+        auto next = std::next(it);
+
+        if (it->roomId == roomId) {
+            remove(it);
+        }
+
+        it = next;
+    }
+}
+
+qint64 HotFileCache::size() const {
+    return bytes;
+}
+
+void HotFileCache::remove(std::list<Entry>::iterator it) {
+    bytes -= it->data.size();
+    Metrics::instance().hotFileBytes -= it->data.size();
+
+    index.remove(it->key);
+    entries.erase(it);
+}
@@ -0,0 +1,39 @@
+#ifndef HOTFILECACHE_HPP
+#define HOTFILECACHE_HPP
+
+#include <QByteArray>
+#include <QHash>
+#include <QString>
+#include <list>
+
+// Wire form of small files as last sent to a client, evicted least recently used first when the byte
+// budget is exceeded. Every worker has its own, rooms and therefore their files are pinned to one worker.
+class HotFileCache {
+   public:
+    explicit HotFileCache(qint64 _budget);
+
+    // Variant tells apart encodings of one file, e.g. base64 line, frames, compressed frames
+    QByteArray find(const QString& roomId, const QString& fileName, int variant);
+    void insert(const QString& roomId, const QString& fileName, int variant, const QByteArray& data);
+    void removeRoom(const QString& roomId);
+
+    qint64 size() const;
+
+   private:
+    struct Entry {
+        QString key;
+        QString roomId;
+        QByteArray data;
+    };
+
+    static QString key(const QString& roomId, const QString& fileName, int variant);
+    void remove(std::list<Entry>::iterator it);
+
+    qint64 budget;
+    qint64 bytes;
+
+    std::list<Entry> entries;  // most recently used first
+    QHash<QString, std::list<Entry>::iterator> index;
+};
+
+#endif  // HOTFILECACHE_HPP
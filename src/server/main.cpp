@@ -1,7 +1,9 @@
+#include <QThread>
 #include <QtCore/QCoreApplication>
 #include <iomanip>
 #include <iostream>
 
+#include "metricsserver.hpp"
 #include "server.hpp"
 
 #define DEFAULT_PORT 8044
@@ -10,30 +12,55 @@ void usage(std::string exe) {
     std::cout << std::left;
 
     std::cout << "Usage: " << std::endl;
-    std::cout << exe << std::setw(32) << " PORT"
-              << "use custom port (1024-49151)" << std::endl;
-    std::cout << std::setw(32 + exe.size()) << exe << "use default port (" << DEFAULT_PORT << ")"
+    std::cout << exe << std::setw(32) << " PORT [THREADS [METRICS_PORT]]"
+              << "use custom port (1024-49151), number of worker threads and metrics port (0 disables)"
               << std::endl;
+    std::cout << std::setw(32 + exe.size()) << exe << "use default port (" << DEFAULT_PORT
+              << "), one worker thread per core and metrics on port + 1" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
     int port;
+    int threadCount;
+    int metricsPort;
 
-    if (argc == 1) {
-        port = DEFAULT_PORT;
-    } else if (argc == 2) {
-        auto newPort = std::atoi(argv[1]);
-        port = newPort >= 1024 && newPort <= 49151 ? newPort : DEFAULT_PORT;
-    } else {
+    port = DEFAULT_PORT;
+    threadCount = QThread::idealThreadCount();
+
+    if (argc > 4) {
         std::cout << "Too many arguments" << std::endl << std::endl;
 
         usage(argv[0]);
         exit(EXIT_FAILURE);
     }
 
+    if (argc >= 2) {
+        auto newPort = std::atoi(argv[1]);
+        port = newPort >= 1024 && newPort <= 49151 ? newPort : DEFAULT_PORT;
+    }
+
+    metricsPort = port + 1;
+
+    if (argc >= 3) {
+        auto newThreadCount = std::atoi(argv[2]);
+        threadCount = newThreadCount >= 1 && newThreadCount <= 1024 ? newThreadCount : threadCount;
+    }
+
+    if (argc == 4) {
+        auto newMetricsPort = std::atoi(argv[3]);
+        metricsPort = newMetricsPort == 0 || (newMetricsPort >= 1024 && newMetricsPort <= 49151)
+                          ? newMetricsPort
+                          : metricsPort;
+    }
+
     QCoreApplication a(argc, argv);
 
-    Server s(port);
+    Server s(port, threadCount);
+
+    if (metricsPort != 0) {
+        // Metrics are served from the main thread, workers only update atomics
+        new MetricsServer(metricsPort, &s);
+    }
 
     return a.exec();
 }
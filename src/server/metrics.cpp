@@ -0,0 +1,134 @@
+#include "metrics.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+static const qint64* bucketBounds() {
+    static qint64 bounds[LATENCY_BUCKET_COUNT];
+    static bool isInitialized = [] {
+        for (int i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+            bounds[i] = std::llround(1000 * std::pow(2.0, i / 4.0));
+        }
+
+        return true;
+    }();
+
+    Q_UNUSED(isInitialized);
+    return bounds;
+}
+
+static const char* commandNames[METRIC_COMMAND_COUNT] = {"protocol",  "join",    "msg",   "sendfile",
+                                                         "filechunk", "fileend", "getfile", "other"};
+
+LatencyHistogram::LatencyHistogram() : count(0), sum(0) {
+    for (auto& bucket : buckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+}
+
+void LatencyHistogram::record(qint64 nanoseconds) {
+    const qint64* bounds = bucketBounds();
+    auto bucket = std::lower_bound(bounds, bounds + LATENCY_BUCKET_COUNT, nanoseconds) - bounds;
+
+    buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    count.fetch_add(1, std::memory_order_relaxed);
+    sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+}
+
+void LatencyHistogram::appendPrometheus(QByteArray& out, const QByteArray& name,
+                                        const QByteArray& labels) const {
+    const qint64* bounds = bucketBounds();
+    quint64 cumulative = 0;
+
+    // Prometheus buckets are cumulative and measured in seconds
+    for (int i = 0; i <= LATENCY_BUCKET_COUNT; i++) {
+        QByteArray bound = i < LATENCY_BUCKET_COUNT ? QByteArray::number(bounds[i] / 1e9, 'g', 6) : "+Inf";
+        cumulative += buckets[i].load(std::memory_order_relaxed);
+
+        out += name + "_bucket{" + labels + ",le=\"" + bound + "\"} " + QByteArray::number(cumulative) + '\n';
+    }
+
+    out += name + "_sum{" + labels + "} " + QByteArray::number(sum.load() / 1e9, 'g', 9) + '\n';
+    out += name + "_count{" + labels + "} " + QByteArray::number(count.load()) + '\n';
+}
+
+Metrics::Metrics()
+    : connections(0),
+      bytesReceived(0),
+      bytesSent(0),
+      hotFileHits(0),
+      hotFileMisses(0),
+      droppedOutputs(0),
+      droppedOutputBytes(0),
+      slowClientDisconnects(0),
+      clients(0),
+      rooms(0),
+      queuedWriteBytes(0),
+      hotFileBytes(0) {}
+
+Metrics& Metrics::instance() {
+    static Metrics metrics;
+    return metrics;
+}
+
+QByteArray Metrics::toPrometheus() const {
+    QByteArray out;
+
+    out += "# HELP wsted_connections_total Accepted client connections.\n";
+    out += "# TYPE wsted_connections_total counter\n";
+    out += "wsted_connections_total " + QByteArray::number(connections.load()) + '\n';
+
+    out += "# HELP wsted_received_bytes_total Bytes received from clients.\n";
+    out += "# TYPE wsted_received_bytes_total counter\n";
+    out += "wsted_received_bytes_total " + QByteArray::number(bytesReceived.load()) + '\n';
+
+    out += "# HELP wsted_sent_bytes_total Bytes sent to clients.\n";
+    out += "# TYPE wsted_sent_bytes_total counter\n";
+    out += "wsted_sent_bytes_total " + QByteArray::number(bytesSent.load()) + '\n';
+
+    out += "# HELP wsted_hot_file_hits_total Downloads sent from the hot-file cache.\n";
+    out += "# TYPE wsted_hot_file_hits_total counter\n";
+    out += "wsted_hot_file_hits_total " + QByteArray::number(hotFileHits.load()) + '\n';
+
+    out += "# HELP wsted_hot_file_misses_total Small file downloads not found in the hot-file cache.\n";
+    out += "# TYPE wsted_hot_file_misses_total counter\n";
+    out += "wsted_hot_file_misses_total " + QByteArray::number(hotFileMisses.load()) + '\n';
+
+    out += "# HELP wsted_dropped_outputs_total Notices and room updates dropped for slow clients.\n";
+    out += "# TYPE wsted_dropped_outputs_total counter\n";
+    out += "wsted_dropped_outputs_total " + QByteArray::number(droppedOutputs.load()) + '\n';
+
+    out += "# HELP wsted_dropped_output_bytes_total Bytes of dropped notices and room updates.\n";
+    out += "# TYPE wsted_dropped_output_bytes_total counter\n";
+    out += "wsted_dropped_output_bytes_total " + QByteArray::number(droppedOutputBytes.load()) + '\n';
+
+    out += "# HELP wsted_slow_client_disconnects_total Clients over the output limit.\n";
+    out += "# TYPE wsted_slow_client_disconnects_total counter\n";
+    out += "wsted_slow_client_disconnects_total " + QByteArray::number(slowClientDisconnects.load()) + '\n';
+
+    out += "# HELP wsted_clients Connected clients.\n";
+    out += "# TYPE wsted_clients gauge\n";
+    out += "wsted_clients " + QByteArray::number(clients.load()) + '\n';
+
+    out += "# HELP wsted_rooms Rooms with at least one user.\n";
+    out += "# TYPE wsted_rooms gauge\n";
+    out += "wsted_rooms " + QByteArray::number(rooms.load()) + '\n';
+
+    out += "# HELP wsted_queued_write_bytes Bytes waiting to be written to client sockets.\n";
+    out += "# TYPE wsted_queued_write_bytes gauge\n";
+    out += "wsted_queued_write_bytes " + QByteArray::number(queuedWriteBytes.load()) + '\n';
+
+    out += "# HELP wsted_hot_file_bytes Bytes held by the hot-file caches of all workers.\n";
+    out += "# TYPE wsted_hot_file_bytes gauge\n";
+    out += "wsted_hot_file_bytes " + QByteArray::number(hotFileBytes.load()) + '\n';
+
+    out += "# HELP wsted_command_duration_seconds Time spent processing a client command.\n";
+    out += "# TYPE wsted_command_duration_seconds histogram\n";
+
+    for (int i = 0; i < METRIC_COMMAND_COUNT; i++) {
+        commandLatency[i].appendPrometheus(out, "wsted_command_duration_seconds",
+                                           QByteArray("command=\"") + commandNames[i] + '"');
+    }
+
+    return out;
+}
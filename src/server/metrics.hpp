@@ -0,0 +1,57 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <QByteArray>
+#include <atomic>
+
+// 4 buckets per power of two starting at 1 us, the last bucket is +Inf
+#define LATENCY_BUCKET_COUNT 96
+
+// Log-linear buckets like HDR histograms, recording is lock-free so every worker can share one
+class LatencyHistogram {
+   public:
+    LatencyHistogram();
+
+    void record(qint64 nanoseconds);
+    void appendPrometheus(QByteArray& out, const QByteArray& name, const QByteArray& labels) const;
+
+   private:
+    std::atomic<quint64> buckets[LATENCY_BUCKET_COUNT + 1];
+    std::atomic<quint64> count;
+    std::atomic<quint64> sum;  // nanoseconds
+};
+
+enum class MetricCommand { Protocol, Join, Msg, SendFile, FileChunk, FileEnd, GetFile, Other };
+
+#define METRIC_COMMAND_COUNT 8
+
+// Process-wide counters and gauges, updated by workers and read by MetricsServer
+class Metrics {
+   public:
+    static Metrics& instance();
+
+    QByteArray toPrometheus() const;
+
+    // Counters
+    std::atomic<quint64> connections;
+    std::atomic<quint64> bytesReceived;
+    std::atomic<quint64> bytesSent;
+    std::atomic<quint64> hotFileHits;
+    std::atomic<quint64> hotFileMisses;
+    std::atomic<quint64> droppedOutputs;
+    std::atomic<quint64> droppedOutputBytes;
+    std::atomic<quint64> slowClientDisconnects;
+
+    // Gauges
+    std::atomic<qint64> clients;
+    std::atomic<qint64> rooms;
+    std::atomic<qint64> queuedWriteBytes;
+    std::atomic<qint64> hotFileBytes;
+
+    LatencyHistogram commandLatency[METRIC_COMMAND_COUNT];
+
+   private:
+    Metrics();
+};
+
+#endif  // METRICS_HPP
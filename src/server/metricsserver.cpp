@@ -0,0 +1,117 @@
+#include "metricsserver.hpp"
+
+#include <QDebug>
+#include <QUrl>
+#include <QUrlQuery>
+
+#include "../logger.hpp"
+#include "metrics.hpp"
+
+// Requests are tiny, anything longer is not a scraper
+#define MAX_REQUEST_SIZE 8192
+
+static QByteArray logSettings() {
+    return "level=" + logLevelName(logLevel()).toUtf8() +
+           "\nsample_text=" + QByteArray::number(logSampling(LogCategory::Text)) +
+           "\nsample_file=" + QByteArray::number(logSampling(LogCategory::File)) + '\n';
+}
+
+// Same settings as the WSTED_LOG_* variables, nothing is changed unless every value is valid
+static bool configureLogging(const QUrlQuery& query) {
+    int textRate = logSampling(LogCategory::Text);
+    int fileRate = logSampling(LogCategory::File);
+    bool isTextValid = true;
+    bool isFileValid = true;
+
+    if (query.hasQueryItem("sample_text")) {
+        textRate = query.queryItemValue("sample_text").toInt(&isTextValid);
+    }
+
+    if (query.hasQueryItem("sample_file")) {
+        fileRate = query.queryItemValue("sample_file").toInt(&isFileValid);
+    }
+
+    if (!isTextValid || !isFileValid || textRate < 1 || fileRate < 1) {
+        return false;
+    }
+
+    // Level is set last, an unknown one leaves the settings as they are
+    if (query.hasQueryItem("level") && !setLogLevel(query.queryItemValue("level"))) {
+        return false;
+    }
+
+    setLogSampling(LogCategory::Text, textRate);
+    setLogSampling(LogCategory::File, fileRate);
+
+    qDebug() << "Logging changed to" << logSettings().replace('\n', ' ');
+    return true;
+}
+
+MetricsServer::MetricsServer(int _port, QObject* parent) : QTcpServer(parent) {
+    QHostAddress address = QHostAddress::LocalHost;
+
+    if (listen(address, _port) == false) {
+        qDebug() << "Could not listen for metrics at address" << address.toString() << "on port" << _port;
+        return;
+    }
+
+    connect(this, SIGNAL(newConnection()), this, SLOT(acceptConnection()));
+
+    qDebug() << "Metrics: listening at address" << address.toString() << "on port" << _port;
+}
+
+MetricsServer::~MetricsServer() {}
+
+void MetricsServer::acceptConnection() {
+    while (hasPendingConnections()) {
+        QTcpSocket* client = nextPendingConnection();
+
+        connect(client, SIGNAL(readyRead()), this, SLOT(readRequest()));
+        connect(client, SIGNAL(disconnected()), client, SLOT(deleteLater()));
+    }
+}
+
+void MetricsServer::readRequest() {
+    QTcpSocket* client = (QTcpSocket*) sender();
+    QByteArray request;
+    QByteArray status;
+    QByteArray body;
+
+    request = client->peek(MAX_REQUEST_SIZE);
+
+    if (!request.contains("\r\n\r\n")) {
+        if (request.size() >= MAX_REQUEST_SIZE) {
+            client->abort();
+        }
+
+        return;
+    }
+
+    client->readAll();
+
+    if (request.startsWith("GET /metrics ") || request.startsWith("GET / ")) {
+        status = "200 OK";
+        body = Metrics::instance().toPrometheus();
+    } else if (request.startsWith("GET /log ")) {
+        status = "200 OK";
+        body = logSettings();
+    } else if (request.startsWith("POST /log?")) {
+        // Logging is changed while the server runs, e.g. "curl -X POST '127.0.0.1:8045/log?level=debug'"
+        QUrl url(QString::fromLatin1(request.mid(5, request.indexOf(' ', 5) - 5)));
+
+        if (configureLogging(QUrlQuery(url))) {
+            status = "200 OK";
+            body = logSettings();
+        } else {
+            status = "400 Bad Request";
+            body = "Invalid log settings\n";
+        }
+    } else {
+        status = "404 Not Found";
+        body = "Not found\n";
+    }
+
+    client->write("HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " +
+                  QByteArray::number(body.size()) + "\r\nConnection: close\r\n\r\n" + body);
+    client->disconnectFromHost();
+}
@@ -0,0 +1,21 @@
+#ifndef METRICSSERVER_HPP
+#define METRICSSERVER_HPP
+
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+// Serves "GET /metrics" in Prometheus text format on the loopback interface, and the log level and sampling
+// under "/log" ("POST /log?level=debug&sample_text=10&sample_file=10" changes them)
+class MetricsServer : public QTcpServer {
+    Q_OBJECT
+   public:
+    explicit MetricsServer(int _port, QObject* parent = nullptr);
+    ~MetricsServer();
+
+   public slots:
+    void acceptConnection();
+    void readRequest();
+};
+
+#endif  // METRICSSERVER_HPP
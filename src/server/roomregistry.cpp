@@ -0,0 +1,69 @@
+#include "roomregistry.hpp"
+
+#include <QStringList>
+
+QString uniqueUserName(const Room* room, const QString& userName) {
+    QString name = userName;
+
+    while (room->members.contains(name)) {
+        name += "-1";
+    }
+
+    return name;
+}
+
+QString userList(const Room* room) {
+    return QStringList(room->members.keys()).join(',');
+}
+
+QString fileList(const Room* room) {
+    return QStringList(room->files.keys()).join('/');
+}
+
+RoomRegistry::RoomRegistry() {}
+
+RoomRegistry::~RoomRegistry() {
+    qDeleteAll(rooms);
+}
+
+Room* RoomRegistry::find(const QString& roomId) const {
+    return rooms.value(roomId, nullptr);
+}
+
+bool RoomRegistry::contains(const QString& roomId) const {
+    return rooms.contains(roomId);
+}
+
+int RoomRegistry::size() const {
+    return rooms.size();
+}
+
+QList<QString> RoomRegistry::ids() const {
+    return rooms.keys();
+}
+
+Room* RoomRegistry::acquire(const QString& roomId) {
+    Room*& room = rooms[roomId];
+
+    if (!room) {
+        room = new Room;
+        room->id = roomId;
+        room->sequence = 0;
+        room->refCount = 0;
+    }
+
+    room->refCount++;
+
+    return room;
+}
+
+bool RoomRegistry::release(Room* room) {
+    if (--room->refCount > 0) {
+        return false;
+    }
+
+    rooms.remove(room->id);
+    delete room;
+
+    return true;
+}
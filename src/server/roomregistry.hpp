@@ -0,0 +1,44 @@
+#ifndef ROOMREGISTRY_HPP
+#define ROOMREGISTRY_HPP
+
+#include <QHash>
+#include <QString>
+
+#include "session.hpp"
+
+struct Room {
+    QString id;
+    QHash<QString, Session*> members;  // by username, names are unique within a room
+    QHash<QString, QByteArray> files;  // filename -> content hash in BlobStore
+    QHash<quint64, Upload*> uploads;        // uploads with a transfer ID, data connections write into them
+    QHash<quint64, Upload*> parkedUploads;  // interrupted uploads by transfer ID, each holds a reference
+    quint64 sequence;                       // number of the last RoomEvent
+    int refCount;
+};
+
+// Name of a new member, "-1" is appended while it is taken
+QString uniqueUserName(const Room* room, const QString& userName);
+
+// Payloads of the Users (separated by ',') and Files (separated by '/') messages
+QString userList(const Room* room);
+QString fileList(const Room* room);
+
+// Rooms are created by the first acquire() and deleted by the last release()
+class RoomRegistry {
+   public:
+    RoomRegistry();
+    ~RoomRegistry();
+
+    Room* find(const QString& roomId) const;
+    bool contains(const QString& roomId) const;
+    int size() const;
+    QList<QString> ids() const;
+
+    Room* acquire(const QString& roomId);
+    bool release(Room* room);
+
+   private:
+    QHash<QString, Room*> rooms;
+};
+
+#endif  // ROOMREGISTRY_HPP
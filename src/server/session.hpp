@@ -0,0 +1,114 @@
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+#include <QCryptographicHash>
+#include <QFile>
+#include <QMap>
+#include <QQueue>
+#include <QTcpSocket>
+
+#include "../base64.hpp"
+#include "../compression.hpp"
+#include "blobstore.hpp"
+
+struct Room;
+
+// Range of an upload waiting to be written by the DiskPool
+struct FileWrite {
+    qint64 offset;
+    QByteArray data;
+};
+
+struct Upload {
+    QFile file;  // temporary file in BlobStore, opened and written by one DiskPool task at a time
+    QCryptographicHash hash{QCryptographicHash::Sha256};
+    QString fileName;
+    QString roomId;
+    QString userName;  // uploader, kept for the notice once the file is stored
+    qint64 size;      // announced by FileBegin, -1 for base64 "/sendfile" lines
+    qint64 received;  // bytes written to file
+    base64::Decoder base64;  // "/sendfile" data is decoded as it arrives
+    quint64 transferId;  // 0 unless the client can resume the upload after a dropped connection
+    qint64 parkedAt;     // when the connection dropped, msecs since epoch
+    bool isStriped;      // ranges arrive on data connections, the hash is computed at the end
+    QMap<qint64, qint64> slices;  // offset -> end of ranges announced by PutFileSlice
+
+    // Disk writes, the worker only reads hasWriteError and isCommitted while no task is running
+    bool isWritable;  // accepted and no write has failed as far as the worker knows
+    QList<FileWrite> writes;  // received while the task in flight writes earlier ones
+    qint64 writeBytes;        // queued and in flight, reading from the client pauses above a limit
+    bool isBusy;              // a DiskPool task is using file
+    bool hasWriteError;
+    bool isFinishing;   // detached from its session, stored once the writes are done
+    bool isCommitted;   // content is in BlobStore
+    bool isDiscarded;   // removed while busy, the file is deleted when the task has finished
+};
+
+struct Download {
+    QFile file;  // only used by DiskPool tasks once it is open
+    QString fileName;
+    QString roomId;
+    bool isText;      // base64 "/sendfile" line for text protocol clients
+    bool started;     // header has been written
+    bool isZeroCopy;  // chunks that have been read ahead are sent with sendfile(2), mapped blobs only
+    compression::Codec codec;  // None for content that does not compress, e.g. archives and media
+    QByteArray hash;
+    const MappedBlob* mapping;  // chunks point into here instead of readAhead when the blob could be mapped
+    quint64 transferId;  // first 8 bytes of the content hash, so a resumed download gets the same data
+    qint64 size;         // of the whole file, announced by FileBegin
+    qint64 position;     // next byte sent to the client
+    qint64 end;          // FileEnd is sent at this position
+
+    // Reads run one block at a time ahead of the socket, the worker only uses block while no task is running
+    qint64 readEnd;        // bytes before this have been read by DiskPool tasks
+    QByteArray readAhead;  // bytes from position to readEnd, empty when chunks come from mapping
+    QByteArray block;      // filled by the task in flight
+    bool isReading;        // a DiskPool task is reading the next block
+    bool hasReadError;
+    int cacheVariant;    // -1 unless the wire form is recorded for the hot-file cache
+    QByteArray captured;  // wire form written so far
+    QByteArray cached;    // whole wire form found in the hot-file cache
+    bool isOpening;   // file is being opened by a DiskPool task, chunks are sent once it is done
+    bool isOpen;
+    bool isDiscarded;  // closed while opening or reading, deleted when the task has finished
+};
+
+// What may happen to queued output of a client that has fallen behind, see Worker::shedOutput()
+enum class OutputKind {
+    Message,     // chat messages and replies, never dropped
+    Notice,      // server notices, dropped without replacement
+    RoomUpdate,  // room events and lists, replaced by the current room state once the queue drains
+};
+
+struct Output {
+    QByteArray data;  // shared with the other recipients of a broadcast
+    OutputKind kind;
+};
+
+// Everything the server keeps about one connection, found by its socket in O(1)
+struct Session {
+    QTcpSocket* socket;
+    QString userName;
+    Room* room;  // nullptr until the client joins a room
+    bool isData;  // attached data connection, not listed as a room member
+    int protocolVersion;
+    compression::Codec codec;  // negotiated with "/protocol", None if the client offered nothing we support
+    Upload* upload;  // only one upload per connection at a time
+    QQueue<Download*> downloads;
+    QList<Output> outgoing;  // written together once the socket has drained, ahead of file data
+    qint64 outgoingBytes;
+    bool isRoomStateStale;  // room updates were dropped, the room state follows the rest of the queue
+    bool isClosing;         // over the output limit with nothing left to drop
+
+    // Range of an upload received on a data connection
+    quint64 sliceTransferId;
+    qint64 slicePosition;
+    qint64 sliceEnd;
+    bool isReadPaused;  // upload it writes to is too far ahead of the disk
+
+    // Metrics
+    qint64 unreadBytes;  // received bytes already counted but not processed yet
+    qint64 queuedBytes;  // this session's share of the queued write bytes gauge
+};
+
+#endif  // SESSION_HPP
@@ -0,0 +1,1899 @@
+#include "worker.hpp"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QPointer>
+#include <QRandomGenerator>
+#include <QThread>
+#include <QTime>
+#include <QTimer>
+#include <QtEndian>
+
+#ifdef Q_OS_LINUX
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include "../base64.hpp"
+#include "../logger.hpp"
+#include "metrics.hpp"
+
+// Downloads are read by DiskPool tasks up to this far ahead of what has been sent, a block at a time
+static const qint64 READ_AHEAD_SIZE = protocol::FILE_HIGH_WATER_MARK * 2;
+
+// Pages of mapped blobs are touched this far apart, no page is smaller
+static const qint64 MIN_PAGE_SIZE = 4096;
+
+// Raw chunks that have been read ahead go from the page cache to the socket without passing through user
+// space
+static const qint64 ZERO_COPY_CHUNK_SIZE = protocol::FILE_CHUNK_SIZE * 16;
+static const qint64 ZERO_COPY_BUDGET = protocol::FILE_HIGH_WATER_MARK * 4;
+
+// Files up to this size are kept in the hot-file cache of their room's worker
+static const qint64 HOT_FILE_MAX_SIZE = 1 << 20;
+static const qint64 HOT_FILE_CACHE_BUDGET = (1 << 20) * 64LL;
+
+// Queued output is written once the socket buffer is below this, so messages overtake file chunks
+static const qint64 OUTPUT_FLUSH_MARK = protocol::FILE_HIGH_WATER_MARK;
+
+// Queued output of one client above which notices are dropped and then the client is disconnected,
+// WSTED_OUTPUT_LIMIT sets it in bytes
+static const qint64 DEFAULT_OUTPUT_LIMIT = (1 << 20) * 4LL;
+static const qint64 MIN_OUTPUT_LIMIT = (1 << 10) * 64LL;
+
+// Reading from uploading clients pauses while this much of their upload waits for the disk
+static const qint64 UPLOAD_WRITE_HIGH_WATER_MARK = protocol::FILE_HIGH_WATER_MARK * 4;
+
+// Interrupted uploads keep their room and partial file until the client comes back or this expires
+static const qint64 PARKED_UPLOAD_TIMEOUT = 10 * 60 * 1000;
+
+// Encodings of one file differ by protocol features and codec, each one is cached separately
+static int hotFileVariant(const Session* session, const Download* download) {
+    if (download->isText) {
+        return 0;
+    }
+
+    return 1 + (session->protocolVersion >= protocol::RESUMABLE_VERSION ? 1 : 0) + 2 * (int) download->codec;
+}
+
+static MetricCommand metricCommand(protocol::Command command) {
+    switch (command) {
+        case protocol::Command::Protocol:
+            return MetricCommand::Protocol;
+        case protocol::Command::Join:
+        case protocol::Command::Attach:
+            return MetricCommand::Join;
+        case protocol::Command::Msg:
+            return MetricCommand::Msg;
+        case protocol::Command::SendFile:
+            return MetricCommand::SendFile;
+        case protocol::Command::GetFile:
+            return MetricCommand::GetFile;
+        default:
+            return MetricCommand::Other;
+    }
+}
+
+static MetricCommand metricCommand(protocol::FrameType type) {
+    switch (type) {
+        case protocol::FrameType::Message:
+            return MetricCommand::Msg;
+        case protocol::FrameType::FileBegin:
+        case protocol::FrameType::FileResume:
+        case protocol::FrameType::PutFileSlice:
+            return MetricCommand::SendFile;
+        case protocol::FrameType::FileChunk:
+        case protocol::FrameType::PackedChunk:
+            return MetricCommand::FileChunk;
+        case protocol::FrameType::FileEnd:
+            return MetricCommand::FileEnd;
+        case protocol::FrameType::GetFile:
+        case protocol::FrameType::GetFileRange:
+        case protocol::FrameType::GetFileSlice:
+            return MetricCommand::GetFile;
+        default:
+            return MetricCommand::Other;
+    }
+}
+
+static qint64 outputLimitFromEnvironment() {
+    bool isValid;
+    qint64 limit = qEnvironmentVariable("WSTED_OUTPUT_LIMIT").toLongLong(&isValid);
+
+    if (!isValid) {
+        return DEFAULT_OUTPUT_LIMIT;
+    }
+
+    return qMax(limit, MIN_OUTPUT_LIMIT);
+}
+
+Worker::Worker(int _index, BlobStore* _blobs, DiskPool* _disks, QObject* parent)
+    : QObject(parent),
+      index(_index),
+      blobs(_blobs),
+      disks(_disks),
+      outputLimit(outputLimitFromEnvironment()),
+      hasPausedReaders(false),
+      hotFiles(HOT_FILE_CACHE_BUDGET) {}
+
+Worker::~Worker() {
+    // Server is shutting down, so uploads are discarded instead of parked and nobody is told who left
+    for (auto session : std::as_const(sessions)) {
+        Room* room = session->room;
+
+        session->socket->disconnect(this);
+        abortReceiveFile(session);
+
+        for (auto download : std::as_const(session->downloads)) {
+            closeDownload(download);
+        }
+
+        if (room && !session->isData) {
+            room->members.remove(session->userName);
+        }
+
+        if (room) {
+            releaseRoom(room);
+        }
+
+        Metrics::instance().clients--;
+        Metrics::instance().queuedWriteBytes -= session->queuedBytes;
+
+        delete session;
+    }
+
+    sessions.clear();
+    pendingWrites.clear();
+
+    // Rooms left are kept by parked uploads and by uploads still being stored
+    for (const auto& roomId : rooms.ids()) {
+        Room* room = rooms.find(roomId);
+        QList<Upload*> parked = room->parkedUploads.values();
+
+        room->parkedUploads.clear();
+
+        // Each parked upload holds a reference, the room is gone after the last one at the latest
+        for (auto upload : std::as_const(parked)) {
+            discardUpload(upload);
+            releaseRoom(room);
+        }
+    }
+
+    // Completions of disk tasks are posted here and may start the next task of an upload, none may
+    // arrive once the worker is gone
+    do {
+        disks->waitForDone();
+        QCoreApplication::sendPostedEvents(this, QEvent::MetaCall);
+    } while (!disks->isIdle());
+}
+
+void Worker::setWorkers(const QList<Worker*>& allWorkers) {
+    workers = allWorkers;
+}
+
+Worker* Worker::roomOwner(const QString& roomId) const {
+    return workers[qHash(roomId) % (size_t) workers.size()];
+}
+
+void Worker::addClient(qintptr socketDescriptor) {
+    QTcpSocket* client = new QTcpSocket(this);
+    client->setSocketDescriptor(socketDescriptor);
+
+    Session* session = new Session;
+    session->socket = client;
+    session->room = nullptr;
+    session->isData = false;
+    session->protocolVersion = protocol::TEXT_VERSION;
+    session->codec = compression::Codec::None;
+    session->upload = nullptr;
+    session->sliceTransferId = 0;
+    session->slicePosition = 0;
+    session->sliceEnd = 0;
+    session->isReadPaused = false;
+    session->outgoingBytes = 0;
+    session->isRoomStateStale = false;
+    session->isClosing = false;
+    session->unreadBytes = 0;
+    session->queuedBytes = 0;
+
+    connectClient(client);
+    sessions.insert(client, session);
+
+    Metrics::instance().connections++;
+    Metrics::instance().clients++;
+
+    qDebug() << "New client: incoming connection from" << client->peerAddress().toString() << "on worker"
+             << index;
+}
+
+void Worker::connectClient(QTcpSocket* client) {
+    connect(client, SIGNAL(readyRead()), this, SLOT(readyRead()));
+    connect(client, SIGNAL(disconnected()), this, SLOT(disconnected()));
+    connect(client, SIGNAL(bytesWritten(qint64)), this, SLOT(bytesWritten(qint64)));
+}
+
+void Worker::handOverClient(Session* session, Worker* owner, const QString& userName,
+                            const QString& roomId) {
+    QTcpSocket* client = session->socket;
+
+    // Nothing but the negotiated protocol can exist before the client has joined a room
+    abortReceiveFile(session);
+
+    for (auto download : session->downloads) {
+        closeDownload(download);
+    }
+
+    session->downloads.clear();
+
+    // Replies queued before the join, e.g. to "/protocol", are written before the socket changes threads
+    flushClient(session);
+
+    sessions.remove(client);
+    pendingWrites.remove(session);
+    session->unreadBytes = client->bytesAvailable();
+
+    client->disconnect(this);
+    client->setParent(nullptr);
+    client->moveToThread(owner->thread());
+
+    qDebug() << "Client" << client->peerAddress().toString() << "handed over to worker" << owner->index
+             << "for room" << roomId;
+
+    QMetaObject::invokeMethod(
+        owner, [owner, session, userName, roomId] { owner->adoptClient(session, userName, roomId); },
+        Qt::QueuedConnection);
+}
+
+void Worker::adoptClient(Session* session, QString userName, QString roomId) {
+    QTcpSocket* client = session->socket;
+
+    client->setParent(this);
+
+    connectClient(client);
+    sessions.insert(client, session);
+
+    // Bytes that arrived while in transit
+    Metrics::instance().bytesReceived += client->bytesAvailable() - session->unreadBytes;
+
+    processJoinRoom(session, userName, roomId);
+
+    // Lines that arrived after "/join" are still buffered in the socket
+    processIncoming(session);
+
+    if (sessions.contains(client) && client->state() == QAbstractSocket::UnconnectedState) {
+        // Disconnected while in transit, nobody was listening to its signals
+        removeClient(session);
+    }
+}
+
+void Worker::sendTextMessage(Room* room, const QString& userName, const QString& msg, OutputKind kind) {
+    QString timeString;
+    QString messageToWrite;
+
+    timeString = QDateTime().currentDateTime().time().toString();
+    timeString = timeString.mid(0, timeString.lastIndexOf(':'));
+
+    messageToWrite = timeString + ' ' + userName + ":" + msg;
+
+    broadcast(room, protocol::FrameType::Message, messageToWrite, kind);
+}
+
+void Worker::sendNotice(Room* room, const QString& msg) {
+    sendTextMessage(room, "Server", ' ' + msg, OutputKind::Notice);
+}
+
+QString Worker::generateNewRoomId() {
+    // Only IDs of rooms pinned to this worker are generated, so the client stays here
+    QRandomGenerator generator(QDateTime::currentSecsSinceEpoch());
+
+    QString allowedChars = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+    QString newRoomId;
+
+    do {
+        newRoomId.clear();
+
+        for (; newRoomId.size() != 10;) {
+            auto r = generator.generate() % allowedChars.size();
+            newRoomId += allowedChars[r];
+        }
+    } while (rooms.contains(newRoomId) || roomOwner(newRoomId) != this);
+
+    return newRoomId;
+}
+
+void Worker::readyRead() {
+    Session* session = sessions.value((QTcpSocket*) sender());
+
+    if (session) {
+        Metrics::instance().bytesReceived += session->socket->bytesAvailable() - session->unreadBytes;
+        processIncoming(session);
+    }
+}
+
+void Worker::processIncoming(Session* session) {
+    QTcpSocket* client = session->socket;
+    QElapsedTimer timer;
+    MetricCommand command;
+    char firstByte;
+
+    // Client leaves this worker if it was closed or handed over to the owner of its room
+    while (sessions.contains(client) && client->peek(&firstByte, 1) == 1) {
+        Upload* upload = session->upload;
+
+        // Data stays in the socket while the disk is behind, uploadWritten() continues
+        if (isUploadThrottled(session)) {
+            hasPausedReaders = true;
+            session->isReadPaused = true;
+            client->setReadBufferSize(protocol::FILE_HIGH_WATER_MARK);
+            break;
+        }
+
+        timer.start();
+
+        if (upload && upload->size == -1) {
+            // Base64 data of a "/sendfile" line that is still arriving
+            receiveTextFileData(session);
+            command = MetricCommand::FileChunk;
+        } else if (protocol::isFrameStart(firstByte)) {
+            // Binary frame from client
+            protocol::Frame frame;
+            auto result = protocol::readFrame(client, frame);
+
+            if (result == protocol::ReadResult::Incomplete) {
+                break;
+            } else if (result == protocol::ReadResult::Error) {
+                messageLogger("Received BAD", client, "Malformed frame, closing connection");
+                client->abort();
+                return;
+            }
+
+            processFrame(session, frame);
+            command = metricCommand(frame.type);
+        } else if (beginReceiveTextFile(session)) {
+            // Header of a "/sendfile" line, the data is decoded as it arrives instead of waiting for '\n'
+            command = MetricCommand::SendFile;
+        } else if (client->canReadLine()) {
+            // Text line from client
+            command = metricCommand(processTextLine(session, protocol::readLine(client, lineBuffer)));
+        } else {
+            break;
+        }
+
+        Metrics::instance().commandLatency[(int) command].record(timer.nsecsElapsed());
+    }
+
+    if (sessions.contains(client)) {
+        session->unreadBytes = client->bytesAvailable();
+    }
+}
+
+protocol::Command Worker::processTextLine(Session* session, QByteArrayView line) {
+    QTcpSocket* client = session->socket;
+    protocol::TextCommand command;
+    QString roomId;
+    QString data;
+    QString filename;
+    Room* room;
+
+    if (!protocol::parseTextLine(line, command)) {
+        messageLogger("Received BAD", client, QString::fromUtf8(line));
+        return protocol::Command::Unknown;
+    }
+
+    roomId = QString::fromUtf8(command.room);
+
+    if (!command.hasFileName) {
+        // Message from client
+
+        if (command.command == protocol::Command::Protocol) {
+            // Client supports a newer protocol version, it has to be negotiated before join
+            messageLogger("Received PROTOCOL", client, QString::fromUtf8(line));
+
+            auto version = qBound(protocol::TEXT_VERSION, command.room.toInt(), protocol::CURRENT_VERSION);
+
+            session->protocolVersion = version;
+            session->codec = compression::Codec::None;
+
+            QString messageToWrite = "/protocol " + QString::number(version) + ":";
+
+            if (version >= protocol::COMPRESSED_VERSION) {
+                // First of the codecs offered by the client that this build supports
+                session->codec = compression::chooseCodec(command.data);
+                messageToWrite += QString::fromLatin1(compression::codecName(session->codec));
+            }
+
+            messageToWrite += '\n';
+            writeToClient(session, messageToWrite.toUtf8());
+            messageLogger("Sent", client, messageToWrite);
+        } else if (command.command == protocol::Command::Join) {
+            // User wants to join some room
+            messageLogger("Received JOIN", client, QString::fromUtf8(line));
+
+            data = QString::fromUtf8(command.data);
+            processJoinRoom(session, data, roomId);
+        } else if (command.command == protocol::Command::Attach && roomId != "new") {
+            // Additional connection of a user that moves byte ranges of a file
+            messageLogger("Received JOIN", client, QString::fromUtf8(line));
+
+            data = QString::fromUtf8(command.data);
+            session->isData = true;
+            processJoinRoom(session, data, roomId);
+        } else if (command.command == protocol::Command::Msg) {
+            // Text message from client
+            room = joinedRoom(session, roomId);
+
+            if (room) {
+                sendTextMessage(room, session->userName, QString::fromUtf8(command.data));
+                messageLogger("Received TEXT", client, QString::fromUtf8(line));
+            } else {
+                messageLogger("Received BAD", client, QString::fromUtf8(line));
+            }
+        }
+    } else {
+        // File from client
+
+        filename = QString::fromUtf8(command.fileName);
+
+        if (command.command == protocol::Command::GetFile && !filename.isEmpty()) {
+            // Client is downloading file
+            messageLogger("Received REQUEST", client, QString::fromUtf8(line));
+
+            if (joinedRoom(session, roomId)) {
+                sendFile(session, filename);
+            }
+        }
+    }
+
+    return command.command;
+}
+
+void Worker::processFrame(Session* session, const protocol::Frame& frame) {
+    QTcpSocket* client = session->socket;
+    QString roomId;
+    QString filename;
+    QByteArray chunk;
+    QByteArray hash;
+    quint64 transferId;
+    qint64 size;
+    qint64 offset;
+    Room* room;
+
+    roomId = QString::fromUtf8(frame.room);
+
+    switch (frame.type) {
+        case protocol::FrameType::Message:
+            // Text message from client
+            room = joinedRoom(session, roomId);
+
+            if (room) {
+                sendTextMessage(room, session->userName, QString::fromUtf8(frame.payload));
+                messageLogger("Received TEXT", client, protocol::describeFrame(frame));
+            } else {
+                messageLogger("Received BAD", client, protocol::describeFrame(frame));
+            }
+            break;
+        case protocol::FrameType::FileBegin:
+            // Client starts uploading file
+            if (protocol::decodeFileBegin(frame.payload, filename, size) && !filename.isEmpty()) {
+                messageLogger("Received FILE", client, protocol::describeFrame(frame));
+
+                beginReceiveFile(session, filename, roomId, size);
+            } else {
+                messageLogger("Received BAD", client, protocol::describeFrame(frame));
+            }
+            break;
+        case protocol::FrameType::FileResume:
+            // Client starts or continues uploading file
+            if (protocol::decodeResume(frame.payload, transferId, size, filename, hash) && transferId != 0 &&
+                !filename.isEmpty()) {
+                messageLogger("Received FILE", client, protocol::describeFrame(frame));
+
+                resumeReceiveFile(session, transferId, filename, roomId, size, hash);
+            } else {
+                messageLogger("Received BAD", client, protocol::describeFrame(frame));
+            }
+            break;
+        case protocol::FrameType::FileChunk:
+            receiveFileChunk(session, frame.payload);
+            break;
+        case protocol::FrameType::PackedChunk:
+            if (compression::decompressChunk(frame.payload, chunk)) {
+                receiveFileChunk(session, chunk);
+            } else {
+                messageLogger("Received BAD", client, protocol::describeFrame(frame));
+                abortReceiveFile(session);
+            }
+            break;
+        case protocol::FrameType::FileEnd:
+            finishReceiveFile(session);
+            break;
+        case protocol::FrameType::GetFile:
+            // Client is downloading file
+            messageLogger("Received REQUEST", client, protocol::describeFrame(frame));
+
+            filename = QString::fromUtf8(frame.payload);
+            if (!filename.isEmpty() && joinedRoom(session, roomId)) {
+                sendFile(session, filename);
+            }
+            break;
+        case protocol::FrameType::GetFileRange:
+            // Client is downloading file or continues an interrupted download
+            messageLogger("Received REQUEST", client, protocol::describeFrame(frame));
+
+            if (protocol::decodeTransfer(frame.payload, transferId, size, filename) && !filename.isEmpty() &&
+                joinedRoom(session, roomId)) {
+                sendFile(session, filename, transferId, size);
+            }
+            break;
+        case protocol::FrameType::GetFileSlice:
+            // Client is downloading a byte range of file, usually on one of several data connections
+            messageLogger("Received REQUEST", client, protocol::describeFrame(frame));
+
+            if (protocol::decodeSlice(frame.payload, transferId, offset, size, filename) &&
+                !filename.isEmpty() && joinedRoom(session, roomId)) {
+                sendFile(session, filename, transferId, offset, size);
+            }
+            break;
+        case protocol::FrameType::GetRoomState:
+            // Client has missed a room event
+            room = joinedRoom(session, roomId);
+
+            if (room) {
+                messageLogger("Received REQUEST", client, protocol::describeFrame(frame));
+                sendRoomState(room, session);
+            } else {
+                messageLogger("Received BAD", client, protocol::describeFrame(frame));
+            }
+            break;
+        case protocol::FrameType::PutFileSlice:
+            // Client is uploading a byte range of file, FileChunks follow
+            if (protocol::decodeSlice(frame.payload, transferId, offset, size, filename) &&
+                joinedRoom(session, roomId) && beginReceiveSlice(session, transferId, offset, size)) {
+                messageLogger("Received FILE", client, protocol::describeFrame(frame));
+            } else {
+                messageLogger("Received BAD", client, protocol::describeFrame(frame));
+            }
+            break;
+        default:
+            messageLogger("Received BAD", client, protocol::describeFrame(frame));
+            break;
+    }
+}
+
+void Worker::sendToClient(Session* session, protocol::FrameType type, const QString& roomId,
+                          const QString& data) {
+    writeToClient(session, protocol::encodeMessage(session->protocolVersion, type, roomId.toUtf8(),
+                                                   data.toUtf8()));
+}
+
+void Worker::sendToClient(Session* session, protocol::FrameType type, const QString& roomId,
+                          const QByteArray& payload) {
+    writeToClient(session, protocol::encodeMessage(session->protocolVersion, type, roomId.toUtf8(), payload));
+}
+
+void Worker::writeToClient(Session* session, const QByteArray& data, OutputKind kind) {
+    // Room state sent after the queue drains covers the updates that would follow
+    if (session->isClosing || (kind == OutputKind::RoomUpdate && session->isRoomStateStale)) {
+        return;
+    }
+
+    // Everything queued during this tick goes to the socket in one write
+    if (pendingWrites.isEmpty()) {
+        QMetaObject::invokeMethod(this, [this] { flushPendingWrites(); }, Qt::QueuedConnection);
+    }
+
+    session->outgoing.append(Output{data, kind});
+    session->outgoingBytes += data.size();
+    pendingWrites.insert(session);
+
+    if (session->outgoingBytes > outputLimit) {
+        shedOutput(session);
+    }
+}
+
+void Worker::shedOutput(Session* session) {
+    qint64 droppedBytes = 0;
+    qint64 droppedCount = 0;
+
+    // Client can do without notices, and room updates are sent again as one state
+    session->outgoing.removeIf([session, &droppedBytes, &droppedCount](const Output& output) {
+        if (output.kind == OutputKind::Message) {
+            return false;
+        }
+
+        if (output.kind == OutputKind::RoomUpdate) {
+            session->isRoomStateStale = true;
+        }
+
+        droppedBytes += output.data.size();
+        droppedCount++;
+        return true;
+    });
+
+    session->outgoingBytes -= droppedBytes;
+
+    Metrics::instance().droppedOutputs += droppedCount;
+    Metrics::instance().droppedOutputBytes += droppedBytes;
+
+    if (session->outgoingBytes <= outputLimit) {
+        qDebug() << "Dropped" << droppedCount << "notices for slow client" << session->userName;
+        return;
+    }
+
+    // Only messages are left, so the client is disconnected instead of the queue growing further
+    qDebug() << "Disconnecting slow client" << session->userName << "with" << session->outgoingBytes
+             << "bytes queued";
+
+    session->isClosing = true;
+    session->outgoing.clear();
+    session->outgoingBytes = 0;
+
+    Metrics::instance().slowClientDisconnects++;
+
+    // Caller may be iterating the room members, the session is removed on the next tick
+    QPointer<QTcpSocket> guard(session->socket);
+    QMetaObject::invokeMethod(
+        this,
+        [guard] {
+            if (guard) {
+                guard->abort();
+            }
+        },
+        Qt::QueuedConnection);
+}
+
+void Worker::broadcast(Room* room, protocol::FrameType type, const QString& data, OutputKind kind) {
+    QByteArray roomName = room->id.toUtf8();
+    QByteArray payload = data.toUtf8();
+    QByteArray encoded[protocol::CURRENT_VERSION + 1];
+
+    // Message is encoded once per protocol version, recipients share the buffer instead of copies
+    for (auto member : std::as_const(room->members)) {
+        QByteArray& message = encoded[member->protocolVersion];
+
+        if (message.isNull()) {
+            message = protocol::encodeMessage(member->protocolVersion, type, roomName, payload);
+        }
+
+        writeToClient(member, message, kind);
+    }
+}
+
+void Worker::flushClient(Session* session) {
+    QByteArray data;
+
+    if (session->outgoing.isEmpty() && !session->isRoomStateStale) {
+        return;
+    }
+
+    // Queue waits for bytesWritten() while the socket is backed up. Text protocol clients can't tell a
+    // message from base64 data until the "/sendfile" line ends.
+    if (session->isClosing || session->socket->bytesToWrite() >= OUTPUT_FLUSH_MARK ||
+        (!session->downloads.isEmpty() && session->downloads.head()->isText &&
+         session->downloads.head()->started)) {
+        updateQueuedBytes(session);
+        return;
+    }
+
+    if (session->isRoomStateStale) {
+        session->isRoomStateStale = false;
+        sendRoomState(session->room, session);
+    }
+
+    if (session->outgoing.size() == 1) {
+        data = session->outgoing.first().data;
+    } else {
+        data.reserve(session->outgoingBytes);
+
+        for (const auto& output : std::as_const(session->outgoing)) {
+            data.append(output.data);
+        }
+    }
+
+    session->outgoing.clear();
+    session->outgoingBytes = 0;
+    session->socket->write(data);
+
+    updateQueuedBytes(session);
+}
+
+void Worker::updateQueuedBytes(Session* session) {
+    qint64 queuedBytes = session->socket->bytesToWrite() + session->outgoingBytes;
+
+    Metrics::instance().queuedWriteBytes += queuedBytes - session->queuedBytes;
+    session->queuedBytes = queuedBytes;
+}
+
+void Worker::flushPendingWrites() {
+    QSet<Session*> pending;
+
+    pending.swap(pendingWrites);
+
+    for (auto session : std::as_const(pending)) {
+        flushClient(session);
+    }
+}
+
+void Worker::disconnected() {
+    Session* session = sessions.value((QTcpSocket*) sender());
+
+    if (session) {
+        removeClient(session);
+    }
+}
+
+void Worker::removeClient(Session* session) {
+    QTcpSocket* client = session->socket;
+    Room* room = session->room;
+    QString roomId;
+
+    qDebug() << "Client disconnected:" << client->peerAddress().toString();
+
+    parkReceiveFile(session);
+
+    for (auto download : session->downloads) {
+        closeDownload(download);
+    }
+
+    sessions.remove(client);
+    pendingWrites.remove(session);
+    client->deleteLater();
+
+    Metrics::instance().clients--;
+    Metrics::instance().queuedWriteBytes -= session->queuedBytes;
+
+    if (room && session->isData) {
+        // Data connections hold a room reference but are not members
+        releaseRoom(room);
+    } else if (room) {
+        roomId = room->id;
+        room->members.remove(session->userName);
+
+        qDebug() << "This client was in room" << roomId << '\n';
+
+        if (!releaseRoom(room)) {
+            sendNotice(room, session->userName + " has left.");
+            sendRoomEvent(room, protocol::RoomEventKind::UserLeft, session->userName);
+        }
+    } else {
+        qDebug() << "This client was not in any room\n";
+    }
+
+    delete session;
+}
+
+void Worker::sendRoomEvent(Room* room, protocol::RoomEventKind kind, const QString& name,
+                           Session* except) {
+    QByteArray roomName = room->id.toUtf8();
+    QByteArray encoded[protocol::CURRENT_VERSION + 1];
+    QByteArray list;
+    bool isUserEvent =
+        kind == protocol::RoomEventKind::UserJoined || kind == protocol::RoomEventKind::UserLeft;
+    auto listType = isUserEvent ? protocol::FrameType::Users : protocol::FrameType::Files;
+
+    room->sequence++;
+
+    // Members on version 6 get the change alone, older ones the whole list it belongs to
+    for (auto member : std::as_const(room->members)) {
+        QByteArray& message = encoded[member->protocolVersion];
+
+        if (member == except) {
+            continue;
+        }
+
+        if (message.isNull() && member->protocolVersion >= protocol::EVENTS_VERSION) {
+            message = protocol::encodeFrame(protocol::FrameType::RoomEvent, roomName,
+                                            protocol::encodeRoomEvent(room->sequence, kind, name));
+        } else if (message.isNull()) {
+            if (list.isNull()) {
+                list = (isUserEvent ? userList(room) : fileList(room)).toUtf8();
+            }
+
+            message = protocol::encodeMessage(member->protocolVersion, listType, roomName, list);
+        }
+
+        writeToClient(member, message, OutputKind::RoomUpdate);
+    }
+}
+
+void Worker::sendRoomState(Room* room, Session* session) {
+    if (session->protocolVersion >= protocol::EVENTS_VERSION) {
+        sendToClient(session, protocol::FrameType::RoomState, room->id,
+                     protocol::encodeRoomState(room->sequence, userList(room), fileList(room)));
+    } else {
+        sendToClient(session, protocol::FrameType::Users, room->id, userList(room));
+        sendToClient(session, protocol::FrameType::Files, room->id, fileList(room));
+    }
+}
+
+bool Worker::beginReceiveFile(Session* session, QString& filename, const QString& roomId, qint64 size) {
+    Upload* upload;
+
+    // Only one upload per connection, a new one replaces an unfinished one
+    abortReceiveFile(session);
+
+    // Data of a failed upload is still consumed and discarded until it ends
+    upload = new Upload;
+    upload->roomId = roomId;
+    upload->size = size;
+    upload->received = 0;
+    upload->transferId = 0;
+    upload->parkedAt = 0;
+    upload->isStriped = false;
+    upload->isWritable = false;
+    upload->writeBytes = 0;
+    upload->isBusy = false;
+    upload->hasWriteError = false;
+    upload->isFinishing = false;
+    upload->isCommitted = false;
+    upload->isDiscarded = false;
+    session->upload = upload;
+
+    if (filename.isEmpty() || !joinedRoom(session, roomId)) {
+        return false;
+    }
+
+    // Content hash and so the final name in the store are known only when the upload ends. The file is
+    // created by the first DiskPool task, an error shows when the upload is finished.
+    upload->file.setFileName(blobs->temporaryPath());
+    upload->fileName = filename;
+    upload->isWritable = true;
+
+    return true;
+}
+
+bool Worker::beginReceiveTextFile(Session* session) {
+    static const QByteArray prefix = "/sendfile '";
+    static const qint64 maxHeaderSize =
+        prefix.size() + protocol::MAX_FILE_NAME_LENGTH + 2 + protocol::MAX_ROOM_ID_LENGTH + 1;
+
+    QTcpSocket* client = session->socket;
+    protocol::TextCommand command;
+    QByteArray head;
+    QString filename;
+    QString roomId;
+    qsizetype newlineIdx;
+
+    // Header ends at the first ':' after the closing quote, nothing past its longest form is looked at
+    head = client->peek(maxHeaderSize);
+
+    if (!head.startsWith(prefix)) {
+        return false;
+    }
+
+    newlineIdx = head.indexOf('\n');
+
+    if (newlineIdx != -1) {
+        head.truncate(newlineIdx);
+    }
+
+    if (!protocol::parseTextLine(head, command) || command.command != protocol::Command::SendFile ||
+        command.fileName.size() > protocol::MAX_FILE_NAME_LENGTH) {
+        if (newlineIdx == -1 && head.size() < maxHeaderSize) {
+            // Rest of the header is still arriving
+            return false;
+        }
+
+        // Rest of the line is consumed by an upload that was refused, its data is never buffered
+        messageLogger("Received BAD", client, "Malformed file header: " + QString::fromUtf8(head.left(64)));
+        client->skip(head.size());
+        beginReceiveFile(session, filename, roomId, -1);
+
+        return true;
+    }
+
+    filename = QString::fromUtf8(command.fileName);
+    roomId = QString::fromUtf8(command.room);
+
+    // Header ends where the base64 data begins
+    client->skip(command.data.data() - head.constData());
+    messageLogger("Received FILE", client, "/sendfile '" + filename + "' " + roomId + ":_BASE64_DATA_");
+
+    beginReceiveFile(session, filename, roomId, -1);
+
+    return true;
+}
+
+void Worker::receiveTextFileData(Session* session) {
+    QTcpSocket* client = session->socket;
+    Upload* upload;
+    QByteArray data;
+    qsizetype decodedSize;
+    qsizetype tailSize;
+    bool isLineFinished;
+
+    upload = session->upload;
+    data = client->peek(protocol::FILE_CHUNK_SIZE / 3 * 4);
+
+    auto newlineIdx = data.indexOf('\n');
+    isLineFinished = newlineIdx != -1;
+
+    if (isLineFinished) {
+        data.truncate(newlineIdx);
+    }
+
+    client->skip(data.size() + (isLineFinished ? 1 : 0));
+
+    if (isLineFinished && data.endsWith('\r')) {
+        data.chop(1);
+    }
+
+    // Data is decoded straight into a buffer shared by all uploads, a cut group waits in the decoder
+    if (decodeBuffer.size() < base64::decodedSizeBound(data.size() + 3)) {
+        decodeBuffer.resize(base64::decodedSizeBound(data.size() + 3));
+    }
+
+    if (upload->isWritable) {
+        decodedSize = upload->base64.decode(data.constData(), data.size(), decodeBuffer.data());
+
+        if (decodedSize >= 0 && isLineFinished) {
+            tailSize = upload->base64.finish(decodeBuffer.data() + decodedSize);
+            decodedSize = tailSize < 0 ? -1 : decodedSize + tailSize;
+        }
+
+        if (decodedSize < 0) {
+            // Rest of the line is still consumed, the upload fails when it ends
+            messageLogger("Received BAD", client, "Invalid base64 data of '" + upload->fileName + "'");
+            upload->isWritable = false;
+        } else {
+            // Data waits for the DiskPool, so it can't stay in the shared buffer
+            receiveFileChunk(session, QByteArray(decodeBuffer.constData(), decodedSize));
+        }
+    }
+
+    if (isLineFinished) {
+        finishReceiveFile(session);
+    }
+}
+
+void Worker::receiveFileChunk(Session* session, const QByteArray& data) {
+    Upload* upload = session->upload;
+
+    if (session->sliceTransferId != 0) {
+        receiveSliceChunk(session, data);
+        return;
+    }
+
+    if (!upload || upload->isStriped || !upload->isWritable || data.isEmpty()) {
+        return;
+    }
+
+    writeUpload(upload, upload->received, data);
+
+    upload->hash.addData(data);
+    upload->received += data.size();
+}
+
+void Worker::writeUpload(Upload* upload, qint64 offset, const QByteArray& data) {
+    upload->writes.append(FileWrite{offset, data});
+    upload->writeBytes += data.size();
+
+    if (!upload->isBusy) {
+        startUploadWrites(upload);
+    }
+}
+
+// Temporary file is created by the first task that needs it, so a slow disk does not hold up the worker
+static bool openUploadFile(Upload* upload) {
+    if (upload->file.isOpen()) {
+        return true;
+    }
+
+    if (!upload->file.open(QIODevice::ReadWrite, QFileDevice::ReadOwner | QFileDevice::WriteOwner)) {
+        qDebug() << upload->file.fileName() << upload->file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+void Worker::startUploadWrites(Upload* upload) {
+    QList<FileWrite> writes;
+    qint64 size = 0;
+
+    writes.swap(upload->writes);
+
+    for (const auto& write : std::as_const(writes)) {
+        size += write.data.size();
+    }
+
+    // Writes of one upload run one batch at a time and in the order they were received
+    upload->isBusy = true;
+
+    disks->run(
+        this,
+        [upload, writes] {
+            if (upload->hasWriteError || !openUploadFile(upload)) {
+                upload->hasWriteError = true;
+                return;
+            }
+
+            for (const auto& write : writes) {
+                if (!upload->file.seek(write.offset) || upload->file.write(write.data) != write.data.size()) {
+                    qDebug() << upload->file.fileName() << upload->file.errorString();
+                    upload->hasWriteError = true;
+                    return;
+                }
+            }
+        },
+        [this, upload, size] { uploadWritten(upload, size); });
+}
+
+void Worker::uploadWritten(Upload* upload, qint64 size) {
+    bool isDrained;
+
+    upload->isBusy = false;
+    upload->writeBytes -= size;
+    isDrained = upload->writeBytes < UPLOAD_WRITE_HIGH_WATER_MARK;
+
+    if (upload->hasWriteError) {
+        upload->isWritable = false;
+    }
+
+    if (upload->isDiscarded) {
+        discardUpload(upload);
+    } else if (!upload->writes.isEmpty()) {
+        startUploadWrites(upload);
+    } else if (upload->isFinishing) {
+        storeUpload(upload);
+    }
+
+    if (isDrained && hasPausedReaders) {
+        resumeReading();
+    }
+}
+
+bool Worker::isUploadThrottled(Session* session) const {
+    Upload* upload = session->upload;
+
+    if (session->sliceTransferId != 0 && session->room) {
+        upload = session->room->uploads.value(session->sliceTransferId, nullptr);
+    }
+
+    return upload && upload->writeBytes >= UPLOAD_WRITE_HIGH_WATER_MARK;
+}
+
+void Worker::resumeReading() {
+    QList<QTcpSocket*> paused;
+
+    hasPausedReaders = false;
+
+    for (auto session : std::as_const(sessions)) {
+        if (session->isReadPaused && !isUploadThrottled(session)) {
+            paused.append(session->socket);
+        } else if (session->isReadPaused) {
+            hasPausedReaders = true;
+        }
+    }
+
+    // Processing may close sessions, so each one is looked up again
+    for (auto client : std::as_const(paused)) {
+        Session* session = sessions.value(client);
+
+        if (session) {
+            session->isReadPaused = false;
+            client->setReadBufferSize(0);
+            processIncoming(session);
+        }
+    }
+}
+
+void Worker::finishReceiveFile(Session* session) {
+    Upload* upload = session->upload;
+
+    if (!upload) {
+        return;
+    }
+
+    if (!upload->isWritable || (upload->size != -1 && upload->received != upload->size)) {
+        qDebug() << "Incomplete upload" << upload->fileName << upload->received << "of" << upload->size
+                 << "bytes";
+        abortReceiveFile(session);
+        return;
+    }
+
+    session->upload = nullptr;
+    forgetUpload(session->room, upload);
+
+    // Upload was accepted only if the client is in the room, which is kept until the file is listed
+    rooms.acquire(session->room->id);
+    upload->userName = session->userName;
+    upload->isFinishing = true;
+
+    if (!upload->isBusy) {
+        storeUpload(upload);
+    }
+}
+
+void Worker::storeUpload(Upload* upload) {
+    upload->isBusy = true;
+
+    disks->run(
+        this,
+        [this, upload] {
+            if (upload->hasWriteError || !openUploadFile(upload)) {
+                upload->file.remove();
+                return;
+            }
+
+            if (upload->isStriped) {
+                // Ranges arrived out of order, so the hash is computed from the finished file
+                upload->hash.reset();
+                upload->file.seek(0);
+                upload->hash.addData(&upload->file);
+            }
+
+            upload->file.close();
+            upload->isCommitted = blobs->commit(upload->file.fileName(), upload->hash.result());
+        },
+        [this, upload] { listUpload(upload); });
+}
+
+void Worker::listUpload(Upload* upload) {
+    Room* room = rooms.find(upload->roomId);
+
+    if (upload->isCommitted) {
+        listFile(room, upload->fileName, upload->hash.result(), upload->userName);
+    }
+
+    // Blob is released again if everybody has left meanwhile
+    releaseRoom(room);
+    delete upload;
+}
+
+// Room takes over a reference to the blob
+void Worker::listFile(Room* room, QString fileName, const QByteArray& hash, const QString& userName) {
+    while (room->files.contains(fileName)) {
+        qDebug() << "Duplicate filename" << fileName;
+
+        auto idx = fileName.lastIndexOf('.');
+        if (idx != -1) {
+            fileName = fileName.mid(0, idx) + "-1" + fileName.mid(idx);
+        } else {
+            fileName = fileName + "-1";
+        }
+
+        qDebug() << "Changing to" << fileName;
+    }
+
+    room->files.insert(fileName, hash);
+
+    sendNotice(room, userName + " has uploaded file '" + fileName + "'.");
+    sendRoomEvent(room, protocol::RoomEventKind::FileAdded, fileName);
+}
+
+void Worker::abortReceiveFile(Session* session) {
+    Upload* upload = session->upload;
+
+    if (!upload) {
+        return;
+    }
+
+    session->upload = nullptr;
+    forgetUpload(session->room, upload);
+    discardUpload(upload);
+}
+
+void Worker::discardUpload(Upload* upload) {
+    if (upload->isBusy) {
+        upload->isDiscarded = true;
+        return;
+    }
+
+    // Upload is not accepted until it has a temporary file name
+    if (upload->file.fileName().isEmpty()) {
+        delete upload;
+        return;
+    }
+
+    upload->isBusy = true;
+
+    // Partial file was never announced, nobody can be downloading it
+    disks->run(this, [upload] { upload->file.remove(); }, [upload] { delete upload; });
+}
+
+void Worker::resumeReceiveFile(Session* session, quint64 transferId, QString& filename,
+                               const QString& roomId, qint64 size, const QByteArray& hash) {
+    Room* room;
+    Upload* upload;
+
+    room = joinedRoom(session, roomId);
+    upload = room ? room->parkedUploads.value(transferId, nullptr) : nullptr;
+
+    if (room && !hash.isEmpty() && blobs->acquire(hash)) {
+        // Content is already stored, so the file is listed at once and the client has nothing left to send
+        abortReceiveFile(session);
+
+        if (upload) {
+            room->parkedUploads.remove(transferId);
+            discardUpload(upload);
+            rooms.release(room);
+        }
+
+        qDebug() << "Known content" << hash.toHex() << "listed as" << filename;
+
+        listFile(room, filename, hash, session->userName);
+        sendToClient(session, protocol::FrameType::FileOffset, roomId,
+                     protocol::encodeTransfer(transferId, size));
+        return;
+    }
+
+    if (upload && upload->size == size && upload->fileName == filename) {
+        // Client is a member now, so the reference of the parked upload can be dropped
+        abortReceiveFile(session);
+        room->parkedUploads.remove(transferId);
+        rooms.release(room);
+
+        session->upload = upload;
+
+        qDebug() << "Resumed upload" << filename << "at" << upload->received << "of" << size << "bytes";
+    } else {
+        beginReceiveFile(session, filename, roomId, size);
+        session->upload->transferId = transferId;
+    }
+
+    if (room && session->upload->isWritable) {
+        room->uploads.insert(transferId, session->upload);
+    }
+
+    // Client continues from what is already stored
+    sendToClient(session, protocol::FrameType::FileOffset, roomId,
+                 protocol::encodeTransfer(transferId, session->upload->received));
+}
+
+void Worker::parkReceiveFile(Session* session) {
+    Upload* upload = session->upload;
+    Room* room = session->room;
+
+    // Ranges of striped uploads are not contiguous, so they can't continue from one offset
+    if (!upload || upload->transferId == 0 || upload->isStriped || !upload->isWritable || !room) {
+        abortReceiveFile(session);
+        return;
+    }
+
+    session->upload = nullptr;
+    forgetUpload(room, upload);
+
+    if (room->parkedUploads.contains(upload->transferId)) {
+        qDebug() << "Upload" << upload->fileName << "is already parked";
+
+        discardUpload(upload);
+        return;
+    }
+
+    // Room is kept alive for the client to come back even if nobody else is in it
+    rooms.acquire(room->id);
+    room->parkedUploads.insert(upload->transferId, upload);
+    upload->parkedAt = QDateTime::currentMSecsSinceEpoch();
+
+    qDebug() << "Parked upload" << upload->fileName << "at" << upload->received << "of" << upload->size
+             << "bytes";
+
+    QString roomId = room->id;
+    quint64 transferId = upload->transferId;
+
+    QTimer::singleShot(PARKED_UPLOAD_TIMEOUT, this,
+                       [this, roomId, transferId] { expireParkedUpload(roomId, transferId); });
+}
+
+void Worker::forgetUpload(Room* room, Upload* upload) {
+    if (room && upload->transferId != 0 && room->uploads.value(upload->transferId) == upload) {
+        room->uploads.remove(upload->transferId);
+    }
+}
+
+bool Worker::beginReceiveSlice(Session* session, quint64 transferId, qint64 offset, qint64 length) {
+    Room* room = session->room;
+    Upload* upload = room->uploads.value(transferId, nullptr);
+
+    session->sliceTransferId = 0;
+
+    if (!upload || upload->size == -1 || offset > upload->size || length > upload->size - offset ||
+        (!upload->isStriped && upload->received != 0)) {
+        return false;
+    }
+
+    // Ranges may not overlap, so the received byte count tells when the file is complete
+    auto next = upload->slices.lowerBound(offset);
+
+    if ((next != upload->slices.end() && next.key() < offset + length) ||
+        (next != upload->slices.begin() && std::prev(next).value() > offset)) {
+        return false;
+    }
+
+    upload->slices.insert(offset, offset + length);
+    upload->isStriped = true;
+
+    session->sliceTransferId = transferId;
+    session->slicePosition = offset;
+    session->sliceEnd = offset + length;
+
+    if (length == 0) {
+        receiveSliceChunk(session, QByteArray());
+    }
+
+    return true;
+}
+
+void Worker::receiveSliceChunk(Session* session, const QByteArray& data) {
+    Room* room = session->room;
+    Upload* upload = room->uploads.value(session->sliceTransferId, nullptr);
+    quint64 transferId = session->sliceTransferId;
+
+    if (!upload || !upload->isWritable || session->slicePosition + data.size() > session->sliceEnd) {
+        messageLogger("Received BAD", session->socket, "Chunk does not belong to an upload slice");
+        session->sliceTransferId = 0;
+        return;
+    }
+
+    // Every data connection writes at its own position of the shared temporary file
+    if (!data.isEmpty()) {
+        writeUpload(upload, session->slicePosition, data);
+    }
+
+    session->slicePosition += data.size();
+    upload->received += data.size();
+
+    if (session->slicePosition == session->sliceEnd) {
+        // Client sends FileEnd on its main connection once every slice is acknowledged
+        session->sliceTransferId = 0;
+        sendToClient(session, protocol::FrameType::FileOffset, room->id,
+                     protocol::encodeTransfer(transferId, session->sliceEnd));
+    }
+}
+
+void Worker::expireParkedUpload(const QString& roomId, quint64 transferId) {
+    Room* room;
+    Upload* upload;
+
+    room = rooms.find(roomId);
+    upload = room ? room->parkedUploads.value(transferId, nullptr) : nullptr;
+
+    // Upload may have been resumed and parked again since the timer was started
+    if (!upload || QDateTime::currentMSecsSinceEpoch() - upload->parkedAt < PARKED_UPLOAD_TIMEOUT) {
+        return;
+    }
+
+    qDebug() << "Expired upload" << upload->fileName << "in room" << roomId;
+
+    room->parkedUploads.remove(transferId);
+    discardUpload(upload);
+
+    releaseRoom(room);
+}
+
+void Worker::sendFile(Session* session, const QString& filename, quint64 transferId, qint64 offset,
+                      qint64 length) {
+    Room* room = session->room;
+    Download* download;
+
+    auto it = room->files.constFind(filename);
+    if (it == room->files.constEnd()) {
+        qDebug() << "No file" << filename << "in room" << room->id;
+        return;
+    }
+
+    download = new Download;
+    download->hash = it.value();
+    download->mapping = nullptr;
+    download->transferId = qFromBigEndian<quint64>(it.value().constData());
+    download->fileName = filename;
+    download->roomId = room->id;
+    download->isText = session->protocolVersion < protocol::FRAMED_VERSION;
+    download->started = false;
+#ifdef Q_OS_LINUX
+    download->isZeroCopy = !download->isText;
+#else
+    download->isZeroCopy = false;
+#endif
+    download->codec = download->isText ? compression::Codec::None : session->codec;
+    download->size = 0;
+    download->position = 0;
+    download->end = 0;
+    download->readEnd = 0;
+    download->isReading = false;
+    download->hasReadError = false;
+    download->cacheVariant = -1;
+    download->isOpening = true;
+    download->isOpen = false;
+    download->isDiscarded = false;
+
+    // Downloads of one client are sent one after another, so this one waits in the queue while it opens
+    session->downloads.enqueue(download);
+
+    disks->run(
+        this,
+        [this, download, transferId, offset, length] {
+            openDownload(download, transferId, offset, length);
+        },
+        [this, session, download, length] { downloadOpened(session, download, length < 0); });
+}
+
+void Worker::openDownload(Download* download, quint64 transferId, qint64 offset, qint64 length) {
+    download->file.setFileName(blobs->path(download->hash));
+
+    if (!download->file.open(QIODevice::ReadOnly)) {
+        qDebug() << download->file.fileName() << download->file.errorString();
+        return;
+    }
+
+    download->isOpen = true;
+
+    // Concurrent downloads of a blob read from one shared mapping instead of copying it to the heap
+    download->mapping = blobs->acquireMapping(download->hash);
+
+    // Content that is already compressed is sent as it is, and the rest can't use sendfile(2)
+    if (download->codec != compression::Codec::None &&
+        !compression::isCompressible(download->file.peek(compression::SAMPLE_SIZE))) {
+        download->codec = compression::Codec::None;
+    }
+
+    // Read-ahead only brings the pages of mapped blobs into the page cache, which sendfile(2) relies on
+    if (download->codec != compression::Codec::None || !download->mapping) {
+        download->isZeroCopy = false;
+    }
+
+    download->size = download->file.size();
+    download->end = download->size;
+
+    if (length >= 0) {
+        // Slice of a striped download, an empty one when the content differs from the one requested
+        bool isSameContent = transferId == 0 || transferId == download->transferId;
+
+        offset = isSameContent ? qMin(offset, download->end) : 0;
+        download->end = isSameContent ? offset + qMin(length, download->end - offset) : 0;
+        download->position = offset;
+    } else if (transferId == download->transferId && offset > 0 && offset <= download->size) {
+        // Partial file of the client is only continued if it has the same content
+        download->position = offset;
+    }
+
+    download->readEnd = download->position;
+}
+
+// Next block of a download, so sending it never waits for the disk
+static void readDownloadBlock(Download* download, qint64 position, qint64 size) {
+    if (download->mapping) {
+        // Touching every page faults it in here instead of on the worker
+        volatile char touched;
+
+        for (qint64 offset = 0; offset < size; offset += MIN_PAGE_SIZE) {
+            touched = download->mapping->data[position + offset];
+        }
+
+        touched = download->mapping->data[position + size - 1];
+        Q_UNUSED(touched);
+        return;
+    }
+
+    if (!download->file.seek(position)) {
+        qDebug() << download->file.fileName() << download->file.errorString();
+        download->hasReadError = true;
+        return;
+    }
+
+    download->block = download->file.read(size);
+
+    if (download->block.size() != size) {
+        qDebug() << "Short read of" << download->file.fileName() << download->file.errorString();
+        download->hasReadError = true;
+    }
+}
+
+void Worker::downloadOpened(Session* session, Download* download, bool isWholeFile) {
+    download->isOpening = false;
+
+    // Session is still here unless it has closed its downloads meanwhile
+    if (download->isDiscarded) {
+        closeDownload(download);
+        return;
+    }
+
+    if (!download->isOpen) {
+        session->downloads.removeOne(download);
+        closeDownload(download);
+        sendFileChunks(session);
+        return;
+    }
+
+    if (isWholeFile && download->position == 0 && download->end <= HOT_FILE_MAX_SIZE) {
+        // Small file is sent from memory, or recorded while it is sent so the next download is
+        int variant = hotFileVariant(session, download);
+
+        download->cached = hotFiles.find(download->roomId, download->fileName, variant);
+        download->cacheVariant = download->cached.isEmpty() ? variant : -1;
+        download->isZeroCopy = false;
+    }
+
+    sendFileChunks(session);
+
+    // Data connections are part of a download already announced on the main connection
+    if (session->isData || !session->room) {
+        return;
+    }
+
+    sendNotice(session->room, session->userName + " has downloaded file '" + download->fileName + "'.");
+}
+
+void Worker::readDownload(Session* session, Download* download) {
+    qint64 position = download->readEnd;
+    qint64 size = qMin(READ_AHEAD_SIZE, download->end - position);
+
+    if (download->isReading || size <= 0 || download->readEnd - download->position >= READ_AHEAD_SIZE) {
+        return;
+    }
+
+    download->isReading = true;
+
+    disks->run(
+        this, [download, position, size] { readDownloadBlock(download, position, size); },
+        [this, session, download, size] { downloadRead(session, download, size); });
+}
+
+void Worker::downloadRead(Session* session, Download* download, qint64 size) {
+    download->isReading = false;
+
+    // Session is still here unless it has closed its downloads meanwhile
+    if (download->isDiscarded) {
+        closeDownload(download);
+        return;
+    }
+
+    if (download->hasReadError) {
+        // Client finds the file shorter than announced, as it would if the read failed on the worker
+        download->end = download->readEnd;
+    } else {
+        download->readAhead.append(download->block);
+        download->readEnd += size;
+    }
+
+    download->block.clear();
+    sendFileChunks(session);
+}
+
+void Worker::sendFileChunks(Session* session) {
+    QTcpSocket* client = session->socket;
+    QString messageToWrite;
+    QByteArray room;
+    QByteArray chunk;
+    QByteArray packed;
+    QByteArray header;
+    qint64 zeroCopyBudget;
+
+    zeroCopyBudget = ZERO_COPY_BUDGET;
+
+    // File is read only as fast as the socket drains, so memory use does not depend on file size
+    while (!session->downloads.isEmpty() && client->bytesToWrite() < protocol::FILE_HIGH_WATER_MARK) {
+        Download* download = session->downloads.head();
+        room = download->roomId.toUtf8();
+
+        // Messages queued meanwhile go before the next chunk
+        flushClient(session);
+
+        if (download->isOpening) {
+            break;
+        }
+
+        if (!download->cached.isEmpty()) {
+            // Whole file as an earlier download of the same encoding has sent it
+            client->write(download->cached);
+            messageLogger("Sent FILE", client,
+                          "[sendfile " + download->roomId + "] '" + download->fileName + "' _CACHED_DATA_");
+
+            finishDownload(session);
+            continue;
+        }
+
+        if (!download->started) {
+            download->started = true;
+
+            if (download->isText) {
+                messageToWrite = "/sendfile '" + download->fileName + "' " + download->roomId + ":";
+
+                writeDownloadData(client, download, messageToWrite.toUtf8());
+                messageLogger("Sent FILE", client, messageToWrite + "_BASE64_DATA_");
+            } else {
+                writeDownloadData(client, download,
+                                  protocol::encodeFrame(protocol::FrameType::FileBegin, room,
+                                                        protocol::encodeFileBegin(download->fileName,
+                                                                                  download->size)));
+                messageLogger("Sent FILE", client,
+                              "[sendfile " + download->roomId + "] '" + download->fileName + "' _RAW_DATA_");
+
+                if (session->protocolVersion >= protocol::RESUMABLE_VERSION) {
+                    writeDownloadData(client, download,
+                                      protocol::encodeFrame(protocol::FrameType::FileOffset, room,
+                                                            protocol::encodeTransfer(download->transferId,
+                                                                                     download->position)));
+                }
+            }
+        }
+
+        readDownload(session, download);
+
+        if (download->position == download->readEnd && download->position < download->end) {
+            // Block is still being read, its completion continues
+            break;
+        }
+
+        if (download->isZeroCopy && client->bytesToWrite() == 0 && download->position < download->end) {
+            if (zeroCopyBudget <= 0) {
+                // Nothing is left in the write buffer to trigger bytesWritten(), so continue later
+                QPointer<QTcpSocket> guard(client);
+                QTimer::singleShot(0, this, [this, guard] {
+                    Session* session = sessions.value(guard.data());
+
+                    if (guard && session) {
+                        sendFileChunks(session);
+                    }
+                });
+                break;
+            }
+
+            zeroCopyBudget -= sendFileChunkZeroCopy(session, download);
+            continue;
+        }
+
+        chunk = readFileChunk(download, protocol::FILE_CHUNK_SIZE);
+
+        if (!chunk.isEmpty() && download->isText) {
+            writeDownloadData(client, download, base64::encode(chunk));
+        } else if (!chunk.isEmpty() && download->codec != compression::Codec::None &&
+                   compression::compressChunk(download->codec, chunk, packed) &&
+                   packed.size() < chunk.size() - (chunk.size() >> compression::MIN_SAVING_SHIFT)) {
+            writeDownloadData(client, download,
+                              protocol::encodeFrame(protocol::FrameType::PackedChunk, room, packed));
+        } else if (!chunk.isEmpty()) {
+            // Chunk did not shrink enough, the rest of the file is sent raw
+            download->codec = compression::Codec::None;
+            header = protocol::encodeFrameHeader(protocol::FrameType::FileChunk, room, chunk.size());
+            writeDownloadData(client, download, header);
+            writeDownloadData(client, download, chunk);
+        } else if (download->isText) {
+            // Messages held back while the "/sendfile" line was open are written by the next flushClient()
+            writeDownloadData(client, download, "\n");
+            finishDownload(session);
+        } else {
+            writeDownloadData(client, download, protocol::encodeFrame(protocol::FrameType::FileEnd, room));
+            finishDownload(session);
+        }
+    }
+
+    updateQueuedBytes(session);
+}
+
+// Bytes that have been sent without readFileChunk() are dropped from the read-ahead
+static void skipFileChunk(Download* download, qint64 size) {
+    if (!download->mapping) {
+        download->readAhead.remove(0, size);
+    }
+
+    download->position += size;
+}
+
+QByteArray Worker::readFileChunk(Download* download, qint64 maxSize) {
+    qint64 position = download->position;
+    qint64 size = qMin(maxSize, download->readEnd - position);
+    QByteArray chunk;
+
+    if (download->mapping) {
+        // Chunk points into the shared mapping, the socket's write buffer gets the only copy
+        chunk = QByteArray::fromRawData(download->mapping->data + position, size);
+    } else {
+        chunk = download->readAhead.first(size);
+    }
+
+    skipFileChunk(download, size);
+    return chunk;
+}
+
+void Worker::writeDownloadData(QTcpSocket* client, Download* download, const QByteArray& data) {
+    client->write(data);
+
+    if (download->cacheVariant != -1) {
+        download->captured += data;
+    }
+}
+
+void Worker::finishDownload(Session* session) {
+    Download* download = session->downloads.dequeue();
+
+    if (download->cacheVariant != -1) {
+        hotFiles.insert(download->roomId, download->fileName, download->cacheVariant, download->captured);
+    }
+
+    closeDownload(download);
+}
+
+void Worker::closeDownload(Download* download) {
+    if (download->isOpening || download->isReading) {
+        download->isDiscarded = true;
+        return;
+    }
+
+    if (download->mapping) {
+        blobs->releaseMapping(download->hash);
+    }
+
+    delete download;
+}
+
+qint64 Worker::sendFileChunkZeroCopy(Session* session, Download* download) {
+#ifdef Q_OS_LINUX
+    QTcpSocket* client = session->socket;
+    QByteArray header;
+    qint64 chunkSize;
+    ssize_t headerSent;
+    ssize_t fileSent;
+    off_t offset;
+    int socketFd;
+
+    // Only bytes a DiskPool task has brought into the page cache, so sendfile(2) does not wait for the disk
+    chunkSize = qMin(download->readEnd - download->position, ZERO_COPY_CHUNK_SIZE);
+    header = protocol::encodeFrameHeader(protocol::FrameType::FileChunk, download->roomId.toUtf8(),
+                                         chunkSize);
+    socketFd = client->socketDescriptor();
+
+    // Write buffer is empty, so writing to the descriptor directly keeps the stream in order
+    headerSent = ::send(socketFd, header.constData(), header.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+
+    if (headerSent < header.size()) {
+        // Socket is full, the rest of the frame goes through the write buffer
+        client->write(header.mid(qMax<ssize_t>(headerSent, 0)));
+        client->write(readFileChunk(download, chunkSize));
+
+        Metrics::instance().bytesSent += qMax<ssize_t>(headerSent, 0);
+        return qMax<ssize_t>(headerSent, 0);
+    }
+
+    // Offset is passed on its own, sendfile(2) leaves the position of file alone
+    offset = download->position;
+    fileSent = ::sendfile(socketFd, download->file.handle(), &offset, chunkSize);
+
+    if (fileSent < 0) {
+        if (errno != EAGAIN && errno != EWOULDBLOCK) {
+            qDebug() << "sendfile() failed for" << download->fileName << ':' << strerror(errno);
+            download->isZeroCopy = false;
+        }
+
+        fileSent = 0;
+    }
+
+    skipFileChunk(download, fileSent);
+
+    if (fileSent < chunkSize) {
+        client->write(readFileChunk(download, chunkSize - fileSent));
+    }
+
+    // Bytes written by Qt are counted in bytesWritten(), these bypassed the socket buffer
+    Metrics::instance().bytesSent += headerSent + fileSent;
+
+    return headerSent + fileSent;
+#else
+    Q_UNUSED(session);
+
+    download->isZeroCopy = false;
+    return 0;
+#endif
+}
+
+void Worker::bytesWritten(qint64 bytes) {
+    Session* session = sessions.value((QTcpSocket*) sender());
+
+    Metrics::instance().bytesSent += bytes;
+
+    if (session) {
+        // Messages first, file data fills the socket buffer up to its own mark after them
+        flushClient(session);
+        sendFileChunks(session);
+    }
+}
+
+Room* Worker::joinedRoom(Session* session, const QString& roomId) const {
+    // Commands only act on the room the client has joined
+    if (!session->room || session->room->id != roomId) {
+        return nullptr;
+    }
+
+    return session->room;
+}
+
+bool Worker::releaseRoom(Room* room) {
+    QString roomId = room->id;
+
+    if (room->refCount == 1) {
+        // Blobs are removed when the last room listing them is deleted
+        for (const auto& hash : std::as_const(room->files)) {
+            blobs->release(hash);
+        }
+    }
+
+    if (!rooms.release(room)) {
+        return false;
+    }
+
+    hotFiles.removeRoom(roomId);
+
+    Metrics::instance().rooms--;
+    qDebug() << "Deleted room" << roomId << "(no more users in room)" << '\n';
+
+    return true;
+}
+
+void Worker::processJoinRoom(Session* session, QString& userName, QString& roomId) {
+    QTcpSocket* client = session->socket;
+    Worker* owner;
+    Room* room;
+
+    if (session->room) {
+        messageLogger("Received BAD", client, "Already joined room " + session->room->id);
+        return;
+    }
+
+    if (roomId.toUtf8().size() > protocol::MAX_ROOM_ID_LENGTH) {
+        messageLogger("Received BAD", client,
+                      "Room ID is too long: " + roomId.left(protocol::MAX_ROOM_ID_LENGTH));
+        return;
+    }
+
+    if (roomId == "new") {
+        roomId = generateNewRoomId();
+
+        sendToClient(session, protocol::FrameType::RoomId, roomId, userName);
+        messageLogger("Sent", client, "/roomid " + roomId + ":" + userName);
+    }
+
+    owner = roomOwner(roomId);
+
+    if (owner != this) {
+        handOverClient(session, owner, userName, roomId);
+        return;
+    }
+
+    if (session->isData) {
+        // Data connections can only attach to an existing room and stay invisible to its members
+        room = rooms.find(roomId);
+
+        if (!room) {
+            messageLogger("Received BAD", client, "Can't attach to room " + roomId);
+            return;
+        }
+
+        rooms.acquire(roomId);
+        session->userName = userName;
+        session->room = room;
+
+        qDebug() << "Attached data connection of" << userName << "to room" << roomId;
+        return;
+    }
+
+    room = rooms.acquire(roomId);
+
+    if (room->refCount == 1) {
+        Metrics::instance().rooms++;
+    }
+
+    if (room->members.contains(userName)) {
+        QString newUserName = uniqueUserName(room, userName);
+
+        qDebug() << "Duplicate username" << userName << ", changing to" << newUserName;
+        userName = newUserName;
+    }
+
+    session->userName = userName;
+    session->room = room;
+    room->members.insert(userName, session);
+
+    sendToClient(session, protocol::FrameType::UserId, roomId, userName);
+    messageLogger("Sent", userName, "/userid " + roomId + ':' + userName);
+
+    sendNotice(room, userName + " has joined.");
+
+    // New member gets the whole state, the others only the change
+    sendRoomEvent(room, protocol::RoomEventKind::UserJoined, userName, session);
+    sendRoomState(room, session);
+}
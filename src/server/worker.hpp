@@ -0,0 +1,128 @@
+#ifndef WORKER_HPP
+#define WORKER_HPP
+
+#include <QHash>
+#include <QObject>
+#include <QTcpSocket>
+
+#include "../protocol.hpp"
+#include "blobstore.hpp"
+#include "diskpool.hpp"
+#include "hotfilecache.hpp"
+#include "roomregistry.hpp"
+#include "session.hpp"
+
+// Worker owns the sockets and rooms of one event-loop thread, rooms are pinned by their ID hash
+class Worker : public QObject {
+    Q_OBJECT
+   public:
+    Worker(int _index, BlobStore* _blobs, DiskPool* _disks, QObject* parent = nullptr);
+    ~Worker();
+
+    void setWorkers(const QList<Worker*>& allWorkers);
+    void addClient(qintptr socketDescriptor);
+
+   private:
+    // Clients
+    void connectClient(QTcpSocket* client);
+    void removeClient(Session* session);
+    void handOverClient(Session* session, Worker* owner, const QString& userName, const QString& roomId);
+    void adoptClient(Session* session, QString userName, QString roomId);
+
+    // Protocol
+    void processIncoming(Session* session);
+    protocol::Command processTextLine(Session* session, QByteArrayView line);
+    void processFrame(Session* session, const protocol::Frame& frame);
+    void sendToClient(Session* session, protocol::FrameType type, const QString& roomId,
+                      const QString& data);
+    void sendToClient(Session* session, protocol::FrameType type, const QString& roomId,
+                      const QByteArray& payload);
+    void writeToClient(Session* session, const QByteArray& data, OutputKind kind = OutputKind::Message);
+    void shedOutput(Session* session);
+    void broadcast(Room* room, protocol::FrameType type, const QString& data,
+                   OutputKind kind = OutputKind::Message);
+    void flushClient(Session* session);
+    void flushPendingWrites();
+    void updateQueuedBytes(Session* session);
+    bool isUploadThrottled(Session* session) const;
+    void resumeReading();
+
+    // Messages
+    void sendTextMessage(Room* room, const QString& userName, const QString& msg,
+                         OutputKind kind = OutputKind::Message);
+    void sendNotice(Room* room, const QString& msg);
+
+    // Users and files
+    void sendRoomEvent(Room* room, protocol::RoomEventKind kind, const QString& name,
+                       Session* except = nullptr);
+    void sendRoomState(Room* room, Session* session);
+
+    // Files
+    bool beginReceiveFile(Session* session, QString& filename, const QString& roomId, qint64 size);
+    void resumeReceiveFile(Session* session, quint64 transferId, QString& filename, const QString& roomId,
+                           qint64 size, const QByteArray& hash);
+    void parkReceiveFile(Session* session);
+    void forgetUpload(Room* room, Upload* upload);
+    bool beginReceiveSlice(Session* session, quint64 transferId, qint64 offset, qint64 length);
+    void receiveSliceChunk(Session* session, const QByteArray& data);
+    void expireParkedUpload(const QString& roomId, quint64 transferId);
+    bool beginReceiveTextFile(Session* session);
+    void receiveTextFileData(Session* session);
+    void receiveFileChunk(Session* session, const QByteArray& data);
+    void finishReceiveFile(Session* session);
+    void abortReceiveFile(Session* session);
+
+    // Upload files are written, stored and removed by DiskPool tasks, completions come back here
+    void writeUpload(Upload* upload, qint64 offset, const QByteArray& data);
+    void startUploadWrites(Upload* upload);
+    void uploadWritten(Upload* upload, qint64 size);
+    void storeUpload(Upload* upload);
+    void listUpload(Upload* upload);
+    void listFile(Room* room, QString fileName, const QByteArray& hash, const QString& userName);
+    void discardUpload(Upload* upload);
+
+    void sendFile(Session* session, const QString& filename, quint64 transferId = 0, qint64 offset = 0,
+                  qint64 length = -1);
+    void openDownload(Download* download, quint64 transferId, qint64 offset, qint64 length);  // DiskPool
+    void downloadOpened(Session* session, Download* download, bool isWholeFile);
+    void readDownload(Session* session, Download* download);
+    void downloadRead(Session* session, Download* download, qint64 size);
+    void sendFileChunks(Session* session);
+    QByteArray readFileChunk(Download* download, qint64 maxSize);
+    void writeDownloadData(QTcpSocket* client, Download* download, const QByteArray& data);
+    void finishDownload(Session* session);
+    void closeDownload(Download* download);
+    qint64 sendFileChunkZeroCopy(Session* session, Download* download);
+
+    // Rooms
+    void processJoinRoom(Session* session, QString& userName, QString& roomId);
+    Room* joinedRoom(Session* session, const QString& roomId) const;
+    bool releaseRoom(Room* room);
+    QString generateNewRoomId();
+    Worker* roomOwner(const QString& roomId) const;
+
+    int index;
+    QList<Worker*> workers;
+    BlobStore* blobs;
+    DiskPool* disks;
+    qint64 outputLimit;  // bytes queued per client, see shedOutput()
+    bool hasPausedReaders;  // some session waits for its upload to be written, see resumeReading()
+
+    QByteArray lineBuffer;
+    QByteArray decodeBuffer;
+
+    QHash<QTcpSocket*, Session*> sessions;
+    QSet<Session*> pendingWrites;
+    RoomRegistry rooms;
+    HotFileCache hotFiles;
+
+    // Benchmarks drive joins and broadcasts with sessions that have no socket
+    friend class ServerBench;
+
+   public slots:
+    void readyRead();
+    void disconnected();
+    void bytesWritten(qint64 bytes);
+};
+
+#endif  // WORKER_HPP
@@ -0,0 +1,201 @@
+#include <QRandomGenerator>
+#include <QtTest>
+
+#include "../base64.hpp"
+
+// Longest input where every length is checked, covers every tail the vector blocks leave to scalar code
+#define SHORT_LENGTH_LIMIT 300
+
+// Base64 of the text protocol against Qt's codec, once with every instruction set this CPU has
+class Base64Test : public QObject {
+    Q_OBJECT
+
+   private:
+    static void addImplementationRows();
+    static QList<qsizetype> lengths();
+    static QByteArray randomBytes(qsizetype size);
+
+    const char* defaultImplementation;
+
+   private slots:
+    void initTestCase();
+    void init();
+    void cleanup();
+
+    void encode_data();
+    void encode();
+    void decode_data();
+    void decode();
+    void decodeSplit_data();
+    void decodeSplit();
+    void decodeUnpadded_data();
+    void decodeUnpadded();
+    void decodeInvalid_data();
+    void decodeInvalid();
+};
+
+void Base64Test::addImplementationRows() {
+    QTest::addColumn<QByteArray>("implementation");
+
+    QTest::newRow("scalar") << QByteArray("scalar");
+    QTest::newRow("sse4.1") << QByteArray("sse4.1");
+    QTest::newRow("avx2") << QByteArray("avx2");
+}
+
+QList<qsizetype> Base64Test::lengths() {
+    QList<qsizetype> result;
+
+    for (qsizetype length = 0; length <= SHORT_LENGTH_LIMIT; length++) {
+        result.append(length);
+    }
+
+    // File chunks and lengths around them
+    for (qsizetype length : {(1 << 12) - 1, 1 << 12, (3 << 14) - 1, 3 << 14, (3 << 14) + 1, 1 << 20}) {
+        result.append(length);
+    }
+
+    return result;
+}
+
+QByteArray Base64Test::randomBytes(qsizetype size) {
+    QByteArray bytes(size, Qt::Uninitialized);
+
+    for (auto& byte : bytes) {
+        byte = static_cast<char>(QRandomGenerator::global()->bounded(256));
+    }
+
+    return bytes;
+}
+
+void Base64Test::initTestCase() {
+    defaultImplementation = base64::implementation();
+    qDebug() << "Detected instruction set:" << defaultImplementation;
+}
+
+void Base64Test::init() {
+    QFETCH(QByteArray, implementation);
+
+    if (!base64::setImplementation(implementation.constData())) {
+        QSKIP("This CPU doesn't have the instruction set");
+    }
+
+    QCOMPARE(base64::implementation(), implementation.constData());
+}
+
+void Base64Test::cleanup() {
+    base64::setImplementation(defaultImplementation);
+}
+
+void Base64Test::encode_data() {
+    addImplementationRows();
+}
+
+void Base64Test::encode() {
+    for (qsizetype length : lengths()) {
+        QByteArray data = randomBytes(length);
+        QByteArray encoded = base64::encode(data);
+
+        QCOMPARE(encoded.size(), base64::encodedSize(length));
+        QCOMPARE(encoded, data.toBase64());
+    }
+}
+
+void Base64Test::decode_data() {
+    addImplementationRows();
+}
+
+void Base64Test::decode() {
+    for (qsizetype length : lengths()) {
+        QByteArray text = randomBytes(length).toBase64();
+        QByteArray decoded;
+
+        QVERIFY(base64::decode(text, decoded));
+        QCOMPARE(decoded, QByteArray::fromBase64(text));
+    }
+}
+
+void Base64Test::decodeSplit_data() {
+    addImplementationRows();
+}
+
+// Uploads arrive in pieces of any size, a group may be cut anywhere
+void Base64Test::decodeSplit() {
+    for (qsizetype length = 0; length <= SHORT_LENGTH_LIMIT; length += 7) {
+        QByteArray data = randomBytes(length);
+        QByteArray text = data.toBase64();
+        QByteArray out(base64::decodedSizeBound(text.size() + 3), Qt::Uninitialized);
+
+        // Cut at one position
+        for (qsizetype split = 0; split <= text.size(); split++) {
+            base64::Decoder decoder;
+            qsizetype first = decoder.decode(text.constData(), split, out.data());
+            qsizetype second =
+                decoder.decode(text.constData() + split, text.size() - split, out.data() + first);
+            qsizetype tail = decoder.finish(out.data() + first + second);
+
+            QVERIFY2(first >= 0 && second >= 0 && tail >= 0,
+                     qPrintable("split at " + QString::number(split)));
+            QCOMPARE(out.left(first + second + tail), data);
+        }
+
+        // Pieces of the same size
+        for (qsizetype piece = 1; piece <= 9; piece++) {
+            base64::Decoder decoder;
+            qsizetype written = 0;
+
+            for (qsizetype pos = 0; pos < text.size(); pos += piece) {
+                qsizetype n = decoder.decode(text.constData() + pos, qMin(piece, text.size() - pos),
+                                             out.data() + written);
+
+                QVERIFY2(n >= 0, qPrintable("pieces of " + QString::number(piece)));
+                written += n;
+            }
+
+            written += decoder.finish(out.data() + written);
+            QCOMPARE(out.left(written), data);
+        }
+    }
+}
+
+void Base64Test::decodeUnpadded_data() {
+    addImplementationRows();
+}
+
+void Base64Test::decodeUnpadded() {
+    for (qsizetype length = 0; length <= SHORT_LENGTH_LIMIT; length++) {
+        QByteArray data = randomBytes(length);
+        QByteArray text = data.toBase64(QByteArray::OmitTrailingEquals);
+        QByteArray decoded;
+
+        QVERIFY(base64::decode(text, decoded));
+        QCOMPARE(decoded, data);
+    }
+}
+
+void Base64Test::decodeInvalid_data() {
+    addImplementationRows();
+}
+
+void Base64Test::decodeInvalid() {
+    QByteArray text = randomBytes(SHORT_LENGTH_LIMIT).toBase64();
+    QByteArray decoded;
+
+    // Invalid character at every position, in vector blocks as well as in the tail
+    for (qsizetype pos = 0; pos < text.size(); pos++) {
+        QByteArray broken = text;
+
+        broken[pos] = '*';
+
+        QVERIFY2(!base64::decode(broken, decoded), qPrintable("'*' at " + QString::number(pos)));
+        QVERIFY(QByteArray::fromBase64Encoding(broken, QByteArray::AbortOnBase64DecodingErrors)
+                    .decodingStatus != QByteArray::Base64DecodingStatus::Ok);
+    }
+
+    // Nothing may follow padding, and a single character is not a group
+    QVERIFY(!base64::decode("QQ==QUJD", decoded));
+    QVERIFY(!base64::decode(text + "Q", decoded));
+}
+
+QTEST_GUILESS_MAIN(Base64Test)
+
+#include "base64test.moc"